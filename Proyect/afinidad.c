@@ -0,0 +1,266 @@
+/* pthread_setaffinity_np y las macros CPU_* son extensiones de GNU */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "afinidad.h"
+
+#define RUTA_CPU "/sys/devices/system/cpu/cpu%d/"
+#define MAX_INDICES_CACHE 8 /* Niveles de caché que se buscan en sysfs */
+
+/**
+ * @brief Posición de una CPU en la máquina.
+ */
+typedef struct {
+    int cpu;
+    long paquete; /* physical_package_id */
+    long nucleo; /* core_id, único dentro del paquete */
+    long l3; /* Id de su L3, o el paquete si no se conoce */
+    int rango; /* 0 para el primer hilo hardware de su núcleo, 1 para su hermano SMT... */
+    int puesto; /* Núcleos de su dominio de L3 con el mismo rango y una CPU menor */
+} CpuTopologia;
+
+/**
+ * @brief Lee un entero de un fichero de sysfs.
+ *
+ * @return El valor, o defecto si el fichero no existe o no empieza por un entero.
+ */
+static long leer_entero(const char *ruta, long defecto) {
+    FILE *f;
+    long valor;
+
+    if ((f = fopen(ruta, "r")) == NULL) {
+        return defecto;
+    }
+    if (fscanf(f, "%ld", &valor) != 1) {
+        valor = defecto;
+    }
+    fclose(f);
+    return valor;
+}
+
+/**
+ * @brief Id de la L3 de una CPU, o -1 si sysfs no la describe.
+ */
+static long dominio_l3(int cpu) {
+    char ruta[256];
+
+    for (int i = 0; i < MAX_INDICES_CACHE; i++) {
+        snprintf(ruta, sizeof(ruta), RUTA_CPU "cache/index%d/level", cpu, i);
+        if (leer_entero(ruta, -1) == 3) {
+            snprintf(ruta, sizeof(ruta), RUTA_CPU "cache/index%d/id", cpu, i);
+            return leer_entero(ruta, -1);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief CPUs que caben en la cuota de tiempo del cgroup, o 0 si no hay cuota.
+ *
+ * Prueba cpu.max de cgroup v2 y, si no está, cpu.cfs_quota_us de cgroup v1.
+ */
+static int cpus_de_cuota(void) {
+    long cuota = -1, periodo = 0;
+    FILE *f;
+
+    if ((f = fopen("/sys/fs/cgroup/cpu.max", "r")) != NULL) {
+        /* "max 100000" sin cuota, "<cuota> <periodo>" con ella */
+        if (fscanf(f, "%ld %ld", &cuota, &periodo) != 2) {
+            cuota = -1;
+        }
+        fclose(f);
+    } else {
+        cuota = leer_entero("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", -1);
+        periodo = leer_entero("/sys/fs/cgroup/cpu/cpu.cfs_period_us", 0);
+    }
+    if (cuota <= 0 || periodo <= 0) {
+        return 0;
+    }
+    return (int)((cuota + periodo - 1) / periodo);
+}
+
+/**
+ * @brief Orden de colocación: por rango SMT, luego por puesto en la L3 y luego alternando L3.
+ */
+static int comparar_cpus(const void *a, const void *b) {
+    const CpuTopologia *x = (const CpuTopologia *)a, *y = (const CpuTopologia *)b;
+
+    if (x->rango != y->rango) {
+        return x->rango - y->rango;
+    }
+    if (x->puesto != y->puesto) {
+        return x->puesto - y->puesto;
+    }
+    if (x->l3 != y->l3) {
+        return x->l3 < y->l3 ? -1 : 1;
+    }
+    return x->cpu - y->cpu;
+}
+
+/**
+ * @brief Calcula el rango SMT y el puesto en la L3 de cada CPU y las ordena para colocar hilos.
+ */
+static void ordenar_cpus(Topologia *topologia, CpuTopologia *cpus, int n) {
+    for (int i = 0; i < n; i++) {
+        cpus[i].rango = 0;
+        for (int j = 0; j < n; j++) {
+            if (cpus[j].paquete == cpus[i].paquete && cpus[j].nucleo == cpus[i].nucleo && cpus[j].cpu < cpus[i].cpu) {
+                cpus[i].rango++;
+            }
+        }
+    }
+    topologia->nucleos = topologia->dominios_l3 = 0;
+    for (int i = 0; i < n; i++) {
+        cpus[i].puesto = 0;
+        for (int j = 0; j < n; j++) {
+            if (cpus[j].l3 == cpus[i].l3 && cpus[j].rango == cpus[i].rango && cpus[j].cpu < cpus[i].cpu) {
+                cpus[i].puesto++;
+            }
+        }
+        topologia->nucleos += cpus[i].rango == 0;
+        topologia->dominios_l3 += cpus[i].rango == 0 && cpus[i].puesto == 0;
+    }
+    qsort(cpus, (size_t)n, sizeof(CpuTopologia), comparar_cpus);
+    for (int i = 0; i < n; i++) {
+        topologia->orden[i] = cpus[i].cpu;
+    }
+    topologia->n_cpus = n;
+}
+
+int afinidad_detectar(Topologia *topologia) {
+    static CpuTopologia cpus[AFINIDAD_MAX_CPUS];
+    char ruta[256];
+    cpu_set_t permitidas;
+    long en_linea;
+    int n = 0, cuota;
+
+    /* El cpuset del cgroup ya está aplicado en la afinidad heredada */
+    if (sched_getaffinity(0, sizeof(permitidas), &permitidas) != 0) {
+        CPU_ZERO(&permitidas);
+        en_linea = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long c = 0; c < en_linea && c < AFINIDAD_MAX_CPUS; c++) {
+            CPU_SET(c, &permitidas);
+        }
+    }
+    for (int c = 0; c < AFINIDAD_MAX_CPUS && c < CPU_SETSIZE; c++) {
+        if (!CPU_ISSET(c, &permitidas)) {
+            continue;
+        }
+        cpus[n].cpu = c;
+        snprintf(ruta, sizeof(ruta), RUTA_CPU "topology/physical_package_id", c);
+        cpus[n].paquete = leer_entero(ruta, 0);
+        /* Sin core_id cada CPU cuenta como un núcleo propio */
+        snprintf(ruta, sizeof(ruta), RUTA_CPU "topology/core_id", c);
+        cpus[n].nucleo = leer_entero(ruta, -1 - c);
+        cpus[n].l3 = dominio_l3(c);
+        if (cpus[n].l3 == -1) {
+            cpus[n].l3 = cpus[n].paquete;
+        }
+        n++;
+    }
+    if (n == 0) {
+        return -1;
+    }
+    topologia->permitidas = n;
+    ordenar_cpus(topologia, cpus, n);
+    /* Con cuota, más CPUs que las que caben en ella solo reparten el mismo tiempo */
+    cuota = cpus_de_cuota();
+    if (cuota > 0 && cuota < topologia->n_cpus) {
+        topologia->n_cpus = cuota;
+    }
+    return 0;
+}
+
+/**
+ * @brief Devuelve las CPUs reservadas por mineros que ya no existen.
+ */
+static void recuperar_reservas(OcupacionCpus *ocupacion) {
+    uint64_t reserva;
+    pid_t pid;
+
+    for (int i = 0; i < AFINIDAD_MAX_RESERVAS; i++) {
+        reserva = atomic_load(&ocupacion->reservas[i]);
+        if (reserva == 0) {
+            continue;
+        }
+        pid = RESERVA_PID(reserva);
+        /* Si dos mineros ven a la vez la misma reserva muerta, solo uno la devuelve */
+        if (kill(pid, 0) == -1 && errno == ESRCH &&
+            atomic_compare_exchange_strong(&ocupacion->reservas[i], &reserva, 0)) {
+            atomic_fetch_sub(&ocupacion->hilos[RESERVA_CPU(reserva)], 1);
+        }
+    }
+}
+
+/**
+ * @brief Anota una reserva de este proceso en una entrada libre.
+ *
+ * @return El índice de la entrada, o -1 si no queda ninguna.
+ */
+static int anotar_reserva(OcupacionCpus *ocupacion, int cpu) {
+    uint64_t libre;
+
+    for (int i = 0; i < AFINIDAD_MAX_RESERVAS; i++) {
+        libre = 0;
+        if (atomic_compare_exchange_strong(&ocupacion->reservas[i], &libre, RESERVA(getpid(), cpu))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int afinidad_colocar(const Topologia *topologia, OcupacionCpus *ocupacion, pthread_t hilo) {
+    cpu_set_t conjunto;
+    uint32_t menor, hilos;
+    int mejor, reserva;
+
+    recuperar_reservas(ocupacion);
+    /* La CPU se reserva con un CAS: dos mineros que colocan a la vez no eligen la misma */
+    do {
+        mejor = topologia->orden[0];
+        menor = atomic_load(&ocupacion->hilos[mejor]);
+        for (int i = 1; i < topologia->n_cpus; i++) {
+            hilos = atomic_load(&ocupacion->hilos[topologia->orden[i]]);
+            if (hilos < menor) {
+                menor = hilos;
+                mejor = topologia->orden[i];
+            }
+        }
+    } while (!atomic_compare_exchange_weak(&ocupacion->hilos[mejor], &menor, menor + 1));
+
+    /* El hilo solo cuenta mientras su reserva diga de qué minero es */
+    if ((reserva = anotar_reserva(ocupacion, mejor)) == -1) {
+        atomic_fetch_sub(&ocupacion->hilos[mejor], 1);
+        return -1;
+    }
+    CPU_ZERO(&conjunto);
+    CPU_SET(mejor, &conjunto);
+    if (pthread_setaffinity_np(hilo, sizeof(conjunto), &conjunto) != 0) {
+        atomic_store(&ocupacion->reservas[reserva], 0);
+        atomic_fetch_sub(&ocupacion->hilos[mejor], 1);
+        return -1;
+    }
+    return mejor;
+}
+
+void afinidad_liberar(OcupacionCpus *ocupacion, int cpu) {
+    uint64_t reserva;
+
+    if (cpu < 0 || cpu >= AFINIDAD_MAX_CPUS) {
+        return;
+    }
+    /* Cualquier reserva de este proceso en esa CPU vale: todas cuentan lo mismo */
+    for (int i = 0; i < AFINIDAD_MAX_RESERVAS; i++) {
+        reserva = RESERVA(getpid(), cpu);
+        if (atomic_compare_exchange_strong(&ocupacion->reservas[i], &reserva, 0)) {
+            atomic_fetch_sub(&ocupacion->hilos[cpu], 1);
+            return;
+        }
+    }
+}
@@ -0,0 +1,81 @@
+/**
+ * @file afinidad.h
+ * @brief Colocación de los hilos mineros en CPUs según la topología de la máquina.
+ *
+ * Con --afinidad cada hilo del pool se fija a una CPU. El orden de colocación sale de
+ * /sys/devices/system/cpu: primero un hilo hardware de cada núcleo físico, repartidos por
+ * turnos entre los dominios de L3, y solo después los hermanos SMT. Los mineros de la
+ * misma máquina comparten en el segmento de la red cuántos hilos hay en cada CPU, así que
+ * cada hilo nuevo va a la CPU menos ocupada en ese orden y dos procesos no se apilan en
+ * los mismos núcleos. Cada hilo fijado deja además una reserva con el pid de su minero:
+ * si el minero muere sin liberarlas, el siguiente que coloca hilos las recupera.
+ *
+ * Solo se usan las CPUs que deja sched_getaffinity(), que ya refleja el cpuset del cgroup.
+ * Si el cgroup limita además el tiempo de CPU (cpu.max), los hilos se reparten solo entre
+ * tantas CPUs como caben en la cuota. Sin topología en sysfs, cada CPU cuenta como un
+ * núcleo de un único dominio; si el sistema no deja fijar un hilo, se queda sin fijar.
+ */
+
+#ifndef AFINIDAD_H
+#define AFINIDAD_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define AFINIDAD_MAX_CPUS 1024 /**< CPUs que se tienen en cuenta, como CPU_SETSIZE */
+#define AFINIDAD_MAX_RESERVAS 4096 /**< Hilos fijados a la vez entre todos los mineros */
+
+#define RESERVA(pid, cpu) (((uint64_t)(uint32_t)(pid) << 32) | (uint32_t)(cpu)) /**< Reserva de una CPU; 0 si está libre */
+#define RESERVA_PID(reserva) ((pid_t)((reserva) >> 32)) /**< Minero que fijó el hilo */
+#define RESERVA_CPU(reserva) ((int)((reserva) & 0xffffffffu)) /**< CPU a la que está fijado */
+
+/**
+ * @brief Hilos fijados a cada CPU por todos los mineros; vive en el segmento de la red.
+ */
+typedef struct {
+    _Atomic uint32_t hilos[AFINIDAD_MAX_CPUS]; /**< Hilos fijados a cada CPU */
+    _Atomic uint64_t reservas[AFINIDAD_MAX_RESERVAS]; /**< Quién ocupa cada hilo contado, ver RESERVA() */
+} OcupacionCpus;
+
+/**
+ * @brief CPUs utilizables, en orden de colocación.
+ */
+typedef struct {
+    int n_cpus; /**< CPUs en el orden */
+    int orden[AFINIDAD_MAX_CPUS]; /**< CPUs: núcleos distintos y dominios de L3 alternos primero */
+    int permitidas; /**< CPUs que permite la afinidad del proceso */
+    int nucleos; /**< Núcleos físicos entre las permitidas */
+    int dominios_l3; /**< Dominios de L3 entre las permitidas */
+} Topologia;
+
+/**
+ * @brief Lee la topología y las CPUs que permite el cgroup, y calcula el orden de colocación.
+ *
+ * @param topologia Topología a rellenar.
+ * @return 0 si todo va bien, -1 si no se conoce ninguna CPU utilizable.
+ */
+int afinidad_detectar(Topologia *topologia);
+
+/**
+ * @brief Fija un hilo a la CPU menos ocupada por los mineros, en el orden de colocación.
+ *
+ * Antes devuelve las reservas de los mineros que han muerto sin liberarlas.
+ *
+ * @param topologia Topología detectada.
+ * @param ocupacion Ocupación compartida por los mineros.
+ * @param hilo Hilo a fijar.
+ * @return La CPU, o -1 si no se ha podido fijar o no quedan reservas.
+ */
+int afinidad_colocar(const Topologia *topologia, OcupacionCpus *ocupacion, pthread_t hilo);
+
+/**
+ * @brief Devuelve el puesto de un hilo de este proceso que deja de minar en una CPU.
+ *
+ * @param ocupacion Ocupación compartida por los mineros.
+ * @param cpu CPU devuelta por afinidad_colocar().
+ */
+void afinidad_liberar(OcupacionCpus *ocupacion, int cpu);
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ * @file bench_bloque.c
+ * @brief Microbenchmark del formato compacto de bloque frente al bloque de tamaño fijo.
+ *
+ * Uso: ./bench_bloque [repeticiones]
+ *
+ * Para varios números de mineros vivos mide los bytes por bloque y el tiempo de llevar un
+ * bloque del minero al monitor: con el bloque fijo, copiar la estructura entera en cada
+ * salto (cola, anillo y monitor); con el compacto, codificar, copiar solo los bytes
+ * ocupados y decodificar.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bloque.h"
+
+#define REPETICIONES_POR_DEFECTO 20000
+
+/**
+ * @brief Bloque de tamaño fijo que se enviaba antes: siempre BLOQUE_MAX_CARTERAS carteras.
+ */
+typedef struct {
+    CabeceraBloque bloque;
+    Monedas monedas_mineros[BLOQUE_MAX_CARTERAS];
+} BloqueFijo;
+
+static double ahora_ns(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+int main(int argc, char const *argv[]) {
+    static const int vivos[] = {10, 50, 200, 1000};
+    static BloqueFijo origen, cola, anillo, monitor;
+    static Monedas carteras[BLOQUE_MAX_CARTERAS], leidas[BLOQUE_MAX_CARTERAS];
+    static unsigned char mensaje[BLOQUE_MAX_BYTES], ranura[BLOQUE_MAX_BYTES];
+    CabeceraBloque bloque = {0}, leido;
+    long repeticiones = REPETICIONES_POR_DEFECTO;
+    double antes, fijo_ns, compacto_ns;
+    volatile int control = 0;
+    size_t bytes = 0;
+    int formato;
+
+    if (argc > 1) {
+        repeticiones = atol(argv[1]);
+    }
+    if (repeticiones <= 0) {
+        printf("Uso: %s [repeticiones]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("[%d] %ld blocks per case\n", getpid(), repeticiones);
+    printf("%8s %12s %12s %14s %14s\n", "miners", "fixed_B", "compact_B", "fixed_ns", "compact_ns");
+    for (size_t c = 0; c < sizeof(vivos) / sizeof(vivos[0]); c++) {
+        for (int i = 0; i < vivos[c]; i++) {
+            carteras[i].pid = 1000 + i;
+            carteras[i].monedas = i % 7;
+            origen.monedas_mineros[i] = carteras[i];
+        }
+
+        antes = ahora_ns();
+        for (long r = 0; r < repeticiones; r++) {
+            origen.bloque.id = (int)r;
+            memcpy(&cola, &origen, sizeof(BloqueFijo));
+            memcpy(&anillo, &cola, sizeof(BloqueFijo));
+            memcpy(&monitor, &anillo, sizeof(BloqueFijo));
+            control += monitor.bloque.id;
+        }
+        fijo_ns = (ahora_ns() - antes) / (double)repeticiones;
+
+        antes = ahora_ns();
+        for (long r = 0; r < repeticiones; r++) {
+            bloque.id = (int)r;
+            bytes = bloque_codificar(&bloque, BLOQUE_COMPLETO, carteras, vivos[c], mensaje);
+            memcpy(ranura, mensaje, bytes);
+            control += bloque_decodificar(ranura, bytes, &leido, &formato, leidas) + leido.id;
+        }
+        compacto_ns = (ahora_ns() - antes) / (double)repeticiones;
+
+        printf("%8d %12zu %12zu %14.1f %14.1f\n", vivos[c], sizeof(BloqueFijo), bytes, fijo_ns, compacto_ns);
+    }
+    exit(EXIT_SUCCESS);
+}
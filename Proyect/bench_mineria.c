@@ -0,0 +1,317 @@
+/**
+ * @file bench_mineria.c
+ * @brief Batería de medidas del minado para seguir su rendimiento entre versiones.
+ *
+ * Uso: ./bench_mineria [--repeticiones <n>] [--objetivos <n>] [--hilos <n>] [--csv <fichero>] [--json <fichero>]
+ *
+ * Mide tres cosas:
+ *  - pow: recorrer los POW_LIMIT nonces con pow_hash() uno a uno, con pow_hash_batch() y con
+ *    pow_search_batch() (núcleo elegido en tiempo de ejecución).
+ *  - barrido: una ronda del pool de hilos sobre todos los nonces menos el último, con el
+ *    objetivo de ese último, así que no hay solución y se calculan todos los hashes. Los
+ *    hilos reclaman tramos de un contador, como en modo cooperativo, y se roban trabajo.
+ *    Se mide con 1, 2, 4... hasta MAX_THREADS hilos: es la curva de escalado de miner_thread().
+ *  - solucion: tiempo hasta la solución de una serie fija de objetivos, encadenados como en la
+ *    red (cada objetivo es la solución del anterior, empezando en 0), con `--hilos` hilos.
+ *
+ * De cada prueba se dan la media y los percentiles 50, 90 y 99 de las muestras y los hashes
+ * por segundo y por núcleo ocupado. Además de la tabla por la salida estándar se pueden
+ * escribir los resultados en CSV y en JSON.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hilos.h"
+#include "pow.h"
+
+#define REPETICIONES_POR_DEFECTO 10
+#define OBJETIVOS_POR_DEFECTO 32
+#define MAX_MUESTRAS 4096
+#define MAX_RESULTADOS 64
+#define NONCES_POR_LOTE 65536 /* Nonces por llamada a pow_hash_batch */
+
+/**
+ * @brief Resumen de las muestras de una prueba.
+ */
+typedef struct {
+    char prueba[32];      /**< Nombre de la prueba */
+    char variante[32];    /**< Núcleo de pow o número de hilos */
+    int hilos;            /**< Hilos usados */
+    int muestras;         /**< Número de muestras */
+    double media_ms;      /**< Media de las muestras */
+    double p50_ms, p90_ms, p99_ms; /**< Percentiles de las muestras */
+    double hashes_nucleo; /**< Hashes por segundo y por núcleo, o NAN si no se conocen */
+} Resultado;
+
+static Resultado resultados[MAX_RESULTADOS];
+static int n_resultados = 0;
+static long nucleos = 1;
+
+static double ahora_ms(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static int comparar_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Percentil por rango más cercano de muestras ya ordenadas.
+ */
+static double percentil(const double *muestras, int n, double p) {
+    int i = (int)ceil(p * n) - 1;
+
+    return muestras[i < 0 ? 0 : i];
+}
+
+/**
+ * @brief Resume unas muestras y las añade a los resultados.
+ *
+ * @param hashes Hashes calculados por muestra, o 0 si no se conocen.
+ */
+static void anotar(const char *prueba, const char *variante, int hilos, double *muestras, int n, double hashes) {
+    Resultado *r = &resultados[n_resultados++];
+    double suma = 0;
+    long ocupados = hilos < nucleos ? hilos : nucleos;
+
+    qsort(muestras, (size_t)n, sizeof(double), comparar_double);
+    for (int i = 0; i < n; i++) {
+        suma += muestras[i];
+    }
+    snprintf(r->prueba, sizeof(r->prueba), "%s", prueba);
+    snprintf(r->variante, sizeof(r->variante), "%s", variante);
+    r->hilos = hilos;
+    r->muestras = n;
+    r->media_ms = suma / n;
+    r->p50_ms = percentil(muestras, n, 0.50);
+    r->p90_ms = percentil(muestras, n, 0.90);
+    r->p99_ms = percentil(muestras, n, 0.99);
+    r->hashes_nucleo = hashes > 0 ? hashes / (r->media_ms / 1e3) / ocupados : NAN;
+    printf("%-10s %-8s %6d %8d %10.3f %10.3f %10.3f %10.3f %14.0f\n", r->prueba, r->variante, r->hilos, r->muestras,
+           r->media_ms, r->p50_ms, r->p90_ms, r->p99_ms, r->hashes_nucleo);
+    fflush(stdout);
+}
+
+static bool no_parar(void) {
+    return false;
+}
+
+/**
+ * @brief Nonces pendientes de una ronda de barrido.
+ */
+typedef struct {
+    _Atomic long int siguiente;
+    long int fin;
+} Barrido;
+
+static bool reclamar_barrido(void *ctx, long int tramo, long int *inicio, long int *fin) {
+    Barrido *barrido = (Barrido *)ctx;
+
+    *inicio = atomic_fetch_add(&barrido->siguiente, tramo);
+    if (*inicio >= barrido->fin) {
+        return false;
+    }
+    *fin = (*inicio + tramo < barrido->fin) ? *inicio + tramo : barrido->fin;
+    return true;
+}
+
+/**
+ * @brief Recorre todos los nonces con cada una de las funciones de pow.
+ */
+static void medir_pow(int repeticiones) {
+    static long int hashes[NONCES_POR_LOTE];
+    double muestras[MAX_MUESTRAS], antes;
+    volatile long int sumidero = 0;
+    long int suma;
+
+    for (int r = 0; r < repeticiones; r++) {
+        antes = ahora_ms();
+        suma = 0;
+        for (long int x = 0; x < POW_LIMIT; x++) {
+            suma += pow_hash(x);
+        }
+        sumidero += suma;
+        muestras[r] = ahora_ms() - antes;
+    }
+    anotar("pow_hash", "scalar", 1, muestras, repeticiones, POW_LIMIT);
+
+    for (int r = 0; r < repeticiones; r++) {
+        antes = ahora_ms();
+        for (long int x = 0; x < POW_LIMIT; x += NONCES_POR_LOTE) {
+            pow_hash_batch(x, (POW_LIMIT - x < NONCES_POR_LOTE) ? POW_LIMIT - x : NONCES_POR_LOTE, hashes);
+            sumidero += hashes[0];
+        }
+        muestras[r] = ahora_ms() - antes;
+    }
+    anotar("pow_batch", pow_batch_isa(), 1, muestras, repeticiones, POW_LIMIT);
+
+    /* El objetivo del último nonce obliga a recorrer todo el rango */
+    for (int r = 0; r < repeticiones; r++) {
+        antes = ahora_ms();
+        sumidero += pow_search_batch(0, POW_LIMIT, pow_hash(POW_LIMIT - 1));
+        muestras[r] = ahora_ms() - antes;
+    }
+    anotar("pow_search", pow_batch_isa(), 1, muestras, repeticiones, POW_LIMIT);
+    (void)sumidero;
+}
+
+/**
+ * @brief Curva de escalado de una ronda completa del pool.
+ */
+static int medir_barrido(int repeticiones) {
+    double muestras[MAX_MUESTRAS], antes;
+    char variante[32];
+    PoolMineros pool;
+    Barrido barrido;
+    long int solucion;
+    int hilos = 1;
+
+    for (;;) {
+        if (pool_crear(&pool, hilos, no_parar) != 0) {
+            return -1;
+        }
+        for (int r = 0; r < repeticiones; r++) {
+            atomic_init(&barrido.siguiente, 0);
+            barrido.fin = POW_LIMIT - 1;
+            antes = ahora_ms();
+            pool_minar(&pool, pow_hash(POW_LIMIT - 1), reclamar_barrido, &barrido, &solucion);
+            muestras[r] = ahora_ms() - antes;
+        }
+        pool_destruir(&pool);
+        snprintf(variante, sizeof(variante), "%d", hilos);
+        anotar("scan", variante, hilos, muestras, repeticiones, POW_LIMIT - 1);
+        if (hilos == MAX_THREADS) {
+            break;
+        }
+        hilos = (hilos * 2 > MAX_THREADS) ? MAX_THREADS : hilos * 2;
+    }
+    return 0;
+}
+
+/**
+ * @brief Tiempo hasta la solución de una serie fija de objetivos encadenados.
+ */
+static int medir_solucion(int objetivos, int hilos) {
+    double muestras[MAX_MUESTRAS], antes;
+    char variante[32];
+    PoolMineros pool;
+    long int objetivo = 0, solucion;
+
+    if (pool_crear(&pool, hilos, no_parar) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < objetivos; i++) {
+        antes = ahora_ms();
+        pool_minar(&pool, objetivo, NULL, NULL, &solucion);
+        muestras[i] = ahora_ms() - antes;
+        objetivo = solucion;
+    }
+    pool_destruir(&pool);
+    snprintf(variante, sizeof(variante), "%d", hilos);
+    anotar("solve", variante, hilos, muestras, objetivos, 0);
+    return 0;
+}
+
+static int escribir_csv(const char *ruta) {
+    FILE *f = fopen(ruta, "w");
+
+    if (!f) {
+        perror("fopen");
+        return -1;
+    }
+    fprintf(f, "bench,variant,threads,samples,mean_ms,p50_ms,p90_ms,p99_ms,hashes_per_s_per_core\n");
+    for (int i = 0; i < n_resultados; i++) {
+        const Resultado *r = &resultados[i];
+
+        fprintf(f, "%s,%s,%d,%d,%.6f,%.6f,%.6f,%.6f,", r->prueba, r->variante, r->hilos, r->muestras, r->media_ms,
+                r->p50_ms, r->p90_ms, r->p99_ms);
+        if (!isnan(r->hashes_nucleo)) {
+            fprintf(f, "%.0f", r->hashes_nucleo);
+        }
+        fprintf(f, "\n");
+    }
+    return fclose(f);
+}
+
+static int escribir_json(const char *ruta) {
+    FILE *f = fopen(ruta, "w");
+
+    if (!f) {
+        perror("fopen");
+        return -1;
+    }
+    fprintf(f, "{\n  \"cores\": %ld,\n  \"pow_kernel\": \"%s\",\n  \"results\": [\n", nucleos, pow_batch_isa());
+    for (int i = 0; i < n_resultados; i++) {
+        const Resultado *r = &resultados[i];
+
+        fprintf(f, "    {\"bench\": \"%s\", \"variant\": \"%s\", \"threads\": %d, \"samples\": %d, \"mean_ms\": %.6f, "
+                   "\"p50_ms\": %.6f, \"p90_ms\": %.6f, \"p99_ms\": %.6f, \"hashes_per_s_per_core\": ",
+                r->prueba, r->variante, r->hilos, r->muestras, r->media_ms, r->p50_ms, r->p90_ms, r->p99_ms);
+        if (isnan(r->hashes_nucleo)) {
+            fprintf(f, "null}");
+        } else {
+            fprintf(f, "%.0f}", r->hashes_nucleo);
+        }
+        fprintf(f, "%s\n", i + 1 < n_resultados ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f);
+}
+
+int main(int argc, char const *argv[]) {
+    int repeticiones = REPETICIONES_POR_DEFECTO, objetivos = OBJETIVOS_POR_DEFECTO, hilos;
+    const char *csv = NULL, *json = NULL;
+
+    nucleos = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nucleos < 1) {
+        nucleos = 1;
+    }
+    hilos = nucleos < MAX_THREADS ? (int)nucleos : MAX_THREADS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--repeticiones") == 0 && i + 1 < argc) {
+            repeticiones = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--objetivos") == 0 && i + 1 < argc) {
+            objetivos = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--hilos") == 0 && i + 1 < argc) {
+            hilos = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csv = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json = argv[++i];
+        } else {
+            printf("Uso: %s [--repeticiones <n>] [--objetivos <n>] [--hilos <n>] [--csv <fichero>] [--json <fichero>]\n",
+                   argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (repeticiones < 1 || repeticiones > MAX_MUESTRAS || objetivos < 1 || objetivos > MAX_MUESTRAS ||
+        hilos < 1 || hilos > MAX_THREADS) {
+        printf("Las repeticiones y los objetivos deben estar entre 1 y %d, y los hilos entre 1 y %d\n", MAX_MUESTRAS,
+               MAX_THREADS);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("[%d] %ld cores, pow kernel %s, %d repetitions, %d targets\n", getpid(), nucleos, pow_batch_isa(),
+           repeticiones, objetivos);
+    printf("%-10s %-8s %6s %8s %10s %10s %10s %10s %14s\n", "bench", "variant", "threads", "samples", "mean_ms", "p50_ms",
+           "p90_ms", "p99_ms", "hashes/s/core");
+    medir_pow(repeticiones);
+    if (medir_barrido(repeticiones) != 0 || medir_solucion(objetivos, hilos) != 0) {
+        fprintf(stderr, "Benchmark failed\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((csv && escribir_csv(csv) != 0) || (json && escribir_json(json) != 0)) {
+        exit(EXIT_FAILURE);
+    }
+    exit(EXIT_SUCCESS);
+}
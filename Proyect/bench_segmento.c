@@ -0,0 +1,186 @@
+/**
+ * @file bench_segmento.c
+ * @brief Microbenchmark de contención entre las casillas de voto y el control de ronda.
+ *
+ * Uso: ./bench_segmento [votantes] [lectores] [ms]
+ *
+ * Unos hilos escriben sin parar su casilla de voto mientras otros leen las palabras de
+ * ronda, como hacen los hilos mineros al comprobar si deben parar. Se mide con la
+ * disposición compacta que tenía el segmento (votos de 8 bytes contiguos, pegados al
+ * control de ronda) y con la disposición actual de SharedMemMiner.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "minero.h"
+
+#define VOTANTES_POR_DEFECTO 4
+#define LECTORES_POR_DEFECTO 4
+#define DURACION_POR_DEFECTO_MS 500
+
+/**
+ * @brief Disposición anterior: palabras de ronda y votos compartiendo líneas de caché.
+ */
+typedef struct {
+    _Atomic uint32_t epoca_ronda;
+    _Atomic uint32_t epoca_voto;
+    int objetivo;
+    struct {
+        _Atomic uint64_t voto;
+    } votos[MAX_MINERS];
+} SegmentoCompacto;
+
+/**
+ * @brief Lo que necesita cada hilo: su casilla si vota, las palabras de ronda si lee.
+ */
+typedef struct {
+    _Atomic uint64_t *celda;
+    _Atomic uint32_t *epoca_ronda;
+    _Atomic uint32_t *epoca_voto;
+    const int *objetivo;
+    pthread_barrier_t *salida;
+    _Atomic int *parar;
+    unsigned long operaciones;
+} HiloBench;
+
+static void *votante(void *arg) {
+    HiloBench *hilo = (HiloBench *)arg;
+    uint32_t ronda = 0;
+
+    pthread_barrier_wait(hilo->salida);
+    while (!atomic_load_explicit(hilo->parar, memory_order_relaxed)) {
+        atomic_store_explicit(hilo->celda, VOTO(++ronda, VOTO_A_FAVOR), memory_order_release);
+        hilo->operaciones++;
+    }
+    return NULL;
+}
+
+static void *lector(void *arg) {
+    HiloBench *hilo = (HiloBench *)arg;
+    volatile int suma = 0;
+
+    pthread_barrier_wait(hilo->salida);
+    while (!atomic_load_explicit(hilo->parar, memory_order_relaxed)) {
+        suma += (int)atomic_load_explicit(hilo->epoca_ronda, memory_order_acquire);
+        suma += (int)atomic_load_explicit(hilo->epoca_voto, memory_order_acquire);
+        suma += *(volatile const int *)hilo->objetivo;
+        hilo->operaciones++;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Lanza votantes y lectores sobre las palabras indicadas durante `ms` milisegundos.
+ *
+ * @param celdas Casilla de voto de cada votante.
+ * @param epoca_ronda Palabra de ronda.
+ * @param epoca_voto Palabra de votación.
+ * @param objetivo Objetivo del bloque actual.
+ * @param votantes Número de hilos votantes.
+ * @param lectores Número de hilos lectores.
+ * @param ms Duración de la medida.
+ * @param votos Millones de votos por segundo, sumando todos los votantes.
+ * @param lecturas Millones de lecturas de ronda por segundo, sumando todos los lectores.
+ */
+static void medir(_Atomic uint64_t **celdas, _Atomic uint32_t *epoca_ronda, _Atomic uint32_t *epoca_voto,
+                  const int *objetivo, int votantes, int lectores, long ms, double *votos, double *lecturas) {
+    pthread_t hilos[2 * MAX_THREADS];
+    HiloBench datos[2 * MAX_THREADS];
+    pthread_barrier_t salida;
+    _Atomic int parar = 0;
+    struct timespec antes, despues;
+    double segundos;
+    int i, total = votantes + lectores;
+
+    pthread_barrier_init(&salida, NULL, (unsigned)total + 1);
+    for (i = 0; i < total; i++) {
+        memset(&datos[i], 0, sizeof(datos[i]));
+        datos[i].celda = (i < votantes) ? celdas[i] : NULL;
+        datos[i].epoca_ronda = epoca_ronda;
+        datos[i].epoca_voto = epoca_voto;
+        datos[i].objetivo = objetivo;
+        datos[i].salida = &salida;
+        datos[i].parar = &parar;
+        pthread_create(&hilos[i], NULL, (i < votantes) ? votante : lector, &datos[i]);
+    }
+    pthread_barrier_wait(&salida);
+    clock_gettime(CLOCK_MONOTONIC, &antes);
+    usleep((useconds_t)(ms * 1000));
+    atomic_store(&parar, 1);
+    clock_gettime(CLOCK_MONOTONIC, &despues);
+    *votos = 0;
+    *lecturas = 0;
+    for (i = 0; i < total; i++) {
+        pthread_join(hilos[i], NULL);
+        if (i < votantes) {
+            *votos += (double)datos[i].operaciones;
+        } else {
+            *lecturas += (double)datos[i].operaciones;
+        }
+    }
+    pthread_barrier_destroy(&salida);
+
+    segundos = (double)(despues.tv_sec - antes.tv_sec) + (despues.tv_nsec - antes.tv_nsec) / 1e9;
+    *votos /= segundos * 1e6;
+    *lecturas /= segundos * 1e6;
+}
+
+int main(int argc, char const *argv[]) {
+    _Atomic uint64_t *celdas[MAX_THREADS];
+    SegmentoCompacto *compacto;
+    SharedMemMiner disposicion, *segmento;
+    int votantes = VOTANTES_POR_DEFECTO, lectores = LECTORES_POR_DEFECTO;
+    long ms = DURACION_POR_DEFECTO_MS;
+    double votos, lecturas;
+    int i;
+
+    if (argc > 1) {
+        votantes = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        lectores = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        ms = atol(argv[3]);
+    }
+    if (votantes <= 0 || votantes > MAX_THREADS || lectores <= 0 || lectores > MAX_THREADS || ms <= 0) {
+        printf("Uso: %s [votantes] [lectores] [ms]   (hasta %d hilos de cada tipo)\n", argv[0], MAX_THREADS);
+        exit(EXIT_FAILURE);
+    }
+
+    compacto = aligned_alloc(64, ALINEAR_LINEA(sizeof(SegmentoCompacto)));
+    disponer_segmento(&disposicion, MAX_MINERS);
+    segmento = aligned_alloc(64, disposicion.tamano);
+    if (!compacto || !segmento) {
+        perror("aligned_alloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(compacto, 0, sizeof(SegmentoCompacto));
+    memset(segmento, 0, disposicion.tamano);
+    disponer_segmento(segmento, MAX_MINERS);
+
+    printf("[%d] %d voters, %d round readers, %ld ms per layout\n", getpid(), votantes, lectores, ms);
+
+    for (i = 0; i < votantes; i++) {
+        celdas[i] = &compacto->votos[i].voto;
+    }
+    medir(celdas, &compacto->epoca_ronda, &compacto->epoca_voto, &compacto->objetivo,
+          votantes, lectores, ms, &votos, &lecturas);
+    printf("compact  : votes %8.1f M/s, round reads %8.1f M/s\n", votos, lecturas);
+
+    for (i = 0; i < votantes; i++) {
+        celdas[i] = &votos_de(segmento)[i].voto;
+    }
+    medir(celdas, &segmento->epoca_ronda, &segmento->epoca_voto, &segmento->bloque_actual.objetivo,
+          votantes, lectores, ms, &votos, &lecturas);
+    printf("padded   : votes %8.1f M/s, round reads %8.1f M/s\n", votos, lecturas);
+
+    free(compacto);
+    free(segmento);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,221 @@
+/**
+ * @file bench_transporte.c
+ * @brief Benchmark de ingesta de bloques: cola de mensajes POSIX frente al anillo compartido.
+ *
+ * Uso: ./bench_transporte [productores] [bloques] [carteras] [celdas]
+ *
+ * Para cada transporte lanza `productores` procesos que envían `bloques` bloques compactos
+ * de `carteras` carteras cada uno, mientras este proceso los recibe y decodifica como el
+ * comprobador. Mide los bloques por segundo que llegan al consumidor.
+ *
+ * Antes comprueba que un productor bloqueado con el anillo lleno sigue esperando hueco
+ * cuando le llegan señales, como un minero que recibe SIGALRM con el comprobador atrasado.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "transporte.h"
+
+#define PRODUCTORES_POR_DEFECTO 4
+#define BLOQUES_POR_DEFECTO 100000
+#define CARTERAS_POR_DEFECTO 50
+#define COLA_BENCH "/bench_transporte_cola"
+#define ANILLO_BENCH "/bench_transporte_anillo"
+
+static double ahora_s(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Cuerpo de cada productor: abre el transporte como un minero y envía sus bloques.
+ */
+static void productor(int numero, long bloques, int n_carteras) {
+    static Monedas carteras[BLOQUE_MAX_CARTERAS];
+    static unsigned char mensaje[BLOQUE_MAX_BYTES];
+    CabeceraBloque bloque = {0};
+    Transporte transporte = {.mq = (mqd_t)-1};
+    size_t bytes;
+
+    if (transporte_abrir(&transporte, ANILLO_BENCH, COLA_BENCH) != 0) {
+        _exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < n_carteras; i++) {
+        carteras[i].pid = getpid() + i;
+        carteras[i].monedas = i;
+    }
+    bloque.ganador = getpid();
+    for (long b = 0; b < bloques; b++) {
+        bloque.id = (int)(numero * bloques + b);
+        bytes = bloque_codificar(&bloque, BLOQUE_COMPLETO, carteras, n_carteras, mensaje);
+        if (transporte_enviar(&transporte, mensaje, bytes) == -1) {
+            perror("transporte_enviar");
+            _exit(EXIT_FAILURE);
+        }
+    }
+    transporte_cerrar(&transporte);
+    _exit(EXIT_SUCCESS);
+}
+
+static void senal_vacia(int senal) {
+    (void)senal;
+}
+
+/**
+ * @brief Llena el anillo, señala al productor bloqueado en él y comprueba que entrega todo.
+ *
+ * @return 0 si el productor entrega todos sus bloques, -1 si no.
+ */
+static int comprobar_senales(int celdas) {
+    static unsigned char recibido[BLOQUE_MAX_BYTES];
+    struct sigaction accion;
+    Transporte transporte = {.mq = (mqd_t)-1};
+    int estado, fallos = 0;
+    pid_t pid;
+
+    shm_unlink(ANILLO_BENCH);
+    if (transporte_crear(&transporte, TRANSPORTE_ANILLO, ANILLO_BENCH, celdas) != 0) {
+        return -1;
+    }
+    pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    } else if (pid == 0) {
+        /* Como el minero: manejador instalado con SA_RESTART */
+        memset(&accion, 0, sizeof(accion));
+        accion.sa_handler = senal_vacia;
+        accion.sa_flags = SA_RESTART;
+        sigaction(SIGALRM, &accion, NULL);
+        /* Una celda más de las que caben: el último envío espera al consumidor */
+        productor(0, celdas + 1, 0);
+    }
+    for (int i = 0; i < 10; i++) {
+        usleep(20 * 1000);
+        kill(pid, SIGALRM);
+    }
+    usleep(20 * 1000);
+    /* Si ya ha salido es que ha abandonado el último bloque: no queda nada que esperar */
+    if (waitpid(pid, &estado, WNOHANG) == pid) {
+        transporte_borrar(&transporte);
+        transporte_cerrar(&transporte);
+        return -1;
+    }
+    for (int b = 0; b < celdas + 1; b++) {
+        if (transporte_recibir(&transporte, recibido) == -1) {
+            fallos++;
+            break;
+        }
+    }
+    if (waitpid(pid, &estado, 0) == -1 || !WIFEXITED(estado) || WEXITSTATUS(estado) != EXIT_SUCCESS) {
+        fallos++;
+    }
+    transporte_borrar(&transporte);
+    transporte_cerrar(&transporte);
+    return fallos ? -1 : 0;
+}
+
+/**
+ * @brief Mide un transporte.
+ *
+ * @return Bloques recibidos por segundo, o -1 si algo ha fallado.
+ */
+static double medir(int tipo, int productores, long bloques, int n_carteras, int celdas) {
+    static Monedas carteras[BLOQUE_MAX_CARTERAS];
+    static unsigned char recibido[BLOQUE_MAX_BYTES];
+    CabeceraBloque bloque;
+    Transporte transporte = {.mq = (mqd_t)-1};
+    long total = (long)productores * bloques, leidos = 0;
+    double antes, segundos;
+    ssize_t bytes;
+    int formato, fallos = 0, estado;
+    pid_t pid;
+
+    /* Los productores buscan primero el anillo: en la medida de la cola no debe existir */
+    shm_unlink(ANILLO_BENCH);
+    mq_unlink(COLA_BENCH);
+    if (transporte_crear(&transporte, tipo, tipo == TRANSPORTE_ANILLO ? ANILLO_BENCH : COLA_BENCH, celdas) != 0) {
+        return -1;
+    }
+
+    antes = ahora_s();
+    for (int p = 0; p < productores; p++) {
+        pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            exit(EXIT_FAILURE);
+        } else if (pid == 0) {
+            productor(p, bloques, n_carteras);
+        }
+    }
+    while (leidos < total) {
+        if ((bytes = transporte_recibir(&transporte, recibido)) == -1 ||
+            bloque_decodificar(recibido, (size_t)bytes, &bloque, &formato, carteras) != n_carteras) {
+            fallos++;
+            break;
+        }
+        leidos++;
+    }
+    segundos = ahora_s() - antes;
+
+    for (int p = 0; p < productores; p++) {
+        if (wait(&estado) == -1 || !WIFEXITED(estado) || WEXITSTATUS(estado) != EXIT_SUCCESS) {
+            fallos++;
+        }
+    }
+    transporte_borrar(&transporte);
+    transporte_cerrar(&transporte);
+    return fallos ? -1 : (double)leidos / segundos;
+}
+
+int main(int argc, char const *argv[]) {
+    int productores = PRODUCTORES_POR_DEFECTO, n_carteras = CARTERAS_POR_DEFECTO;
+    int celdas = ANILLO_CELDAS_POR_DEFECTO;
+    long bloques = BLOQUES_POR_DEFECTO;
+    double cola, anillo;
+
+    if (argc > 1) {
+        productores = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        bloques = atol(argv[2]);
+    }
+    if (argc > 3) {
+        n_carteras = atoi(argv[3]);
+    }
+    if (argc > 4) {
+        celdas = atoi(argv[4]);
+    }
+    if (productores <= 0 || bloques <= 0 || n_carteras < 0 || n_carteras > BLOQUE_MAX_CARTERAS ||
+        celdas < 2 || celdas > ANILLO_MAX_CELDAS) {
+        printf("Uso: %s [productores] [bloques] [carteras] [celdas]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("[%d] %d producers x %ld blocks, %d wallets per block, %d ring cells\n",
+           getpid(), productores, bloques, n_carteras, celdas);
+    fflush(stdout);
+    if (comprobar_senales(celdas) != 0) {
+        fprintf(stderr, "A producer blocked on a full ring gave up on a signal\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("ring   : producer blocked on a full ring survives signals\n");
+    cola = medir(TRANSPORTE_COLA, productores, bloques, n_carteras, celdas);
+    anillo = medir(TRANSPORTE_ANILLO, productores, bloques, n_carteras, celdas);
+    if (cola < 0 || anillo < 0) {
+        fprintf(stderr, "Benchmark failed\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("mqueue : %12.0f blocks/s\n", cola);
+    printf("ring   : %12.0f blocks/s (x%.2f)\n", anillo, anillo / cola);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,57 @@
+#include <string.h>
+
+#include "bloque.h"
+
+size_t bloque_codificar(const CabeceraBloque *bloque, int formato, const Monedas *carteras, int n, void *buffer) {
+    CabeceraMensaje cabecera;
+
+    memset(&cabecera, 0, sizeof(cabecera));
+    cabecera.bloque = *bloque;
+    cabecera.formato = (uint16_t)formato;
+    cabecera.carteras = (uint16_t)n;
+    memcpy(buffer, &cabecera, sizeof(cabecera));
+    memcpy((char *)buffer + sizeof(cabecera), carteras, (size_t)n * sizeof(Monedas));
+    return sizeof(cabecera) + (size_t)n * sizeof(Monedas);
+}
+
+int bloque_decodificar(const void *buffer, size_t bytes, CabeceraBloque *bloque, int *formato, Monedas *carteras) {
+    CabeceraMensaje cabecera;
+
+    if (bytes < sizeof(cabecera)) {
+        return -1;
+    }
+    memcpy(&cabecera, buffer, sizeof(cabecera));
+    if ((cabecera.formato != BLOQUE_COMPLETO && cabecera.formato != BLOQUE_DELTA) ||
+        cabecera.carteras > BLOQUE_MAX_CARTERAS ||
+        bytes != sizeof(cabecera) + cabecera.carteras * sizeof(Monedas)) {
+        return -1;
+    }
+    *bloque = cabecera.bloque;
+    *formato = cabecera.formato;
+    memcpy(carteras, (const char *)buffer + sizeof(cabecera), cabecera.carteras * sizeof(Monedas));
+    return cabecera.carteras;
+}
+
+void bloque_aplicar(Monedas *estado, int *n_estado, int formato, const Monedas *carteras, int n) {
+    int i, j;
+
+    if (formato == BLOQUE_COMPLETO) {
+        memcpy(estado, carteras, (size_t)n * sizeof(Monedas));
+        *n_estado = n;
+        return;
+    }
+    /* Los deltas traen pocas carteras (el ganador y las altas y bajas de la ronda) */
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < *n_estado && estado[j].pid != carteras[i].pid; j++)
+            ;
+        if (carteras[i].monedas == BLOQUE_BAJA) {
+            if (j < *n_estado) {
+                estado[j] = estado[--(*n_estado)];
+            }
+        } else if (j < *n_estado) {
+            estado[j].monedas = carteras[i].monedas;
+        } else if (*n_estado < BLOQUE_MAX_CARTERAS) {
+            estado[(*n_estado)++] = carteras[i];
+        }
+    }
+}
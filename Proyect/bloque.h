@@ -0,0 +1,93 @@
+/**
+ * @file bloque.h
+ * @brief Formato compacto de los bloques que viajan del minero al comprobador y al monitor.
+ *
+ * Un mensaje es una cabecera fija seguida solo de las carteras (pid, monedas) que lleva,
+ * sin las casillas vacías del registro. En formato completo lleva todas las carteras
+ * vivas; en formato delta solo las que han cambiado desde el bloque anterior, y una
+ * cartera con BLOQUE_BAJA en las monedas indica que ese minero ha salido de la red.
+ */
+
+#ifndef BLOQUE_H
+#define BLOQUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define BLOQUE_MAX_CARTERAS 1000 /**< Carteras que caben en un mensaje */
+#define BLOQUE_COMPLETO 0 /**< El mensaje lleva todas las carteras vivas */
+#define BLOQUE_DELTA 1 /**< El mensaje lleva solo las carteras cambiadas desde el bloque anterior */
+#define BLOQUE_BAJA (-1) /**< Monedas de una cartera delta cuyo minero ha salido */
+
+typedef struct {
+    pid_t pid; /**< PID del minero */
+    int monedas; /**< Cantidad de monedas del minero */
+} Monedas;
+
+/**
+ * @brief Campos de un bloque sin las carteras: lo que leen todos los mineros en cada ronda.
+ */
+typedef struct {
+    int id;
+    int objetivo;  /**< Valor objetivo del bloque (resultado deseado del POW) */
+    int solucion;  /**< Solución propuesta para el POW */
+    pid_t ganador;
+    int total_votos;
+    int votos_positivos;
+    bool correcto; /**< Bandera que indica si la solución es válida */
+} CabeceraBloque;
+
+/**
+ * @brief Cabecera de un mensaje; le siguen `carteras` elementos Monedas.
+ */
+typedef struct {
+    CabeceraBloque bloque;
+    uint16_t formato;  /**< BLOQUE_COMPLETO o BLOQUE_DELTA */
+    uint16_t carteras; /**< Número de carteras que siguen a la cabecera */
+} CabeceraMensaje;
+
+#define BLOQUE_MAX_BYTES (sizeof(CabeceraMensaje) + BLOQUE_MAX_CARTERAS * sizeof(Monedas)) /**< Mayor mensaje posible */
+
+_Static_assert(BLOQUE_MAX_BYTES <= 8192, "Un bloque debe caber en un mensaje de la cola (msgsize_max por defecto)");
+
+/**
+ * @brief Escribe un bloque en formato compacto.
+ *
+ * @param bloque Campos del bloque.
+ * @param formato BLOQUE_COMPLETO o BLOQUE_DELTA.
+ * @param carteras Carteras que lleva el mensaje.
+ * @param n Número de carteras, como mucho BLOQUE_MAX_CARTERAS.
+ * @param buffer Destino, de al menos BLOQUE_MAX_BYTES bytes.
+ * @return Bytes escritos.
+ */
+size_t bloque_codificar(const CabeceraBloque *bloque, int formato, const Monedas *carteras, int n, void *buffer);
+
+/**
+ * @brief Lee un bloque en formato compacto.
+ *
+ * @param buffer Mensaje recibido.
+ * @param bytes Longitud del mensaje.
+ * @param bloque Campos del bloque leídos.
+ * @param formato BLOQUE_COMPLETO o BLOQUE_DELTA.
+ * @param carteras Destino de las carteras, con sitio para BLOQUE_MAX_CARTERAS.
+ * @return Número de carteras leídas, o -1 si el mensaje está mal formado.
+ */
+int bloque_decodificar(const void *buffer, size_t bytes, CabeceraBloque *bloque, int *formato, Monedas *carteras);
+
+/**
+ * @brief Aplica las carteras de un mensaje al estado completo que guarda el receptor.
+ *
+ * Un mensaje completo sustituye el estado; uno delta actualiza, añade o da de baja las
+ * carteras que lleva.
+ *
+ * @param estado Carteras vivas conocidas, con sitio para BLOQUE_MAX_CARTERAS.
+ * @param n_estado Número de carteras de `estado`; se actualiza.
+ * @param formato Formato del mensaje.
+ * @param carteras Carteras del mensaje.
+ * @param n Número de carteras del mensaje.
+ */
+void bloque_aplicar(Monedas *estado, int *n_estado, int formato, const Monedas *carteras, int n);
+
+#endif
@@ -1,102 +1,89 @@
 #include "monitor.h"
 
 /**
- * @brief Función que inicializa el segmento de memoria compartida y la cola de mensajes.
+ * @brief Función que crea el transporte por el que los mineros envían sus bloques.
  * 
- * Crea el segmento de memoria compartida y la cola de mensajes para la comunicación
- * entre los procesos mineros y el monitor.
+ * El buffer compartido con el monitor ya está iniciado antes del fork.
  * 
- * @param fd_shm Descriptor del segmento de memoria compartida. 
- * @param segmento Puntero al segmento de memoria compartida.
- * @param mq Cola de mensajes para la comunicación con el comprobador.
+ * @param transporte Transporte por el que llegan los bloques de los mineros.
+ * @param tipo TRANSPORTE_COLA o TRANSPORTE_ANILLO.
+ * @param celdas Celdas del anillo, si se usa.
  */
-int setup_comprobador(SharedMem **segmento, mqd_t *mq){
-    struct mq_attr attr;
+int setup_comprobador(Transporte *transporte, int tipo, int celdas){
 
     printf("[%d] Checking blocks...\n", getpid());
     fflush(stdout);
 
-    (*segmento)->in = 0;
-    (*segmento)->out = 0;
-
-    /* Si apuntan al mismo es que está vacio, se incremente in al insertar */
-    /* Se aumenta out al sacar, */
-    /* Si in + 1 apunta a out, está lleno y no se puede añadir */
-
-    /* Iniciar semaforos aqui? */
-    /* Inicializamos el semáforo anónimo. El valor inicial es 1 para mutex, 0 para el resto. */
-    if (sem_init(&(*segmento)->semaforos.mutex, 1, 1) != 0) {
-        perror("sem_init\n");
-        fflush(stdout);
-        return 1;
-    }
-    if (sem_init(&(*segmento)->semaforos.sem_fill, 1, 0) != 0) {
-        perror("sem_init\n");
-        fflush(stdout);
-        return 1;
-    }
-    if (sem_init(&(*segmento)->semaforos.sem_empty, 1, MAX_BLOQUES) != 0) {
-        perror("sem_init\n");
-        fflush(stdout);
-        return 1;
+    /* Los mineros usan el anillo si existe: en modo cola no debe quedar uno viejo */
+    if (tipo == TRANSPORTE_COLA) {
+        shm_unlink(ANILLO_NAME);
     }
-
-    attr.mq_flags   = 0;               // bloqueo
-    attr.mq_maxmsg  = 10;              // max. mensajes en cola
-    attr.mq_msgsize = sizeof(Bloque);  // ¡tamaño exacto!
-    attr.mq_curmsgs = 0;               // (lectura solo)
-    /* Abrir la cola de mensajes para lectura */
-    *mq = mq_open(QUEUE_NAME, O_CREAT | O_RDONLY, 0666, &attr);
-    if (*mq == (mqd_t)-1) {
-        perror("Error al crear/abrir la cola");
+    if (transporte_crear(transporte, tipo, tipo == TRANSPORTE_ANILLO ? ANILLO_NAME : QUEUE_NAME, celdas) != 0) {
         return 1;
     }
     return 0;
 }
 
-void comprobador(SharedMem *segmento, mqd_t *mq){
-    Bloque recibido;
-    int objetivo, solucion, in;
-    bool correcto;
+void comprobador(AnilloDifusion *segmento, Transporte *transporte, const TablaPow *tabla, Libro *libro, Traza *traza, Metricas *metricas, Exportador *exportador, Eventos *eventos){
+    /* Carteras vivas según los bloques recibidos, para expandir los bloques delta */
+    static Monedas estado[BLOQUE_MAX_CARTERAS], carteras[BLOQUE_MAX_CARTERAS];
+    unsigned char recibido[BLOQUE_MAX_BYTES], validado[BLOQUE_MAX_BYTES];
+    CabeceraBloque bloque = {0};
+    ssize_t bytes;
+    int n_estado = 0, n, formato;
 
-    /* Recibir bloque de la cola de mensajes */
-    /* Recibir mensajes de la cola */
+    /* Recibir bloques del transporte; recibir duerme mientras no llegue ninguno */
     do {
-        while(mq_receive(*mq, (char*)&recibido, sizeof(Bloque), NULL) == -1);
-        objetivo = recibido.objetivo;
-        solucion = recibido.solucion;
-        if (pow_hash(solucion) == objetivo){
-            correcto = true;
+        if ((bytes = transporte_recibir(transporte, recibido)) == -1) {
+            /* Sin transporte no llegarán más bloques: se despide al monitor como al salir */
+            memset(&bloque, 0, sizeof(bloque));
+            bloque.solucion = COD_SALIDA;
+            n = 0;
+            formato = BLOQUE_COMPLETO;
+        } else {
+            n = bloque_decodificar(recibido, (size_t)bytes, &bloque, &formato, carteras);
+        }
+        if (n == -1) {
+            fprintf(stderr, "[%d] Discarding malformed block (%zd bytes)\n", getpid(), bytes);
+            continue;
+        }
+        if (metricas && bloque.solucion != COD_SALIDA) {
+            metricas_sumar(metricas, MET_BLOQUES, 1);
+            metricas_fijar(metricas, MET_COLA, (uint64_t)transporte_pendientes(transporte));
+            exportador_bloque(exportador, &bloque);
+        }
+        bloque_aplicar(estado, &n_estado, formato, carteras, n);
+        /* Con tabla, la única preimagen en [0, POW_LIMIT) del objetivo debe ser la solución */
+        if (tabla ? tabla_pow_buscar(tabla, bloque.objetivo) == bloque.solucion
+                  : pow_hash(bloque.solucion) == bloque.objetivo){
+            bloque.correcto = true;
         }
         else {
-            correcto = false;
+            bloque.correcto = false;
         }
-        /* Mensaje recibido */
-        safe_sem_wait(&segmento->semaforos.sem_empty, "sem_empty");
-        safe_sem_wait(&segmento->semaforos.mutex, "mutex");
-        in = segmento->in;
-        
-        /* Escritura en el buffer */
-        segmento->bloques[in].id = recibido.id;
-        segmento->bloques[in].objetivo = objetivo;
-        segmento->bloques[in].solucion = solucion;
-        segmento->bloques[in].ganador = recibido.ganador;
-        for (int i = 0; i < MAX_MINERS; i++) {
-            segmento->bloques[in].monedas_mineros[i].pid = recibido.monedas_mineros[i].pid;
-            segmento->bloques[in].monedas_mineros[i].monedas = recibido.monedas_mineros[i].monedas;
+        /* Los lectores siempre reciben todas las carteras vivas */
+        bytes = (ssize_t)bloque_codificar(&bloque, BLOQUE_COMPLETO, estado, n_estado, validado);
+        /* Se marca antes de publicar: el monitor puede imprimirlo antes de que vuelva la publicación */
+        if (bloque.solucion != COD_SALIDA) {
+            metricas_sumar(metricas, bloque.correcto ? MET_VALIDOS : MET_INVALIDOS, 1);
+            traza_cruzar(traza, bloque.id, MARCA_VALIDADO, FASE_COMPROBACION, MARCA_ENVIO);
+            eventos_anotar(eventos, EVENTO_VALIDADO, bloque.id, bloque.correcto);
         }
-        segmento->bloques[in].total_votos = recibido.total_votos;
-        segmento->bloques[in].votos_positivos = recibido.votos_positivos;   
-        segmento->bloques[in].correcto = correcto;
-        segmento->in = (in + 1) % MAX_BLOQUES;
-
-        safe_sem_post(&segmento->semaforos.mutex, "mutex");
-        safe_sem_post(&segmento->semaforos.sem_fill, "sem_fill");
-    } while (solucion != COD_SALIDA);
+        difusion_publicar(segmento, validado, (size_t)bytes);
+        if (metricas) {
+            metricas_fijar(metricas, MET_ANILLO, difusion_ocupacion(segmento));
+        }
+        /* El libro guarda los bloques tal y como se difunden; el de salida no es un bloque */
+        if (libro && bloque.solucion != COD_SALIDA && libro_anotar(libro, bloque.id, validado, (size_t)bytes) != 0) {
+            fprintf(stderr, "[%d] The ledger could not grow; no more blocks will be stored\n", getpid());
+            libro = NULL;
+        }
+    } while (bloque.solucion != COD_SALIDA);
+    difusion_cerrar(segmento);
 
     printf("[%d] Finishing\n", getpid());
     fflush(stdout);
 
-    mq_unlink(QUEUE_NAME);
+    transporte_borrar(transporte);
     return;
 }
\ No newline at end of file
@@ -0,0 +1,232 @@
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+
+#include "difusion.h"
+#include "futex.h"
+
+size_t difusion_tamano(uint32_t profundidad) {
+    return sizeof(AnilloDifusion) + (size_t)profundidad * sizeof(RanuraDifusion);
+}
+
+void difusion_iniciar(AnilloDifusion *anillo, uint32_t profundidad) {
+    anillo->profundidad = profundidad;
+    anillo->tamano = difusion_tamano(profundidad);
+    atomic_init(&anillo->in, 0);
+    anillo->limite = 0;
+    atomic_init(&anillo->productor_dormido, 0);
+    atomic_init(&anillo->cerrado, 0);
+    atomic_init(&anillo->aviso_datos, 0);
+    atomic_init(&anillo->lectores_dormidos, 0);
+    atomic_init(&anillo->aviso_hueco, 0);
+    for (int i = 0; i < DIFUSION_MAX_LECTORES; i++) {
+        atomic_init(&anillo->lectores[i].estado, LECTOR_LIBRE);
+        atomic_init(&anillo->lectores[i].pid, 0);
+        atomic_init(&anillo->lectores[i].out, 0);
+        atomic_init(&anillo->lectores[i].saltados, 0);
+    }
+    for (uint32_t i = 0; i < profundidad; i++) {
+        atomic_init(&anillo->ranuras[i].secuencia, 0);
+    }
+}
+
+int difusion_unirse(AnilloDifusion *anillo, int politica, pid_t pid) {
+    LectorDifusion *lector;
+    int libre;
+
+    for (int i = 0; i < DIFUSION_MAX_LECTORES; i++) {
+        lector = &anillo->lectores[i];
+        libre = LECTOR_LIBRE;
+        if (!atomic_compare_exchange_strong(&lector->estado, &libre, LECTOR_RESERVADO)) {
+            continue;
+        }
+        lector->politica = politica;
+        atomic_store(&lector->pid, pid);
+        atomic_store(&lector->saltados, 0);
+        atomic_store(&lector->out, atomic_load(&anillo->in));
+        /* El productor solo mira la casilla cuando ya tiene cursor y política */
+        atomic_store_explicit(&lector->estado, LECTOR_ACTIVO, memory_order_release);
+        return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Despierta al productor si está esperando hueco.
+ */
+static void avisar_hueco(AnilloDifusion *anillo) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&anillo->productor_dormido, memory_order_relaxed)) {
+        atomic_fetch_add(&anillo->aviso_hueco, 1);
+        futex_despertar_uno(&anillo->aviso_hueco);
+    }
+}
+
+void difusion_salir(AnilloDifusion *anillo, int lector) {
+    atomic_store(&anillo->lectores[lector].estado, LECTOR_LIBRE);
+    avisar_hueco(anillo);
+}
+
+/**
+ * @brief Cursor del lector DIFUSION_ESPERAR más atrasado, o `in` si no hay ninguno.
+ *
+ * Las casillas de lectores que han muerto sin salir se liberan aquí, para que un monitor
+ * caído no detenga al comprobador para siempre.
+ */
+static uint64_t minimo_esperando(AnilloDifusion *anillo, uint64_t in) {
+    LectorDifusion *lector;
+    uint64_t minimo = in, out;
+    pid_t pid;
+
+    for (int i = 0; i < DIFUSION_MAX_LECTORES; i++) {
+        lector = &anillo->lectores[i];
+        if (atomic_load_explicit(&lector->estado, memory_order_acquire) != LECTOR_ACTIVO ||
+            lector->politica != DIFUSION_ESPERAR) {
+            continue;
+        }
+        out = atomic_load_explicit(&lector->out, memory_order_acquire);
+        if (in - out >= anillo->profundidad) {
+            pid = atomic_load(&lector->pid);
+            if (pid > 0 && kill(pid, 0) == -1 && errno == ESRCH) {
+                atomic_store(&lector->estado, LECTOR_LIBRE);
+                continue;
+            }
+        }
+        if (out < minimo) {
+            minimo = out;
+        }
+    }
+    return minimo;
+}
+
+void difusion_publicar(AnilloDifusion *anillo, const void *bloque, size_t bytes) {
+    uint64_t in = atomic_load_explicit(&anillo->in, memory_order_relaxed);
+    RanuraDifusion *ranura;
+    uint32_t aviso;
+
+    /* Solo se recorren los cursores al llegar al límite calculado la última vez */
+    while (in >= anillo->limite) {
+        anillo->limite = minimo_esperando(anillo, in) + anillo->profundidad;
+        if (in < anillo->limite) {
+            break;
+        }
+        /* Lleno para algún lector que espera: se anuncia que se duerme y se vuelve a mirar */
+        aviso = atomic_load(&anillo->aviso_hueco);
+        atomic_store_explicit(&anillo->productor_dormido, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (in >= minimo_esperando(anillo, in) + anillo->profundidad) {
+            futex_esperar(&anillo->aviso_hueco, aviso, ESPERA_DIFUSION_MS);
+        }
+        atomic_store_explicit(&anillo->productor_dormido, 0, memory_order_relaxed);
+    }
+
+    /* La secuencia a 0 avisa a los lectores que saltan de que la ranura está a medias */
+    ranura = &anillo->ranuras[in & (anillo->profundidad - 1)];
+    atomic_store_explicit(&ranura->secuencia, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(ranura->bloque, bloque, bytes);
+    ranura->bytes = bytes;
+    atomic_store_explicit(&ranura->secuencia, in + 1, memory_order_release);
+    atomic_store_explicit(&anillo->in, in + 1, memory_order_release);
+
+    /* Un solo despertar para todos los lectores, y solo si alguno duerme */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&anillo->lectores_dormidos, memory_order_relaxed) > 0) {
+        atomic_fetch_add(&anillo->aviso_datos, 1);
+        futex_despertar_todos(&anillo->aviso_datos);
+    }
+}
+
+uint64_t difusion_ocupacion(const AnilloDifusion *anillo) {
+    uint64_t in = atomic_load_explicit(&anillo->in, memory_order_relaxed), minimo = in, out;
+
+    for (int i = 0; i < DIFUSION_MAX_LECTORES; i++) {
+        if (atomic_load_explicit(&anillo->lectores[i].estado, memory_order_acquire) != LECTOR_ACTIVO) {
+            continue;
+        }
+        out = atomic_load_explicit(&anillo->lectores[i].out, memory_order_relaxed);
+        if (out < minimo) {
+            minimo = out;
+        }
+    }
+    return in - minimo;
+}
+
+void difusion_cerrar(AnilloDifusion *anillo) {
+    atomic_store(&anillo->cerrado, 1);
+    atomic_fetch_add(&anillo->aviso_datos, 1);
+    futex_despertar_todos(&anillo->aviso_datos);
+}
+
+int difusion_esperar(AnilloDifusion *anillo, int lector) {
+    uint64_t out = atomic_load_explicit(&anillo->lectores[lector].out, memory_order_relaxed);
+    uint32_t aviso;
+
+    /* Lo leído en la última tanda puede ser el hueco que espera el productor */
+    avisar_hueco(anillo);
+
+    while (atomic_load_explicit(&anillo->in, memory_order_acquire) == out) {
+        if (atomic_load(&anillo->cerrado)) {
+            return atomic_load(&anillo->in) == out ? -1 : 0;
+        }
+        aviso = atomic_load(&anillo->aviso_datos);
+        atomic_fetch_add(&anillo->lectores_dormidos, 1);
+        /* Tras anunciarse se vuelve a mirar: un bloque publicado antes no traerá aviso */
+        if (atomic_load(&anillo->in) == out && !atomic_load(&anillo->cerrado)) {
+            futex_esperar(&anillo->aviso_datos, aviso, ESPERA_DIFUSION_MS);
+        }
+        atomic_fetch_sub(&anillo->lectores_dormidos, 1);
+    }
+    return 0;
+}
+
+size_t difusion_leer(AnilloDifusion *anillo, int lector, void *buffer, uint64_t *saltados) {
+    LectorDifusion *casilla = &anillo->lectores[lector];
+    uint64_t out = atomic_load_explicit(&casilla->out, memory_order_relaxed);
+    uint64_t in, primera, segunda, perdidos = 0;
+    RanuraDifusion *ranura;
+    size_t bytes;
+
+    for (;;) {
+        in = atomic_load_explicit(&anillo->in, memory_order_acquire);
+        if (in == out) {
+            break;
+        }
+        if (in - out > anillo->profundidad) {
+            /* Nos han adelantado una vuelta: se salta al bloque más antiguo que sigue ahí */
+            perdidos += in - anillo->profundidad - out;
+            out = in - anillo->profundidad;
+        }
+        ranura = &anillo->ranuras[out & (anillo->profundidad - 1)];
+        primera = atomic_load_explicit(&ranura->secuencia, memory_order_acquire);
+        if (primera != out + 1) {
+            /* El productor está sobrescribiendo la ranura: enseguida avanzará `in` */
+            sched_yield();
+            continue;
+        }
+        bytes = ranura->bytes;
+        if (bytes > BLOQUE_MAX_BYTES) {
+            bytes = BLOQUE_MAX_BYTES;
+        }
+        memcpy(buffer, ranura->bloque, bytes);
+        atomic_thread_fence(memory_order_acquire);
+        segunda = atomic_load_explicit(&ranura->secuencia, memory_order_relaxed);
+        if (segunda != primera) {
+            continue;
+        }
+
+        atomic_store_explicit(&casilla->out, out + 1, memory_order_release);
+        if (perdidos) {
+            atomic_fetch_add(&casilla->saltados, perdidos);
+        }
+        if (saltados) {
+            *saltados = perdidos;
+        }
+        return bytes;
+    }
+    if (saltados) {
+        *saltados = 0;
+    }
+    return 0;
+}
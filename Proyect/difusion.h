@@ -0,0 +1,163 @@
+/**
+ * @file difusion.h
+ * @brief Anillo de difusión de los bloques validados del comprobador a varios lectores.
+ *
+ * El comprobador publica cada bloque una sola vez y cada lector (el monitor de terminal,
+ * un monitor adicional, un exportador...) avanza su propio cursor, así que ninguno le quita
+ * bloques a otro. Cada lector elige qué pasa si se queda atrás:
+ *  - DIFUSION_ESPERAR: el comprobador no sobrescribe lo que no ha leído (contrapresión).
+ *  - DIFUSION_SALTAR: el comprobador no le espera; si le adelanta una vuelta entera, el
+ *    lector salta a los bloques más antiguos que siguen en el anillo y cuenta los perdidos.
+ *
+ * El productor solo publica un número de secuencia por bloque. Recorre los cursores de los
+ * lectores que esperan solo cuando alcanza el límite que calculó la última vez, y los
+ * lectores se despiertan con un único FUTEX_WAKE compartido cuando alguno duerme.
+ */
+
+#ifndef DIFUSION_H
+#define DIFUSION_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "bloque.h"
+
+#define DIFUSION_MAX_LECTORES 8 /**< Lectores simultáneos del anillo */
+#define DIFUSION_ESPERAR 0 /**< El productor espera a este lector si el anillo se llena */
+#define DIFUSION_SALTAR 1 /**< Este lector pierde bloques si se queda una vuelta atrás */
+#define ESPERA_DIFUSION_MS 50 /**< Espera máxima en un futex antes de volver a mirar los índices */
+
+#define LECTOR_LIBRE 0     /**< Casilla de lector sin usar */
+#define LECTOR_ACTIVO 1    /**< Casilla de lector en uso */
+#define LECTOR_RESERVADO 2 /**< Casilla tomada cuyo cursor aún se está preparando */
+
+/**
+ * @brief Posición del anillo: un bloque validado en formato compacto completo.
+ *
+ * `secuencia` vale la posición del bloque más uno cuando está escrito, y 0 mientras el
+ * productor lo sobrescribe; un lector que salta compara la secuencia antes y después de
+ * copiar el bloque para saber si se lo han cambiado a medias.
+ */
+typedef struct {
+  _Alignas(64) _Atomic uint64_t secuencia;
+  size_t bytes; /**< Bytes ocupados en `bloque` */
+  unsigned char bloque[BLOQUE_MAX_BYTES]; /**< Bloque en formato compacto */
+} RanuraDifusion;
+
+/**
+ * @brief Casilla de un lector, en su propia línea de caché.
+ */
+typedef struct {
+  _Alignas(64) _Atomic int estado; /**< LECTOR_LIBRE, LECTOR_RESERVADO o LECTOR_ACTIVO */
+  int politica; /**< DIFUSION_ESPERAR o DIFUSION_SALTAR */
+  _Atomic pid_t pid; /**< Proceso lector, para liberar la casilla si muere; 0 si aún no se conoce */
+  _Atomic uint64_t out; /**< Bloques leídos por este lector */
+  _Atomic uint64_t saltados; /**< Bloques perdidos por quedarse atrás */
+} LectorDifusion;
+
+/**
+ * @brief Segmento compartido entre el comprobador y los lectores.
+ */
+typedef struct {
+  uint32_t profundidad; /**< Número de posiciones, potencia de dos */
+  size_t tamano; /**< Tamaño total del segmento en bytes */
+  _Alignas(64) _Atomic uint64_t in; /**< Bloques publicados; solo lo avanza el comprobador */
+  uint64_t limite; /**< Hasta dónde puede publicar sin mirar los cursores; solo lo usa el comprobador */
+  _Atomic int productor_dormido; /**< El comprobador espera hueco en aviso_hueco */
+  _Atomic int cerrado; /**< Ya se ha publicado el último bloque */
+  _Atomic uint32_t aviso_datos; /**< Palabra futex en la que duermen los lectores */
+  _Alignas(64) _Atomic int lectores_dormidos; /**< Lectores dormidos en aviso_datos */
+  _Atomic uint32_t aviso_hueco; /**< Palabra futex en la que duerme el comprobador */
+  LectorDifusion lectores[DIFUSION_MAX_LECTORES]; /**< Cursores de los lectores */
+  RanuraDifusion ranuras[]; /**< Array circular de bloques validados */
+} AnilloDifusion;
+
+/**
+ * @brief Bytes que ocupa un anillo de `profundidad` posiciones.
+ *
+ * @param profundidad Número de posiciones, potencia de dos.
+ * @return Tamaño del segmento.
+ */
+size_t difusion_tamano(uint32_t profundidad);
+
+/**
+ * @brief Prepara un anillo vacío y sin lectores.
+ *
+ * @param anillo Segmento recién proyectado, de difusion_tamano(profundidad) bytes.
+ * @param profundidad Número de posiciones, potencia de dos.
+ */
+void difusion_iniciar(AnilloDifusion *anillo, uint32_t profundidad);
+
+/**
+ * @brief Ocupa una casilla de lector, que empieza a leer desde el siguiente bloque publicado.
+ *
+ * Quien se une con el productor ya en marcha puede perder algún bloque de la primera vuelta
+ * aunque pida DIFUSION_ESPERAR; para no perder ninguno hay que unirse antes de publicar.
+ *
+ * @param anillo Anillo proyectado.
+ * @param politica DIFUSION_ESPERAR o DIFUSION_SALTAR.
+ * @param pid Proceso que va a leer, o 0 si aún no existe (se puede fijar después en la casilla).
+ * @return Número de lector, o -1 si no quedan casillas.
+ */
+int difusion_unirse(AnilloDifusion *anillo, int politica, pid_t pid);
+
+/**
+ * @brief Libera la casilla del lector; el productor deja de esperarle.
+ *
+ * @param anillo Anillo proyectado.
+ * @param lector Número de lector.
+ */
+void difusion_salir(AnilloDifusion *anillo, int lector);
+
+/**
+ * @brief Publica un bloque. Solo hay un productor.
+ *
+ * Si algún lector DIFUSION_ESPERAR tiene el anillo lleno, espera a que lea.
+ *
+ * @param anillo Anillo proyectado.
+ * @param bloque Bloque en formato compacto.
+ * @param bytes Longitud, como mucho BLOQUE_MAX_BYTES.
+ */
+void difusion_publicar(AnilloDifusion *anillo, const void *bloque, size_t bytes);
+
+/**
+ * @brief Bloques publicados que el lector más atrasado aún no ha leído.
+ *
+ * @param anillo Anillo proyectado.
+ * @return Ocupación del anillo, como mucho su profundidad para los lectores que esperan.
+ */
+uint64_t difusion_ocupacion(const AnilloDifusion *anillo);
+
+/**
+ * @brief Marca que no se publicarán más bloques, para que los lectores no esperen en vano.
+ *
+ * @param anillo Anillo proyectado.
+ */
+void difusion_cerrar(AnilloDifusion *anillo);
+
+/**
+ * @brief Espera a que el lector tenga algún bloque pendiente.
+ *
+ * Antes de dormir despierta al productor si estaba esperando hueco, así que un lector
+ * DIFUSION_ESPERAR debe llamarla entre cada tanda de difusion_leer().
+ *
+ * @param anillo Anillo proyectado.
+ * @param lector Número de lector.
+ * @return 0 si hay bloques pendientes, -1 si el anillo está cerrado y no queda ninguno.
+ */
+int difusion_esperar(AnilloDifusion *anillo, int lector);
+
+/**
+ * @brief Copia el siguiente bloque pendiente del lector, sin esperar.
+ *
+ * @param anillo Anillo proyectado.
+ * @param lector Número de lector.
+ * @param buffer Destino, de al menos BLOQUE_MAX_BYTES bytes.
+ * @param saltados Si no es NULL, recibe los bloques perdidos justo antes de este.
+ * @return Longitud del bloque, o 0 si no hay ninguno pendiente.
+ */
+size_t difusion_leer(AnilloDifusion *anillo, int lector, void *buffer, uint64_t *saltados);
+
+#endif
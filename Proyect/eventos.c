@@ -0,0 +1,70 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "eventos.h"
+
+int eventos_abrir(Eventos *eventos, const char *directorio, RolEventos rol) {
+    char ruta[EVENTOS_MAX_RUTA];
+    int fd;
+
+    if (snprintf(ruta, sizeof(ruta), "%s/eventos.%d.bin", directorio, getpid()) >= (int)sizeof(ruta)) {
+        fprintf(stderr, "La ruta del directorio de eventos es demasiado larga\n");
+        return -1;
+    }
+    /* Un fichero de un pid anterior reutilizado se sobrescribe entero */
+    if ((fd = open(ruta, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1) {
+        perror(ruta);
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)EVENTOS_TAMANO) == -1) {
+        perror("ftruncate eventos");
+        close(fd);
+        return -1;
+    }
+    eventos->tamano = EVENTOS_TAMANO;
+    eventos->cabecera = mmap(NULL, eventos->tamano, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (eventos->cabecera == MAP_FAILED) {
+        perror("mmap eventos");
+        return -1;
+    }
+    eventos->eventos = (Evento *)(eventos->cabecera + 1);
+
+    /* El fichero recién truncado está a ceros: ningún evento tiene todavía su número */
+    memcpy(eventos->cabecera->magia, EVENTOS_MAGIA, sizeof(eventos->cabecera->magia));
+    eventos->cabecera->version = EVENTOS_VERSION;
+    eventos->cabecera->rol = (uint32_t)rol;
+    eventos->cabecera->pid = getpid();
+    eventos->cabecera->capacidad = EVENTOS_CAPACIDAD;
+    atomic_store(&eventos->cabecera->siguiente, 0);
+    return 0;
+}
+
+void eventos_anotar(Eventos *eventos, TipoEvento tipo, int ronda, int64_t dato) {
+    struct timespec ahora;
+    uint64_t numero;
+    Evento *evento;
+
+    if (!eventos) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ahora);
+    /* fetch_add y no carga-almacenamiento: un manejador de señal puede interrumpir a mitad */
+    numero = atomic_fetch_add_explicit(&eventos->cabecera->siguiente, 1, memory_order_relaxed);
+    evento = &eventos->eventos[numero & (EVENTOS_CAPACIDAD - 1)];
+    evento->instante_ns = (uint64_t)ahora.tv_sec * 1000000000ULL + (uint64_t)ahora.tv_nsec;
+    evento->tipo = (uint32_t)tipo;
+    evento->ronda = ronda;
+    evento->dato = dato;
+    /* El número va el último: un evento a medio escribir no lleva el de su posición */
+    atomic_store_explicit(&evento->numero, numero + 1, memory_order_release);
+}
+
+void eventos_cerrar(Eventos *eventos) {
+    munmap(eventos->cabecera, eventos->tamano);
+}
@@ -0,0 +1,120 @@
+/**
+ * @file eventos.h
+ * @brief Registro binario de eventos de cada proceso en un anillo proyectado de un fichero.
+ *
+ * Cada proceso con --eventos <directorio> crea <directorio>/eventos.<pid>.bin y anota en él
+ * eventos de tamaño fijo: apertura de ronda, despertar, señal recibida, solución, voto,
+ * votación decidida, envío al transporte, bloque validado y bloque impreso. El fichero es
+ * una proyección MAP_SHARED, así que los eventos llegan al disco aunque el proceso muera o
+ * se quede colgado, y volcar_eventos los mezcla después en una línea de tiempo.
+ *
+ * Anotar es una lectura de CLOCK_MONOTONIC_RAW por el vDSO, un fetch_add sobre el índice y
+ * el almacenamiento de 32 bytes, sin bloqueos ni llamadas al sistema: unas decenas de
+ * nanosegundos, poco para las decenas de eventos de una ronda de milisegundos. Como el
+ * índice se reserva con fetch_add, también se puede anotar desde un manejador de señal.
+ * CLOCK_MONOTONIC_RAW es el mismo reloj para todos los procesos y, a diferencia del TSC,
+ * no hace falta calibrarlo para pasarlo a nanosegundos.
+ */
+
+#ifndef EVENTOS_H
+#define EVENTOS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define EVENTOS_MAGIA "EVENTOS" /**< Firma al principio de cada fichero, con su terminador */
+#define EVENTOS_VERSION 1 /**< Versión del formato del fichero */
+#define EVENTOS_CAPACIDAD 65536 /**< Eventos del anillo, potencia de dos: 2 MiB por proceso */
+#define EVENTOS_MAX_RUTA 4096 /**< Longitud máxima de la ruta del fichero */
+
+/**
+ * @brief Qué ha pasado.
+ */
+typedef enum {
+    EVENTO_RONDA,     /**< El ganador anterior (o el primer minero) abre la ronda */
+    EVENTO_DESPERTAR, /**< El minero despierta del futex de ronda */
+    EVENTO_SENAL,     /**< Llega una señal; el dato es su número */
+    EVENTO_SOLUCION,  /**< El minero encuentra la solución; el dato es la solución */
+    EVENTO_VOTO,      /**< El minero vota; el dato es 1 a favor, 0 en contra */
+    EVENTO_VOTOS,     /**< El ganador da la votación por decidida; el dato son los votos a favor */
+    EVENTO_ENVIO,     /**< El ganador entrega el bloque al transporte; el dato son los bytes */
+    EVENTO_VALIDADO,  /**< El comprobador valida el bloque; el dato es 1 si es correcto */
+    EVENTO_IMPRESO,   /**< El monitor formatea el bloque */
+    EVENTOS
+} TipoEvento;
+
+/**
+ * @brief Papel del proceso que escribe el fichero.
+ */
+typedef enum {
+    EVENTOS_MINERO,
+    EVENTOS_COMPROBADOR,
+    EVENTOS_MONITOR
+} RolEventos;
+
+/**
+ * @brief Un evento del anillo: 32 bytes, dos por línea de caché.
+ */
+typedef struct {
+    _Atomic uint64_t numero; /**< Posición del evento en el registro más uno; se escribe el último */
+    uint64_t instante_ns; /**< CLOCK_MONOTONIC_RAW */
+    uint32_t tipo; /**< TipoEvento */
+    int32_t ronda; /**< Id del bloque, o -1 si no corresponde a una ronda */
+    int64_t dato; /**< Depende del tipo */
+} Evento;
+
+/**
+ * @brief Cabecera del fichero, seguida de EVENTOS_CAPACIDAD eventos.
+ */
+typedef struct {
+    char magia[8]; /**< EVENTOS_MAGIA */
+    uint32_t version; /**< EVENTOS_VERSION */
+    uint32_t rol; /**< RolEventos */
+    pid_t pid; /**< Proceso que escribe */
+    uint32_t capacidad; /**< Eventos del anillo */
+    _Alignas(64) _Atomic uint64_t siguiente; /**< Eventos reservados desde que se creó */
+} CabeceraEventos;
+
+/**
+ * @brief Registro abierto por un proceso.
+ */
+typedef struct {
+    CabeceraEventos *cabecera; /**< Proyección del fichero */
+    Evento *eventos; /**< Anillo, justo después de la cabecera */
+    size_t tamano; /**< Bytes proyectados */
+} Eventos;
+
+/**
+ * @brief Tamaño del fichero de un registro.
+ */
+#define EVENTOS_TAMANO (sizeof(CabeceraEventos) + EVENTOS_CAPACIDAD * sizeof(Evento))
+
+/**
+ * @brief Crea el fichero de eventos de este proceso y lo proyecta.
+ *
+ * @param eventos Registro a rellenar.
+ * @param directorio Directorio en el que crear eventos.<pid>.bin.
+ * @param rol Papel del proceso.
+ * @return 0 si todo va bien, -1 en caso de error.
+ */
+int eventos_abrir(Eventos *eventos, const char *directorio, RolEventos rol);
+
+/**
+ * @brief Anota un evento; es seguro llamarla desde un manejador de señal.
+ *
+ * @param eventos Registro abierto, o NULL para no anotar.
+ * @param tipo Qué ha pasado.
+ * @param ronda Id del bloque, o -1.
+ * @param dato Dato del evento.
+ */
+void eventos_anotar(Eventos *eventos, TipoEvento tipo, int ronda, int64_t dato);
+
+/**
+ * @brief Deshace la proyección; el fichero se queda en disco para volcar_eventos.
+ *
+ * @param eventos Registro abierto.
+ */
+void eventos_cerrar(Eventos *eventos);
+
+#endif
@@ -0,0 +1,483 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "exportador.h"
+
+#define SONDEO_GANADOR 64 /* Casillas que se prueban antes de contar un ganador en otros */
+#define ID_ESCUCHA -1 /* Dato epoll del socket de escucha */
+#define ID_RELOJ -2 /* Dato epoll del temporizador */
+#define ID_PARAR -3 /* Dato epoll del eventfd de parada */
+
+/* Límites superiores de los histogramas exportados, en segundos */
+static const double limites_segundos[] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+
+/**
+ * @brief Texto de una respuesta que crece según se escribe.
+ */
+typedef struct {
+    char *texto;
+    size_t longitud;
+    size_t capacidad;
+} Texto;
+
+static uint64_t instante_ns(void) {
+    struct timespec ahora;
+
+    clock_gettime(CLOCK_MONOTONIC, &ahora);
+    return (uint64_t)ahora.tv_sec * 1000000000ULL + (uint64_t)ahora.tv_nsec;
+}
+
+/**
+ * @brief Añade texto con formato; si no hay memoria, el texto se queda como estaba.
+ */
+static void anadir(Texto *texto, const char *formato, ...) {
+    va_list argumentos;
+    size_t capacidad;
+    char *nuevo;
+    int n;
+
+    while (1) {
+        va_start(argumentos, formato);
+        n = vsnprintf(texto->texto + texto->longitud, texto->capacidad - texto->longitud, formato, argumentos);
+        va_end(argumentos);
+        if (n < 0) {
+            return;
+        }
+        if ((size_t)n < texto->capacidad - texto->longitud) {
+            texto->longitud += (size_t)n;
+            return;
+        }
+        capacidad = 2 * texto->capacidad + (size_t)n;
+        if ((nuevo = realloc(texto->texto, capacidad)) == NULL) {
+            texto->texto[texto->longitud] = '\0';
+            return;
+        }
+        texto->texto = nuevo;
+        texto->capacidad = capacidad;
+    }
+}
+
+/**
+ * @brief Copia un histograma compartido, empezando por la cuenta.
+ */
+static void copiar_histograma(const HistogramaTraza *origen, uint64_t *cuenta, uint64_t *suma, uint64_t *cubetas) {
+    *cuenta += atomic_load_explicit(&origen->cuenta, memory_order_acquire);
+    *suma += atomic_load_explicit(&origen->suma, memory_order_relaxed);
+    for (int c = 0; c < TRAZA_CUBETAS; c++) {
+        cubetas[c] += atomic_load_explicit(&origen->cubetas[c], memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Escribe un histograma en formato Prometheus con los límites de limites_segundos.
+ *
+ * Una cubeta cuenta para un límite si entera queda por debajo, así que cada límite lleva
+ * el error relativo de las cubetas de la traza.
+ */
+static void anadir_histograma(Texto *texto, const char *nombre, const char *etiqueta, uint64_t cuenta,
+                              uint64_t suma, const uint64_t *cubetas) {
+    uint64_t acumulado = 0, total = 0;
+    int c = 0;
+
+    for (int i = 0; i < TRAZA_CUBETAS; i++) {
+        total += cubetas[i];
+    }
+    for (size_t l = 0; l < sizeof(limites_segundos) / sizeof(limites_segundos[0]); l++) {
+        while (c + 1 < TRAZA_CUBETAS && traza_cubeta_inicio(c + 1) <= (uint64_t)(limites_segundos[l] * 1e9)) {
+            acumulado += cubetas[c++];
+        }
+        anadir(texto, "%s_bucket{%s%sle=\"%g\"} %llu\n", nombre, etiqueta, *etiqueta ? "," : "",
+               limites_segundos[l], (unsigned long long)acumulado);
+    }
+    /* La cuenta se leyó antes que las cubetas: +Inf no puede quedar por debajo del último límite */
+    anadir(texto, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", nombre, etiqueta, *etiqueta ? "," : "",
+           (unsigned long long)(total > cuenta ? total : cuenta));
+    anadir(texto, "%s_sum%s%s%s %.9f\n", nombre, *etiqueta ? "{" : "", etiqueta, *etiqueta ? "}" : "", suma / 1e9);
+    anadir(texto, "%s_count%s%s%s %llu\n", nombre, *etiqueta ? "{" : "", etiqueta, *etiqueta ? "}" : "",
+           (unsigned long long)(total > cuenta ? total : cuenta));
+}
+
+/**
+ * @brief Compone la exposición completa a partir de una foto de los contadores.
+ */
+static void componer(Exportador *exportador, Texto *texto) {
+    static uint64_t cubetas[TRAZA_CUBETAS];
+    const ProcesoMetricas *proceso = exportador->metricas->proceso;
+    uint64_t validos, invalidos, cuenta, suma, bloques;
+    char etiqueta[64];
+    pid_t pid;
+
+    validos = atomic_load_explicit(&proceso->contadores[MET_VALIDOS], memory_order_relaxed);
+    invalidos = atomic_load_explicit(&proceso->contadores[MET_INVALIDOS], memory_order_relaxed);
+
+    anadir(texto, "# HELP pow_checker_blocks_total Blocks checked by the checker.\n"
+                  "# TYPE pow_checker_blocks_total counter\n"
+                  "pow_checker_blocks_total{result=\"valid\"} %llu\n"
+                  "pow_checker_blocks_total{result=\"invalid\"} %llu\n",
+           (unsigned long long)validos, (unsigned long long)invalidos);
+    anadir(texto, "# HELP pow_checker_valid_blocks_per_second Valid blocks per second over the last second.\n"
+                  "# TYPE pow_checker_valid_blocks_per_second gauge\n"
+                  "pow_checker_valid_blocks_per_second %.3f\n", exportador->bloques_por_segundo);
+    anadir(texto, "# HELP pow_checker_valid_ratio Fraction of checked blocks that were valid.\n"
+                  "# TYPE pow_checker_valid_ratio gauge\n"
+                  "pow_checker_valid_ratio %.6f\n",
+           validos + invalidos ? (double)validos / (double)(validos + invalidos) : 0.0);
+    anadir(texto, "# HELP pow_checker_transport_depth Blocks waiting in the miners' transport (queue or ring).\n"
+                  "# TYPE pow_checker_transport_depth gauge\n"
+                  "pow_checker_transport_depth %llu\n",
+           (unsigned long long)atomic_load_explicit(&proceso->contadores[MET_COLA], memory_order_relaxed));
+    anadir(texto, "# HELP pow_checker_monitor_ring_occupancy Published blocks not yet read by the slowest monitor.\n"
+                  "# TYPE pow_checker_monitor_ring_occupancy gauge\n"
+                  "pow_checker_monitor_ring_occupancy %llu\n",
+           (unsigned long long)atomic_load_explicit(&proceso->contadores[MET_ANILLO], memory_order_relaxed));
+
+    anadir(texto, "# HELP pow_winner_blocks_total Blocks proposed by each winning miner.\n"
+                  "# TYPE pow_winner_blocks_total counter\n");
+    for (int i = 0; i < EXPORTADOR_GANADORES; i++) {
+        /* El pid se publica después de su cuenta */
+        if ((pid = atomic_load_explicit(&exportador->ganadores[i].pid, memory_order_acquire)) != 0) {
+            bloques = atomic_load_explicit(&exportador->ganadores[i].bloques, memory_order_relaxed);
+            anadir(texto, "pow_winner_blocks_total{pid=\"%d\"} %llu\n", pid, (unsigned long long)bloques);
+        }
+    }
+    if ((bloques = atomic_load_explicit(&exportador->otros_ganadores, memory_order_relaxed)) != 0) {
+        anadir(texto, "pow_winner_blocks_total{pid=\"other\"} %llu\n", (unsigned long long)bloques);
+    }
+
+    cuenta = suma = 0;
+    memset(cubetas, 0, sizeof(cubetas));
+    copiar_histograma(&exportador->rondas, &cuenta, &suma, cubetas);
+    anadir(texto, "# HELP pow_round_seconds Time between consecutive blocks received by the checker.\n"
+                  "# TYPE pow_round_seconds histogram\n");
+    anadir_histograma(texto, "pow_round_seconds", "", cuenta, suma, cubetas);
+
+    if (!exportador->traza) {
+        return;
+    }
+    anadir(texto, "# HELP pow_round_phase_seconds Duration of each round phase, from the round trace.\n"
+                  "# TYPE pow_round_phase_seconds histogram\n");
+    for (int f = 0; f < FASES; f++) {
+        cuenta = suma = 0;
+        memset(cubetas, 0, sizeof(cubetas));
+        copiar_histograma(&exportador->traza->segmento->retirados[f], &cuenta, &suma, cubetas);
+        for (int p = 0; p < TRAZA_PROCESOS; p++) {
+            if (atomic_load(&exportador->traza->segmento->procesos[p].pid) != 0) {
+                copiar_histograma(&exportador->traza->segmento->procesos[p].fases[f], &cuenta, &suma, cubetas);
+            }
+        }
+        snprintf(etiqueta, sizeof(etiqueta), "phase=\"%s\"", traza_nombres_fase[f]);
+        anadir_histograma(texto, "pow_round_phase_seconds", etiqueta, cuenta, suma, cubetas);
+    }
+}
+
+/**
+ * @brief Prepara la respuesta a una petición completa.
+ */
+static void responder(Exportador *exportador, ClienteExportador *cliente) {
+    Texto cuerpo = {0}, respuesta = {0};
+
+    cuerpo.capacidad = respuesta.capacidad = 16384;
+    cuerpo.texto = malloc(cuerpo.capacidad);
+    respuesta.texto = malloc(respuesta.capacidad);
+    if (!cuerpo.texto || !respuesta.texto) {
+        free(cuerpo.texto);
+        free(respuesta.texto);
+        return;
+    }
+    cuerpo.texto[0] = '\0';
+    if (strncmp(cliente->peticion, "GET /metrics ", 13) == 0 || strncmp(cliente->peticion, "GET / ", 6) == 0) {
+        componer(exportador, &cuerpo);
+        anadir(&respuesta, "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                           "Content-Length: %zu\r\nConnection: close\r\n\r\n%s", cuerpo.longitud, cuerpo.texto);
+    } else {
+        anadir(&respuesta, "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 10\r\n"
+                           "Connection: close\r\n\r\nnot found\n");
+    }
+    free(cuerpo.texto);
+    cliente->respuesta = respuesta.texto;
+    cliente->longitud = respuesta.longitud;
+    cliente->escritos = 0;
+}
+
+static void cerrar_cliente(Exportador *exportador, ClienteExportador *cliente) {
+    epoll_ctl(exportador->epoll, EPOLL_CTL_DEL, cliente->fd, NULL);
+    close(cliente->fd);
+    free(cliente->respuesta);
+    cliente->fd = -1;
+    cliente->respuesta = NULL;
+}
+
+/**
+ * @brief Acepta todas las conexiones pendientes; las que no caben se cierran.
+ */
+static void aceptar(Exportador *exportador) {
+    struct epoll_event evento;
+    int fd, libre;
+
+    while ((fd = accept(exportador->escucha, NULL, NULL)) != -1) {
+        if (fcntl(fd, F_SETFL, O_NONBLOCK) == -1 || fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+            close(fd);
+            continue;
+        }
+        libre = -1;
+        for (int i = 0; i < EXPORTADOR_MAX_CLIENTES && libre == -1; i++) {
+            if (exportador->clientes[i].fd == -1) {
+                libre = i;
+            }
+        }
+        if (libre == -1) {
+            close(fd);
+            continue;
+        }
+        exportador->clientes[libre].fd = fd;
+        exportador->clientes[libre].leidos = 0;
+        exportador->clientes[libre].actividad_ns = instante_ns();
+        evento.events = EPOLLIN;
+        evento.data.u64 = (uint64_t)libre;
+        if (epoll_ctl(exportador->epoll, EPOLL_CTL_ADD, fd, &evento) == -1) {
+            close(fd);
+            exportador->clientes[libre].fd = -1;
+        }
+    }
+}
+
+/**
+ * @brief Atiende un cliente listo: lee la petición o escribe lo que quede de la respuesta.
+ */
+static void atender(Exportador *exportador, ClienteExportador *cliente) {
+    struct epoll_event evento;
+    ssize_t n;
+
+    if (!cliente->respuesta) {
+        n = read(cliente->fd, cliente->peticion + cliente->leidos, sizeof(cliente->peticion) - 1 - cliente->leidos);
+        if (n == -1 && (errno == EAGAIN || errno == EINTR)) {
+            return;
+        }
+        if (n <= 0) {
+            cerrar_cliente(exportador, cliente);
+            return;
+        }
+        cliente->leidos += (size_t)n;
+        cliente->actividad_ns = instante_ns();
+        cliente->peticion[cliente->leidos] = '\0';
+        /* Solo se responde con la cabecera completa, o con el búfer ya lleno */
+        if (!strstr(cliente->peticion, "\r\n\r\n") && cliente->leidos < sizeof(cliente->peticion) - 1) {
+            return;
+        }
+        responder(exportador, cliente);
+        if (!cliente->respuesta) {
+            cerrar_cliente(exportador, cliente);
+            return;
+        }
+        evento.events = EPOLLOUT;
+        evento.data.u64 = (uint64_t)(cliente - exportador->clientes);
+        epoll_ctl(exportador->epoll, EPOLL_CTL_MOD, cliente->fd, &evento);
+    }
+    while (cliente->escritos < cliente->longitud) {
+        n = send(cliente->fd, cliente->respuesta + cliente->escritos, cliente->longitud - cliente->escritos, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && errno == EAGAIN) {
+            return;
+        }
+        if (n <= 0) {
+            break;
+        }
+        cliente->escritos += (size_t)n;
+        cliente->actividad_ns = instante_ns();
+    }
+    cerrar_cliente(exportador, cliente);
+}
+
+/**
+ * @brief Tic de un segundo: tasa de bloques válidos desde el tic anterior y cierre de las
+ * conexiones inactivas.
+ */
+static void tic(Exportador *exportador) {
+    uint64_t expiraciones, validos, ahora;
+
+    if (read(exportador->reloj, &expiraciones, sizeof(expiraciones)) != sizeof(expiraciones) || expiraciones == 0) {
+        return;
+    }
+    validos = atomic_load_explicit(&exportador->metricas->proceso->contadores[MET_VALIDOS], memory_order_relaxed);
+    exportador->bloques_por_segundo = (double)(validos - exportador->validos_previos) / (double)expiraciones;
+    exportador->validos_previos = validos;
+
+    ahora = instante_ns();
+    for (int i = 0; i < EXPORTADOR_MAX_CLIENTES; i++) {
+        if (exportador->clientes[i].fd != -1 &&
+            ahora - exportador->clientes[i].actividad_ns > EXPORTADOR_INACTIVIDAD_S * 1000000000ULL) {
+            cerrar_cliente(exportador, &exportador->clientes[i]);
+        }
+    }
+}
+
+/**
+ * @brief Bucle epoll del hilo del exportador.
+ */
+static void *bucle_exportador(void *arg) {
+    Exportador *exportador = (Exportador *)arg;
+    struct epoll_event eventos[EXPORTADOR_MAX_CLIENTES + 3];
+    int64_t id;
+    int n;
+
+    while (1) {
+        n = epoll_wait(exportador->epoll, eventos, EXPORTADOR_MAX_CLIENTES + 3, -1);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            perror("epoll_wait exportador");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            id = (int64_t)eventos[i].data.u64;
+            if (id == ID_PARAR) {
+                return NULL;
+            } else if (id == ID_ESCUCHA) {
+                aceptar(exportador);
+            } else if (id == ID_RELOJ) {
+                tic(exportador);
+            } else if (exportador->clientes[id].fd != -1) {
+                atender(exportador, &exportador->clientes[id]);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Añade un descriptor al epoll para lectura con un identificador.
+ */
+static int vigilar(Exportador *exportador, int fd, int64_t id) {
+    struct epoll_event evento;
+
+    evento.events = EPOLLIN;
+    evento.data.u64 = (uint64_t)id;
+    return epoll_ctl(exportador->epoll, EPOLL_CTL_ADD, fd, &evento);
+}
+
+int exportador_iniciar(Exportador *exportador, int puerto, Metricas *metricas, const Traza *traza) {
+    struct itimerspec periodo = {{1, 0}, {1, 0}};
+    struct sockaddr_in direccion;
+    int uno = 1;
+
+    memset(exportador, 0, sizeof(*exportador));
+    exportador->metricas = metricas;
+    exportador->traza = traza;
+    for (int i = 0; i < EXPORTADOR_MAX_CLIENTES; i++) {
+        exportador->clientes[i].fd = -1;
+    }
+    exportador->reloj = exportador->parar = exportador->epoll = -1;
+
+    if ((exportador->escucha = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
+        perror("socket exportador");
+        return -1;
+    }
+    setsockopt(exportador->escucha, SOL_SOCKET, SO_REUSEADDR, &uno, sizeof(uno));
+    memset(&direccion, 0, sizeof(direccion));
+    direccion.sin_family = AF_INET;
+    direccion.sin_port = htons((uint16_t)puerto);
+    /* Solo loopback: las métricas no salen de la máquina */
+    direccion.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(exportador->escucha, (struct sockaddr *)&direccion, sizeof(direccion)) == -1 ||
+        listen(exportador->escucha, EXPORTADOR_MAX_CLIENTES) == -1) {
+        perror("bind exportador");
+        close(exportador->escucha);
+        return -1;
+    }
+    if ((exportador->reloj = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1 ||
+        timerfd_settime(exportador->reloj, 0, &periodo, NULL) == -1 ||
+        (exportador->parar = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1 ||
+        (exportador->epoll = epoll_create1(EPOLL_CLOEXEC)) == -1 ||
+        vigilar(exportador, exportador->escucha, ID_ESCUCHA) == -1 ||
+        vigilar(exportador, exportador->reloj, ID_RELOJ) == -1 ||
+        vigilar(exportador, exportador->parar, ID_PARAR) == -1) {
+        perror("epoll exportador");
+        exportador_parar(exportador);
+        return -1;
+    }
+    if (pthread_create(&exportador->hilo, NULL, bucle_exportador, exportador) != 0) {
+        perror("pthread_create exportador");
+        exportador_parar(exportador);
+        return -1;
+    }
+    return 0;
+}
+
+void exportador_bloque(Exportador *exportador, const CabeceraBloque *bloque) {
+    GanadorExportado *ganador;
+    uint64_t ahora;
+    pid_t pid;
+
+    if (!exportador) {
+        return;
+    }
+    ahora = instante_ns();
+    if (exportador->ultimo_bloque_ns) {
+        traza_anotar(&exportador->rondas, ahora - exportador->ultimo_bloque_ns);
+    }
+    exportador->ultimo_bloque_ns = ahora;
+
+    /* Tabla abierta con sondeo lineal y un único escritor: no hace falta CAS */
+    for (int i = 0; i < SONDEO_GANADOR; i++) {
+        ganador = &exportador->ganadores[((uint32_t)bloque->ganador * 2654435761u + (uint32_t)i) & (EXPORTADOR_GANADORES - 1)];
+        pid = atomic_load_explicit(&ganador->pid, memory_order_relaxed);
+        if (pid == bloque->ganador) {
+            atomic_store_explicit(&ganador->bloques, atomic_load_explicit(&ganador->bloques, memory_order_relaxed) + 1,
+                                  memory_order_relaxed);
+            return;
+        }
+        if (pid == 0) {
+            atomic_store_explicit(&ganador->bloques, 1, memory_order_relaxed);
+            atomic_store_explicit(&ganador->pid, bloque->ganador, memory_order_release);
+            return;
+        }
+    }
+    atomic_store_explicit(&exportador->otros_ganadores,
+                          atomic_load_explicit(&exportador->otros_ganadores, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+}
+
+void exportador_parar(Exportador *exportador) {
+    uint64_t uno = 1;
+
+    if (exportador->hilo) {
+        if (write(exportador->parar, &uno, sizeof(uno)) == sizeof(uno)) {
+            pthread_join(exportador->hilo, NULL);
+        }
+        exportador->hilo = 0;
+    }
+    for (int i = 0; i < EXPORTADOR_MAX_CLIENTES; i++) {
+        if (exportador->clientes[i].fd != -1) {
+            close(exportador->clientes[i].fd);
+            free(exportador->clientes[i].respuesta);
+            exportador->clientes[i].fd = -1;
+        }
+    }
+    if (exportador->epoll != -1) {
+        close(exportador->epoll);
+    }
+    if (exportador->parar != -1) {
+        close(exportador->parar);
+    }
+    if (exportador->reloj != -1) {
+        close(exportador->reloj);
+    }
+    close(exportador->escucha);
+}
@@ -0,0 +1,104 @@
+/**
+ * @file exportador.h
+ * @brief Métricas del comprobador en formato de texto de Prometheus por HTTP en loopback.
+ *
+ * Un hilo propio del comprobador atiende en 127.0.0.1:<puerto> un bucle epoll con el socket
+ * de escucha, los clientes, un temporizador de un segundo y un eventfd para pararlo. Cada
+ * GET /metrics se responde con una foto de los contadores que el comprobador ya publica en
+ * su casilla de métricas, de la tabla de bloques por ganador y del histograma de duración
+ * de las rondas. Una conexión que pasa EXPORTADOR_INACTIVIDAD_S segundos sin enviar ni
+ * recibir nada se cierra en el tic del temporizador, para que no ocupe su casilla para
+ * siempre. El hilo solo lee palabras atómicas: nunca toma un semáforo ni hace esperar
+ * a comprobador(), y cada dato que escribe comprobador() tiene un único escritor.
+ *
+ * Con la traza activada exporta además el histograma de cada fase de la ronda, sumado sobre
+ * todos los procesos trazados.
+ */
+
+#ifndef EXPORTADOR_H
+#define EXPORTADOR_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "bloque.h"
+#include "metricas.h"
+#include "traza.h"
+
+#define EXPORTADOR_GANADORES 2048 /**< Casillas de la tabla de ganadores, potencia de dos */
+#define EXPORTADOR_MAX_CLIENTES 16 /**< Conexiones atendidas a la vez */
+#define EXPORTADOR_MAX_PETICION 4096 /**< Bytes leídos de una petición como mucho */
+#define EXPORTADOR_INACTIVIDAD_S 5 /**< Segundos sin leer ni escribir tras los que se cierra una conexión */
+
+/**
+ * @brief Bloques propuestos por un ganador.
+ */
+typedef struct {
+    _Atomic pid_t pid; /**< Ganador, 0 si la casilla está libre */
+    _Atomic uint64_t bloques; /**< Bloques que ha propuesto */
+} GanadorExportado;
+
+/**
+ * @brief Conexión de un cliente: la petición leída o la respuesta pendiente de escribir.
+ */
+typedef struct {
+    int fd; /**< Socket del cliente, -1 si la casilla está libre */
+    char peticion[EXPORTADOR_MAX_PETICION]; /**< Petición leída hasta ahora */
+    size_t leidos; /**< Bytes de la petición */
+    char *respuesta; /**< Respuesta, o NULL mientras se lee la petición */
+    size_t longitud; /**< Bytes de la respuesta */
+    size_t escritos; /**< Bytes de la respuesta ya escritos */
+    uint64_t actividad_ns; /**< Última vez que se leyó o escribió algo, en CLOCK_MONOTONIC */
+} ClienteExportador;
+
+/**
+ * @brief Exportador en marcha.
+ */
+typedef struct {
+    int escucha; /**< Socket de escucha */
+    int reloj; /**< timerfd de un segundo para la tasa de bloques */
+    int parar; /**< eventfd que despierta al hilo para que termine */
+    int epoll; /**< Descriptor epoll */
+    pthread_t hilo; /**< Hilo del bucle */
+    Metricas *metricas; /**< Casilla de métricas del comprobador */
+    const Traza *traza; /**< Traza de las rondas, o NULL */
+    GanadorExportado ganadores[EXPORTADOR_GANADORES]; /**< Bloques por ganador; solo escribe comprobador() */
+    _Atomic uint64_t otros_ganadores; /**< Bloques de ganadores que no caben en la tabla */
+    HistogramaTraza rondas; /**< Tiempo entre bloques consecutivos; solo escribe comprobador() */
+    uint64_t ultimo_bloque_ns; /**< Llegada del bloque anterior; solo la usa comprobador() */
+    uint64_t validos_previos; /**< Bloques válidos en el último tic; solo la usa el hilo */
+    double bloques_por_segundo; /**< Bloques válidos por segundo en el último tic; solo la usa el hilo */
+    ClienteExportador clientes[EXPORTADOR_MAX_CLIENTES]; /**< Conexiones; solo las usa el hilo */
+} Exportador;
+
+/**
+ * @brief Abre el puerto en loopback y arranca el hilo del exportador.
+ *
+ * @param exportador Exportador a rellenar; debe seguir vivo hasta exportador_parar().
+ * @param puerto Puerto TCP en 127.0.0.1.
+ * @param metricas Casilla de métricas del comprobador.
+ * @param traza Traza de las rondas, o NULL.
+ * @return 0 si todo va bien, -1 en caso de error.
+ */
+int exportador_iniciar(Exportador *exportador, int puerto, Metricas *metricas, const Traza *traza);
+
+/**
+ * @brief Cuenta un bloque recibido por el comprobador: su ganador y la duración de la ronda.
+ *
+ * Solo la llama comprobador(); no toma cerrojos ni espera al hilo del exportador.
+ *
+ * @param exportador Exportador en marcha, o NULL.
+ * @param bloque Bloque recibido.
+ */
+void exportador_bloque(Exportador *exportador, const CabeceraBloque *bloque);
+
+/**
+ * @brief Para el hilo del exportador y cierra sus descriptores.
+ *
+ * @param exportador Exportador en marcha.
+ */
+void exportador_parar(Exportador *exportador);
+
+#endif
@@ -0,0 +1,26 @@
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "futex.h"
+
+int futex_esperar(_Atomic uint32_t *palabra, uint32_t valor, long espera_ms) {
+    struct timespec espera;
+
+    if (espera_ms < 0) {
+        return (int)syscall(SYS_futex, (uint32_t *)palabra, FUTEX_WAIT, valor, NULL, NULL, 0);
+    }
+    espera.tv_sec = espera_ms / 1000;
+    espera.tv_nsec = (espera_ms % 1000) * 1000000L;
+    return (int)syscall(SYS_futex, (uint32_t *)palabra, FUTEX_WAIT, valor, &espera, NULL, 0);
+}
+
+int futex_despertar_todos(_Atomic uint32_t *palabra) {
+    return (int)syscall(SYS_futex, (uint32_t *)palabra, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+int futex_despertar_uno(_Atomic uint32_t *palabra) {
+    return (int)syscall(SYS_futex, (uint32_t *)palabra, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
@@ -0,0 +1,46 @@
+/**
+ * @file futex.h
+ * @brief Espera y despertar sobre palabras de 32 bits en memoria compartida entre procesos.
+ *
+ * Envoltorios de la llamada futex(2) en su variante compartida (sin FUTEX_PRIVATE_FLAG),
+ * válida para palabras que están en un segmento proyectado por varios procesos. Un único
+ * futex_despertar_todos() despierta a todos los procesos que esperan en la palabra.
+ */
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * @brief Duerme mientras la palabra valga `valor`, como mucho `espera_ms` milisegundos.
+ *
+ * Si la palabra ya no vale `valor` vuelve inmediatamente. También puede volver por una
+ * señal o sin causa aparente, así que siempre debe llamarse dentro de un bucle que
+ * compruebe la condición esperada.
+ *
+ * @param palabra Palabra de 32 bits, alineada a 4 bytes.
+ * @param valor Valor observado antes de dormir.
+ * @param espera_ms Tiempo máximo de espera en milisegundos, o -1 para no limitarlo.
+ * @return 0 si se ha despertado, -1 con errno a EAGAIN, ETIMEDOUT o EINTR en otro caso.
+ */
+int futex_esperar(_Atomic uint32_t *palabra, uint32_t valor, long espera_ms);
+
+/**
+ * @brief Despierta a todos los procesos e hilos que esperan en la palabra.
+ *
+ * @param palabra Palabra de 32 bits, alineada a 4 bytes.
+ * @return Número de esperas despertadas, o -1 en caso de error.
+ */
+int futex_despertar_todos(_Atomic uint32_t *palabra);
+
+/**
+ * @brief Despierta como mucho a uno de los que esperan en la palabra.
+ *
+ * @param palabra Palabra de 32 bits, alineada a 4 bytes.
+ * @return Número de esperas despertadas, o -1 en caso de error.
+ */
+int futex_despertar_uno(_Atomic uint32_t *palabra);
+
+#endif
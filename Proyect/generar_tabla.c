@@ -0,0 +1,44 @@
+/**
+ * @file generar_tabla.c
+ * @brief Herramienta que genera la tabla precalculada objetivo -> nonce.
+ *
+ * Uso: ./generar_tabla <fichero>
+ *
+ * El fichero generado se usa con la opción --tabla del minero y del monitor.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pow.h"
+#include "tabla_pow.h"
+
+int main(int argc, char const *argv[]) {
+    struct timespec antes, despues;
+    TablaPow tabla;
+
+    if (argc != 2) {
+        printf("Uso: %s <fichero>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &antes);
+    if (tabla_pow_generar(argv[1]) != 0) {
+        fprintf(stderr, "Error generando la tabla %s\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &despues);
+
+    /* Se vuelve a abrir para comprobar lo que ha quedado en disco */
+    if (tabla_pow_abrir(&tabla, argv[1]) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    tabla_pow_cerrar(&tabla);
+
+    printf("[%d] Table %s: %d entries, generated in %.1f ms (kernel %s)\n", getpid(), argv[1],
+           POW_LIMIT, (despues.tv_sec - antes.tv_sec) * 1e3 + (despues.tv_nsec - antes.tv_nsec) / 1e6,
+           pow_batch_isa());
+    exit(EXIT_SUCCESS);
+}
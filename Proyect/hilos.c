@@ -0,0 +1,377 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hilos.h"
+#include "pow.h"
+
+#define RANGO(siguiente, fin) (((uint64_t)(fin) << 32) | (uint32_t)(siguiente))
+#define RANGO_SIGUIENTE(rango) ((long int)((rango) & 0xffffffffu))
+#define RANGO_FIN(rango) ((long int)((rango) >> 32))
+
+static long long diferencia_ns(const struct timespec *desde, const struct timespec *hasta) {
+    return (hasta->tv_sec - desde->tv_sec) * 1000000000LL + (hasta->tv_nsec - desde->tv_nsec);
+}
+
+/**
+ * @brief Saca el siguiente tramo del principio de la cola propia.
+ *
+ * @param thread_data Datos del hilo.
+ * @param inicio Primer nonce del tramo.
+ * @param fin Fin del tramo (no incluido).
+ * @return true si había nonces pendientes, false si la cola está vacía.
+ */
+static bool tomar_tramo(ThreadData *thread_data, long int *inicio, long int *fin) {
+    uint64_t rango, nuevo;
+    long int siguiente, limite, tope;
+
+    rango = atomic_load_explicit(&thread_data->cola.rango, memory_order_relaxed);
+    do {
+        siguiente = RANGO_SIGUIENTE(rango);
+        limite = RANGO_FIN(rango);
+        if (siguiente >= limite) {
+            return false;
+        }
+        tope = (limite - siguiente > thread_data->tramo) ? siguiente + thread_data->tramo : limite;
+        nuevo = RANGO(tope, limite);
+    } while (!atomic_compare_exchange_weak(&thread_data->cola.rango, &rango, nuevo));
+
+    *inicio = siguiente;
+    *fin = tope;
+    return true;
+}
+
+/**
+ * @brief Roba la mitad final de la cola con más nonces pendientes y la pasa a la cola propia.
+ *
+ * Solo se roba a colas con al menos 2 * TRAMO_MIN nonces; lo que queda por debajo lo
+ * termina su dueño.
+ *
+ * @param thread_data Datos del hilo ladrón, con la cola vacía.
+ * @return true si ha conseguido robar, false si no queda nada que robar.
+ */
+static bool robar_tramo(ThreadData *thread_data) {
+    PoolMineros *pool = thread_data->pool;
+    ThreadData *victima;
+    uint64_t rango;
+    long int pendientes, mayor, mitad, limite;
+    int j, elegida;
+
+    while (1) {
+        elegida = -1;
+        mayor = 2 * TRAMO_MIN - 1;
+        for (j = 0; j < pool->n_hilos; j++) {
+            if (j == thread_data->id) {
+                continue;
+            }
+            rango = atomic_load_explicit(&pool->datos[j].cola.rango, memory_order_relaxed);
+            pendientes = RANGO_FIN(rango) - RANGO_SIGUIENTE(rango);
+            if (pendientes > mayor) {
+                mayor = pendientes;
+                elegida = j;
+            }
+        }
+        if (elegida == -1) {
+            return false;
+        }
+
+        victima = &pool->datos[elegida];
+        rango = atomic_load_explicit(&victima->cola.rango, memory_order_relaxed);
+        pendientes = RANGO_FIN(rango) - RANGO_SIGUIENTE(rango);
+        if (pendientes < 2 * TRAMO_MIN) {
+            continue;
+        }
+        mitad = pendientes / 2;
+        limite = RANGO_FIN(rango);
+        if (atomic_compare_exchange_strong(&victima->cola.rango, &rango,
+                                           RANGO(RANGO_SIGUIENTE(rango), limite - mitad))) {
+            atomic_store(&thread_data->cola.rango, RANGO(limite - mitad, limite));
+            atomic_fetch_add_explicit(&pool->robos, 1, memory_order_relaxed);
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief Ajusta el tamaño de tramo para que dure aproximadamente DURACION_TRAMO_NS.
+ *
+ * @param thread_data Datos del hilo.
+ * @param nonces Nonces del último tramo.
+ * @param duracion_ns Tiempo que tardó el último tramo.
+ */
+static void ajustar_tramo(ThreadData *thread_data, long int nonces, long long duracion_ns) {
+    long int ideal;
+
+    if (duracion_ns <= 0) {
+        ideal = TRAMO_MAX;
+    } else {
+        ideal = (long int)((double)nonces * DURACION_TRAMO_NS / duracion_ns);
+    }
+    /* Media móvil para que un tramo aislado no haga oscilar el tamaño */
+    thread_data->tramo = (3 * thread_data->tramo + ideal) / 4;
+    if (thread_data->tramo < TRAMO_MIN) {
+        thread_data->tramo = TRAMO_MIN;
+    }
+    if (thread_data->tramo > TRAMO_MAX) {
+        thread_data->tramo = TRAMO_MAX;
+    }
+}
+
+/**
+ * @brief Suma los nonces de un tramo al contador de hashes del hilo, si lo tiene.
+ */
+static inline void contar_hashes(ThreadData *thread_data, long int nonces) {
+    if (thread_data->hashes) {
+        atomic_store_explicit(thread_data->hashes,
+                              atomic_load_explicit(thread_data->hashes, memory_order_relaxed) + (uint64_t)nonces,
+                              memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Función que ejecuta un hilo minero durante una ronda.
+ *
+ * Cada hilo consume por tramos los nonces de su cola con pow_search_batch() y, cuando
+ * se vacía, reclama un tramo de la fuente externa si la hay o roba trabajo a los demás. Si encuentra una coincidencia con el valor
+ * objetivo, actualiza la variable compartida de solución y termina la ejecución. Las
+ * condiciones de parada se comprueban una vez por tramo.
+ *
+ * @param data Puntero a una estructura ThreadData con los datos del hilo.
+ * @return NULL siempre.
+ */
+void *miner_thread(void *data) {
+    long int inicio, fin, nonce;
+    struct timespec antes, despues;
+    ThreadData *thread_data;
+    PoolMineros *pool;
+    int cero = 0;
+
+    thread_data = (ThreadData *)data;
+
+    while (1) {
+        if (!tomar_tramo(thread_data, &inicio, &fin)) {
+            pool = thread_data->pool;
+            if (pool->reclamar && pool->reclamar(pool->ctx_reclamar, thread_data->tramo, &inicio, &fin)) {
+                /* En la cola propia, para que los demás hilos puedan robar parte */
+                atomic_store(&thread_data->cola.rango, RANGO(inicio, fin));
+                continue;
+            }
+            if (robar_tramo(thread_data)) {
+                continue;
+            }
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &antes);
+        nonce = pow_search_batch(inicio, fin, thread_data->target);
+        if (nonce != -1) {
+            contar_hashes(thread_data, nonce - inicio + 1);
+            atomic_store(thread_data->solution, nonce);
+            atomic_store(thread_data->found, 1);
+            return NULL;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &despues);
+        contar_hashes(thread_data, fin - inicio);
+        ajustar_tramo(thread_data, fin - inicio, diferencia_ns(&antes, &despues));
+
+        if (atomic_load(thread_data->found) == 1)
+            return NULL;
+
+        if (thread_data->parar()) {
+            if (atomic_compare_exchange_strong(thread_data->found, &cero, -1)) {
+                atomic_store(thread_data->solution, -1);
+            }
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Bucle de un hilo del pool: espera una ronda, mina su rango y vuelve a aparcarse.
+ *
+ * @param data Puntero a los ThreadData del hilo.
+ * @return NULL siempre.
+ */
+static void *trabajador_pool(void *data) {
+    ThreadData *thread_data = (ThreadData *)data;
+    PoolMineros *pool = thread_data->pool;
+
+    /* Hasta que estén todos creados no se sabe si el pool sale adelante */
+    pthread_mutex_lock(&pool->arranque);
+    pthread_mutex_unlock(&pool->arranque);
+    if (pool->fallido) {
+        return NULL;
+    }
+    while (1) {
+        pthread_barrier_wait(&pool->inicio);
+        if (pool->terminar) {
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &thread_data->arranque);
+        miner_thread(thread_data);
+        pthread_barrier_wait(&pool->fin);
+    }
+    return NULL;
+}
+
+int pool_crear(PoolMineros *pool, int n_hilos, bool (*parar)(void)) {
+    sigset_t bloqueadas, anteriores;
+    long int range;
+    int j, error;
+
+    if (n_hilos < 1 || n_hilos > MAX_THREADS) {
+        fprintf(stderr, "Error: Number of threads exceeded\n");
+        return -1;
+    }
+
+    pool->n_hilos = n_hilos;
+    pool->terminar = false;
+    pool->fallido = false;
+    pool->reclamar = NULL;
+    pool->ctx_reclamar = NULL;
+    pool->solucion = -1;
+    pool->encontrado = 0;
+    pool->robos = 0;
+    pool->rondas = 0;
+    pool->latencia_total_ns = 0;
+    pool->latencia_max_ns = 0;
+
+    pool->hilos = (pthread_t *)malloc(sizeof(pthread_t) * n_hilos);
+    if (!pool->hilos) {
+        perror("malloc() threads failure\n");
+        return -1;
+    }
+    /* Cada ThreadData empieza con su cola en una línea de caché propia */
+    pool->datos = (ThreadData *)aligned_alloc(_Alignof(ThreadData), sizeof(ThreadData) * n_hilos);
+    if (!pool->datos) {
+        perror("malloc() thread_data failure\n");
+        free(pool->hilos);
+        return -1;
+    }
+
+    /* Los hilos del pool más el hilo principal */
+    if (pthread_barrier_init(&pool->inicio, NULL, n_hilos + 1) != 0 ||
+        pthread_barrier_init(&pool->fin, NULL, n_hilos + 1) != 0) {
+        perror("pthread_barrier_init");
+        free(pool->datos);
+        free(pool->hilos);
+        return -1;
+    }
+
+    /* Las señales del minero las atiende solo el hilo principal */
+    sigemptyset(&bloqueadas);
+    sigaddset(&bloqueadas, SIGINT);
+    sigaddset(&bloqueadas, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &bloqueadas, &anteriores);
+
+    /* Las barreras cuentan con todos los hilos: si falta uno, los demás no deben llegar a ellas */
+    pthread_mutex_init(&pool->arranque, NULL);
+    pthread_mutex_lock(&pool->arranque);
+    range = POW_LIMIT / n_hilos;
+    for (j = 0; j < n_hilos; j++) {
+        pool->datos[j].start = j * range;
+        pool->datos[j].end = (j == n_hilos - 1) ? POW_LIMIT : (j + 1) * range;
+        pool->datos[j].target = -1;
+        pool->datos[j].tramo = TRAMO_INICIAL;
+        pool->datos[j].id = j;
+        atomic_init(&pool->datos[j].cola.rango, RANGO(0, 0));
+        pool->datos[j].solution = &pool->solucion;
+        pool->datos[j].found = &pool->encontrado;
+        pool->datos[j].parar = parar;
+        pool->datos[j].pool = pool;
+        pool->datos[j].hashes = NULL;
+
+        if ((error = pthread_create(&pool->hilos[j], NULL, trabajador_pool, &pool->datos[j])) != 0) {
+            /* pthread_create devuelve el error en lugar de dejarlo en errno */
+            fprintf(stderr, "pthread_create: %s\n", strerror(error));
+            pool->fallido = true;
+            pthread_mutex_unlock(&pool->arranque);
+            while (--j >= 0) {
+                pthread_join(pool->hilos[j], NULL);
+            }
+            pthread_mutex_destroy(&pool->arranque);
+            pthread_barrier_destroy(&pool->inicio);
+            pthread_barrier_destroy(&pool->fin);
+            free(pool->datos);
+            free(pool->hilos);
+            pthread_sigmask(SIG_SETMASK, &anteriores, NULL);
+            return -1;
+        }
+    }
+
+    pthread_mutex_unlock(&pool->arranque);
+    pthread_sigmask(SIG_SETMASK, &anteriores, NULL);
+    return 0;
+}
+
+int pool_minar(PoolMineros *pool, long int objetivo, ReclamarTramo reclamar, void *ctx, long int *solucion) {
+    long long latencia, peor = 0;
+    int j;
+
+    pool->encontrado = 0;
+    pool->solucion = -1;
+    pool->reclamar = reclamar;
+    pool->ctx_reclamar = ctx;
+    for (j = 0; j < pool->n_hilos; j++) {
+        pool->datos[j].target = objetivo;
+        if (reclamar) {
+            atomic_store_explicit(&pool->datos[j].cola.rango, RANGO(0, 0), memory_order_relaxed);
+        } else {
+            atomic_store_explicit(&pool->datos[j].cola.rango,
+                                  RANGO(pool->datos[j].start, pool->datos[j].end), memory_order_relaxed);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &pool->publicacion);
+    pthread_barrier_wait(&pool->inicio);
+    pthread_barrier_wait(&pool->fin);
+
+    /* La ronda arranca cuando el último hilo empieza a minar */
+    for (j = 0; j < pool->n_hilos; j++) {
+        latencia = diferencia_ns(&pool->publicacion, &pool->datos[j].arranque);
+        if (latencia > peor) {
+            peor = latencia;
+        }
+    }
+    pool->rondas++;
+    pool->latencia_total_ns += peor;
+    if (peor > pool->latencia_max_ns) {
+        pool->latencia_max_ns = peor;
+    }
+
+    *solucion = pool->solucion;
+    return pool->encontrado;
+}
+
+void pool_contar_hashes(PoolMineros *pool, int hilo, _Atomic uint64_t *hashes) {
+    pool->datos[hilo].hashes = hashes;
+}
+
+void pool_informe(const PoolMineros *pool) {
+    if (pool->rondas == 0) {
+        return;
+    }
+    printf("[%d] Round start latency: mean %.1f us, max %.1f us (%ld rounds, %d threads, %ld steals)\n",
+           getpid(), pool->latencia_total_ns / 1000.0 / pool->rondas,
+           pool->latencia_max_ns / 1000.0, pool->rondas, pool->n_hilos,
+           atomic_load(&pool->robos));
+    fflush(stdout);
+}
+
+void pool_destruir(PoolMineros *pool) {
+    int j;
+
+    pool->terminar = true;
+    pthread_barrier_wait(&pool->inicio);
+    for (j = 0; j < pool->n_hilos; j++) {
+        pthread_join(pool->hilos[j], NULL);
+    }
+    pthread_barrier_destroy(&pool->inicio);
+    pthread_barrier_destroy(&pool->fin);
+    pthread_mutex_destroy(&pool->arranque);
+    free(pool->datos);
+    free(pool->hilos);
+}
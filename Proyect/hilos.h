@@ -0,0 +1,170 @@
+/**
+ * @file hilos.h
+ * @brief Hilos mineros y pool persistente que los reutiliza entre rondas.
+ *
+ * Los hilos del minero se crean una sola vez al arrancar el proceso y quedan aparcados
+ * en una barrera entre rondas. Cada ronda solo publica el nuevo objetivo y libera la
+ * barrera, sin reservar memoria ni crear hilos.
+ *
+ * Cada hilo empieza la ronda con una porción del espacio de nonces en su propia cola y
+ * la consume por tramos desde el principio. Cuando se queda sin trabajo roba la mitad
+ * final de la cola con más nonces pendientes, de modo que un hilo expulsado de la CPU
+ * no retrasa el final de la ronda. El tamaño del tramo se ajusta a la velocidad medida.
+ *
+ * Opcionalmente las colas empiezan vacías y los tramos se reclaman de una fuente
+ * externa, como el cursor que comparten los mineros en modo cooperativo.
+ */
+
+#ifndef HILOS_H
+#define HILOS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define MAX_THREADS 100 /**< Número máximo de hilos permitidos en la minería */
+#define TRAMO_INICIAL 4096 /**< Nonces del primer tramo de cada hilo, antes de medir su velocidad */
+#define TRAMO_MIN 1024 /**< Tamaño mínimo de tramo; no se roban colas con menos del doble */
+#define TRAMO_MAX (1L << 20) /**< Tamaño máximo de tramo */
+#define DURACION_TRAMO_NS 50000 /**< Duración buscada de un tramo; acota la latencia de cancelación */
+
+struct PoolMineros;
+
+/**
+ * @brief Reclama un tramo de nonces de una fuente externa al pool.
+ *
+ * @param ctx Contexto de la fuente.
+ * @param tramo Tamaño de tramo deseado.
+ * @param inicio Primer nonce del tramo reclamado.
+ * @param fin Fin del tramo reclamado (no incluido).
+ * @return true si se ha obtenido un tramo, false si la fuente está agotada.
+ */
+typedef bool (*ReclamarTramo)(void *ctx, long int tramo, long int *inicio, long int *fin);
+
+/**
+ * @brief Cola de nonces pendientes de un hilo: el rango [siguiente, fin).
+ *
+ * Ambos extremos caben en 32 bits (POW_LIMIT < 2^32) y se guardan juntos en una palabra
+ * atómica. El dueño consume tramos desde `siguiente` y los ladrones recortan `fin`, los
+ * dos con compare-and-swap, sin cerrojos. Ocupa su propia línea de caché.
+ */
+typedef struct
+{
+    _Alignas(64) _Atomic uint64_t rango; /**< fin en los 32 bits altos, siguiente en los bajos */
+} ColaNonces;
+
+/**
+ * @struct ThreadData
+ * @brief Estructura que almacena los datos necesarios para cada hilo minero.
+ *
+ * Esta estructura contiene la información de los rangos de búsqueda, el objetivo a encontrar
+ * y punteros compartidos para comunicar el resultado entre los hilos.
+ */
+typedef struct
+{
+    ColaNonces cola;   /**< Nonces pendientes del hilo en la ronda actual */
+    long int start;    /**< Inicio del rango inicial de búsqueda */
+    long int end;      /**< Fin del rango inicial de búsqueda */
+    long int target;   /**< Valor objetivo a encontrar */
+    long int tramo;    /**< Tamaño de tramo actual, ajustado a la velocidad del hilo */
+    int id;            /**< Índice del hilo dentro del pool */
+    _Atomic long int *solution; /**< Puntero para almacenar la solución encontrada */
+    _Atomic int *found;        /**< Indicador de si se encontró la solución */
+    bool (*parar)(void); /**< Devuelve true si la ronda debe abandonarse */
+    struct PoolMineros *pool; /**< Pool al que pertenece el hilo */
+    struct timespec arranque; /**< Instante en que el hilo empezó la ronda actual */
+    _Atomic uint64_t *hashes; /**< Contador de hashes calculados que publica el hilo, o NULL */
+} ThreadData;
+
+/**
+ * @struct PoolMineros
+ * @brief Hilos mineros de larga duración aparcados en una barrera entre rondas.
+ */
+typedef struct PoolMineros
+{
+    int n_hilos;                 /**< Número de hilos del pool */
+    pthread_t *hilos;            /**< Identificadores de los hilos */
+    ThreadData *datos;           /**< Datos de cada hilo, reservados una sola vez */
+    pthread_barrier_t inicio;    /**< Barrera que libera a los hilos al publicar una ronda */
+    pthread_barrier_t fin;       /**< Barrera en la que el minero espera el final de la ronda */
+    pthread_mutex_t arranque;    /**< Retiene a los hilos hasta que pool_crear los ha creado todos */
+    bool terminar;               /**< Indica a los hilos que deben salir */
+    bool fallido;                /**< pool_crear no pudo crear todos los hilos */
+    ReclamarTramo reclamar;      /**< Fuente externa de tramos de la ronda, o NULL */
+    void *ctx_reclamar;          /**< Contexto de la fuente externa */
+    _Atomic long int solucion;   /**< Solución de la ronda en curso */
+    _Atomic int encontrado;      /**< 1 si se encontró, -1 si se abandonó, 0 si no */
+    _Atomic long int robos;      /**< Tramos robados entre hilos desde la creación del pool */
+    struct timespec publicacion; /**< Instante en que se publicó la ronda en curso */
+    long int rondas;             /**< Rondas ejecutadas */
+    long long latencia_total_ns; /**< Suma de las latencias de arranque de ronda */
+    long long latencia_max_ns;   /**< Peor latencia de arranque de ronda */
+} PoolMineros;
+
+/**
+ * @brief Función que ejecuta un hilo minero durante una ronda.
+ *
+ * @param data Puntero a una estructura ThreadData con los datos del hilo.
+ * @return NULL siempre.
+ */
+void *miner_thread(void *data);
+
+/**
+ * @brief Crea el pool y arranca sus hilos, que quedan esperando la primera ronda.
+ *
+ * Los hilos se crean con SIGINT y SIGALRM bloqueadas para que las señales las atienda
+ * siempre el hilo principal. Si no se puede crear alguno, los ya creados se recogen antes
+ * de volver, sin terminar el proceso.
+ *
+ * @param pool Pool a inicializar.
+ * @param n_hilos Número de hilos, entre 1 y MAX_THREADS.
+ * @param parar Función consultada entre tramos para abandonar la ronda.
+ * @return 0 si se ha creado correctamente, -1 en caso contrario.
+ */
+int pool_crear(PoolMineros *pool, int n_hilos, bool (*parar)(void));
+
+/**
+ * @brief Ejecuta una ronda de minado con los hilos del pool.
+ *
+ * Publica el objetivo, libera a los hilos y espera a que todos terminen. Sin fuente
+ * externa cada hilo empieza con una parte fija de [0, POW_LIMIT); con ella las colas
+ * empiezan vacías y los hilos reclaman tramos hasta agotarla.
+ *
+ * @param pool Pool de hilos.
+ * @param objetivo Valor objetivo de la ronda.
+ * @param reclamar Fuente externa de tramos, o NULL para repartir todo el rango.
+ * @param ctx Contexto de la fuente externa.
+ * @param solucion Solución encontrada, o -1.
+ * @return 1 si se encontró la solución, -1 si se abandonó la ronda, 0 si no hay solución.
+ */
+int pool_minar(PoolMineros *pool, long int objetivo, ReclamarTramo reclamar, void *ctx, long int *solucion);
+
+/**
+ * @brief Entrega a un hilo del pool el contador en el que publicar sus hashes.
+ *
+ * El hilo es el único que escribe en el contador y lo actualiza una vez por tramo, sin
+ * instrucciones atómicas de lectura-modificación-escritura. Debe llamarse entre rondas.
+ *
+ * @param pool Pool de hilos.
+ * @param hilo Índice del hilo.
+ * @param hashes Contador del hilo, en su propia línea de caché, o NULL para no contar.
+ */
+void pool_contar_hashes(PoolMineros *pool, int hilo, _Atomic uint64_t *hashes);
+
+/**
+ * @brief Imprime la latencia media y máxima de arranque de ronda y los robos del pool.
+ *
+ * @param pool Pool de hilos.
+ */
+void pool_informe(const PoolMineros *pool);
+
+/**
+ * @brief Detiene los hilos del pool y libera sus recursos.
+ *
+ * @param pool Pool de hilos.
+ */
+void pool_destruir(PoolMineros *pool);
+
+#endif
@@ -0,0 +1,122 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "instantanea.h"
+
+/**
+ * @brief Suma de comprobación FNV-1a de 64 bits de una copia, sin la secuencia ni la suma.
+ *
+ * Solo entran las casillas guardadas, así que el coste crece con las casillas usadas.
+ */
+static uint64_t suma_copia(const CopiaRed *copia) {
+    const unsigned char *p = (const unsigned char *)&copia->bloque_actual;
+    const unsigned char *fin = (const unsigned char *)&copia->carteras[copia->n_carteras];
+    uint64_t suma = 0xcbf29ce484222325ULL;
+
+    for (; p < fin; p++) {
+        suma ^= *p;
+        suma *= 0x100000001b3ULL;
+    }
+    return suma;
+}
+
+/**
+ * @brief Copia válida más reciente, o NULL si no hay ninguna.
+ */
+static const CopiaRed *copia_valida(const FicheroInstantanea *fichero) {
+    const CopiaRed *mejor = NULL;
+    uint64_t secuencia, mayor = 0;
+
+    for (int i = 0; i < 2; i++) {
+        const CopiaRed *copia = &fichero->copias[i];
+
+        secuencia = atomic_load_explicit(&copia->secuencia, memory_order_acquire);
+        if (secuencia > mayor && copia->n_carteras <= BLOQUE_MAX_CARTERAS && copia->suma == suma_copia(copia)) {
+            mayor = secuencia;
+            mejor = copia;
+        }
+    }
+    return mejor;
+}
+
+int instantanea_abrir(Instantanea *instantanea, const char *ruta) {
+    struct stat info;
+    int fd;
+
+    if ((fd = open(ruta, O_RDWR | O_CREAT, 0644)) == -1) {
+        perror("open instantanea");
+        return -1;
+    }
+    if (fstat(fd, &info) == -1) {
+        perror("fstat instantanea");
+        close(fd);
+        return -1;
+    }
+    /* Un fichero nuevo se crea a ceros: las dos copias quedan vacías */
+    if (info.st_size == 0 && ftruncate(fd, sizeof(FicheroInstantanea)) == -1) {
+        perror("ftruncate instantanea");
+        close(fd);
+        return -1;
+    }
+    if (info.st_size != 0 && (size_t)info.st_size != sizeof(FicheroInstantanea)) {
+        fprintf(stderr, "%s no es una instantánea de la versión %d\n", ruta, INSTANTANEA_VERSION);
+        close(fd);
+        return -1;
+    }
+    instantanea->fichero = mmap(NULL, sizeof(FicheroInstantanea), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (instantanea->fichero == MAP_FAILED) {
+        perror("mmap instantanea");
+        return -1;
+    }
+    if (info.st_size == 0) {
+        memcpy(instantanea->fichero->magico, INSTANTANEA_MAGICO, sizeof(INSTANTANEA_MAGICO));
+        instantanea->fichero->version = INSTANTANEA_VERSION;
+    } else if (memcmp(instantanea->fichero->magico, INSTANTANEA_MAGICO, sizeof(INSTANTANEA_MAGICO)) != 0 ||
+               instantanea->fichero->version != INSTANTANEA_VERSION) {
+        fprintf(stderr, "%s no es una instantánea de la versión %d\n", ruta, INSTANTANEA_VERSION);
+        munmap(instantanea->fichero, sizeof(FicheroInstantanea));
+        return -1;
+    }
+    return 0;
+}
+
+void instantanea_guardar(Instantanea *instantanea, const CabeceraBloque *actual, const CabeceraBloque *anterior,
+                         const Monedas *carteras, int n) {
+    FicheroInstantanea *fichero = instantanea->fichero;
+    uint64_t s0 = atomic_load_explicit(&fichero->copias[0].secuencia, memory_order_relaxed);
+    uint64_t s1 = atomic_load_explicit(&fichero->copias[1].secuencia, memory_order_relaxed);
+    CopiaRed *copia = &fichero->copias[s0 <= s1 ? 0 : 1];
+
+    /* Mientras se escribe, la copia no vale: queda la otra */
+    atomic_store_explicit(&copia->secuencia, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    copia->bloque_actual = *actual;
+    copia->bloque_anterior = *anterior;
+    copia->n_carteras = (uint32_t)n;
+    memcpy(copia->carteras, carteras, (size_t)n * sizeof(Monedas));
+    copia->suma = suma_copia(copia);
+    atomic_store_explicit(&copia->secuencia, (s0 > s1 ? s0 : s1) + 1, memory_order_release);
+}
+
+int instantanea_restaurar(const Instantanea *instantanea, CabeceraBloque *actual, CabeceraBloque *anterior,
+                          Monedas *carteras, int *n) {
+    const CopiaRed *copia = copia_valida(instantanea->fichero);
+
+    if (!copia) {
+        return -1;
+    }
+    *actual = copia->bloque_actual;
+    *anterior = copia->bloque_anterior;
+    *n = (int)copia->n_carteras;
+    memcpy(carteras, copia->carteras, copia->n_carteras * sizeof(Monedas));
+    return 0;
+}
+
+void instantanea_cerrar(Instantanea *instantanea) {
+    munmap(instantanea->fichero, sizeof(FicheroInstantanea));
+}
@@ -0,0 +1,102 @@
+/**
+ * @file instantanea.h
+ * @brief Instantánea del estado de la red para volver a arrancarla desde el último bloque.
+ *
+ * El ganador de cada ronda copia en un fichero proyectado en memoria el bloque actual, el
+ * anterior y la cartera de cada casilla del registro, libres incluidas, hasta la última
+ * que tiene monedas. Es una copia en memoria, sin llamadas al sistema: el fichero
+ * sobrevive a la caída de cualquier proceso y el núcleo lo vuelca a disco por su cuenta.
+ *
+ * El fichero guarda dos copias y cada escritura va a la más antigua, que se invalida antes
+ * de empezar y se marca con una secuencia nueva al terminar. Una suma de comprobación
+ * descarta además la copia que quede a medias en disco tras un corte de luz, así que
+ * siempre queda al menos una completa.
+ *
+ * Un primer minero arrancado con la misma instantánea sigue desde el último bloque y cada
+ * casilla del registro conserva las monedas de la cartera que la ocupaba; el minero que la
+ * toma las hereda.
+ */
+
+#ifndef INSTANTANEA_H
+#define INSTANTANEA_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "bloque.h"
+
+#define INSTANTANEA_MAGICO "INSTANT" /**< Identificador al principio del fichero */
+#define INSTANTANEA_VERSION 2 /**< Versión del formato del fichero */
+
+/**
+ * @brief Una de las dos copias del estado de la red.
+ */
+typedef struct {
+    _Alignas(64) _Atomic uint64_t secuencia; /**< Orden de la copia; 0 si está vacía o a medias */
+    uint64_t suma; /**< Suma de comprobación de lo que sigue */
+    CabeceraBloque bloque_actual; /**< Bloque que se está minando */
+    CabeceraBloque bloque_anterior; /**< Último bloque enviado al comprobador */
+    uint32_t n_carteras; /**< Casillas guardadas */
+    Monedas carteras[BLOQUE_MAX_CARTERAS]; /**< Cartera de cada casilla; la i-ésima es la de la casilla i */
+} CopiaRed;
+
+/**
+ * @brief Contenido del fichero de instantánea.
+ */
+typedef struct {
+    char magico[8]; /**< INSTANTANEA_MAGICO, con terminador */
+    uint32_t version; /**< INSTANTANEA_VERSION */
+    CopiaRed copias[2]; /**< Las dos copias; vale la de mayor secuencia con la suma correcta */
+} FicheroInstantanea;
+
+/**
+ * @brief Instantánea abierta por un minero.
+ */
+typedef struct {
+    FicheroInstantanea *fichero; /**< Proyección del fichero */
+} Instantanea;
+
+/**
+ * @brief Abre o crea el fichero de instantánea y lo proyecta.
+ *
+ * @param instantanea Instantánea a rellenar.
+ * @param ruta Ruta del fichero.
+ * @return 0 si todo va bien, -1 en caso de error.
+ */
+int instantanea_abrir(Instantanea *instantanea, const char *ruta);
+
+/**
+ * @brief Guarda el estado de la red en la copia más antigua.
+ *
+ * Solo la llama el ganador, con el mutex del segmento tomado.
+ *
+ * @param instantanea Instantánea abierta.
+ * @param actual Bloque que se empieza a minar.
+ * @param anterior Último bloque enviado.
+ * @param carteras Cartera de cada casilla, empezando por la 0; las libres también.
+ * @param n Número de casillas.
+ */
+void instantanea_guardar(Instantanea *instantanea, const CabeceraBloque *actual, const CabeceraBloque *anterior,
+                         const Monedas *carteras, int n);
+
+/**
+ * @brief Lee la copia válida más reciente.
+ *
+ * @param instantanea Instantánea abierta.
+ * @param actual Bloque que se estaba minando.
+ * @param anterior Último bloque enviado.
+ * @param carteras Destino de la cartera de cada casilla, con sitio para BLOQUE_MAX_CARTERAS.
+ * @param n Número de casillas leídas.
+ * @return 0 si hay una copia válida, -1 si no hay ninguna.
+ */
+int instantanea_restaurar(const Instantanea *instantanea, CabeceraBloque *actual, CabeceraBloque *anterior,
+                          Monedas *carteras, int *n);
+
+/**
+ * @brief Deshace la proyección del fichero.
+ *
+ * @param instantanea Instantánea abierta.
+ */
+void instantanea_cerrar(Instantanea *instantanea);
+
+#endif
@@ -0,0 +1,406 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libro.h"
+
+#define INDICE_PRIMERA (sizeof(CabeceraIndice) / sizeof(uint64_t)) /* Entrada del id 0 en el índice */
+#define MAX_RUTA 4096 /* Longitud máxima de la ruta del índice */
+
+/**
+ * @brief Bytes que ocupa un registro de `bytes` bytes de bloque, con su alineación.
+ */
+static uint64_t tamano_registro(size_t bytes) {
+    return (sizeof(CabeceraRegistro) + bytes + LIBRO_ALINEACION - 1) & ~(uint64_t)(LIBRO_ALINEACION - 1);
+}
+
+/**
+ * @brief Escribe la ruta del índice de un libro.
+ *
+ * @return 0 si cabe, -1 si la ruta es demasiado larga.
+ */
+static int ruta_indice(char *destino, const char *ruta) {
+    if (snprintf(destino, MAX_RUTA, "%s.idx", ruta) >= MAX_RUTA) {
+        fprintf(stderr, "Ruta del libro demasiado larga\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Amplía el fichero y vuelve a proyectarlo entero.
+ *
+ * Solo lo llama el comprobador; el hilo que confirma no usa las proyecciones, así que
+ * pueden cambiar de dirección sin coordinarse con él.
+ *
+ * @param fd Fichero proyectado.
+ * @param mapa Proyección actual, que se sustituye.
+ * @param capacidad Bytes proyectados, que se actualizan.
+ * @param necesarios Bytes que deben caber como mínimo.
+ * @return 0 si todo va bien, -1 en caso de error (la proyección anterior sigue valiendo).
+ */
+static int crecer(int fd, void **mapa, size_t *capacidad, uint64_t necesarios) {
+    size_t nueva = *capacidad * 2;
+    void *proyeccion;
+
+    if (nueva < necesarios + LIBRO_CRECIMIENTO) {
+        nueva = necesarios + LIBRO_CRECIMIENTO;
+    }
+    if (ftruncate(fd, (off_t)nueva) == -1) {
+        perror("ftruncate libro");
+        return -1;
+    }
+    proyeccion = mmap(NULL, nueva, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (proyeccion == MAP_FAILED) {
+        perror("mmap libro");
+        return -1;
+    }
+    if (*mapa) {
+        munmap(*mapa, *capacidad);
+    }
+    *mapa = proyeccion;
+    *capacidad = nueva;
+    return 0;
+}
+
+/**
+ * @brief Pone en el índice el desplazamiento de un registro, ampliándolo si hace falta.
+ */
+static int indexar(Libro *libro, int id, uint64_t desplazamiento) {
+    uint64_t entrada = INDICE_PRIMERA + (uint64_t)id;
+
+    if ((entrada + 1) * sizeof(uint64_t) > libro->capacidad_indice &&
+        crecer(libro->fd_indice, (void **)&libro->indice, &libro->capacidad_indice, (entrada + 1) * sizeof(uint64_t)) != 0) {
+        return -1;
+    }
+    libro->indice[entrada] = desplazamiento;
+    if ((uint64_t)id + 1 > libro->ids) {
+        libro->ids = (uint64_t)id + 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Hace duraderos los datos escritos hasta `bytes` y después lo anota en las cabeceras.
+ *
+ * Primero se sincronizan los registros y el índice y solo después las cabeceras, así que
+ * una cabecera en disco nunca cuenta registros que no lo estén.
+ */
+static void confirmar(Libro *libro, uint64_t bytes, uint64_t registros, uint64_t ids) {
+    CabeceraLibro cabecera = {LIBRO_MAGICO, LIBRO_VERSION, 0, bytes, registros, {0}};
+    CabeceraIndice cabecera_indice = {INDICE_MAGICO, LIBRO_VERSION, 0, ids, {0}};
+
+    /* fdatasync también vuelca las páginas escritas a través de la proyección compartida */
+    if (fdatasync(libro->fd) == -1 || fdatasync(libro->fd_indice) == -1) {
+        perror("fdatasync libro");
+        return;
+    }
+    if (pwrite(libro->fd, &cabecera, sizeof(cabecera), 0) != (ssize_t)sizeof(cabecera) ||
+        pwrite(libro->fd_indice, &cabecera_indice, sizeof(cabecera_indice), 0) != (ssize_t)sizeof(cabecera_indice)) {
+        perror("pwrite libro");
+        return;
+    }
+    if (fdatasync(libro->fd) == -1 || fdatasync(libro->fd_indice) == -1) {
+        perror("fdatasync libro");
+    }
+}
+
+/**
+ * @brief Hilo que confirma por grupos lo que el comprobador va anotando.
+ */
+static void *confirmador(void *arg) {
+    Libro *libro = (Libro *)arg;
+    uint64_t confirmados = libro->bytes_listos, bytes, registros, ids;
+    struct timespec plazo;
+    bool fin;
+
+    pthread_mutex_lock(&libro->mutex);
+    for (;;) {
+        clock_gettime(CLOCK_MONOTONIC, &plazo);
+        plazo.tv_nsec += (long)LIBRO_INTERVALO_MS * 1000000L;
+        plazo.tv_sec += plazo.tv_nsec / 1000000000L;
+        plazo.tv_nsec %= 1000000000L;
+        while (!libro->fin && libro->sin_confirmar < LIBRO_GRUPO) {
+            if (pthread_cond_timedwait(&libro->aviso, &libro->mutex, &plazo) == ETIMEDOUT) {
+                break;
+            }
+        }
+        fin = libro->fin;
+        if (libro->bytes_listos != confirmados) {
+            bytes = libro->bytes_listos;
+            registros = libro->registros_listos;
+            ids = libro->ids_listos;
+            libro->sin_confirmar = 0;
+            pthread_mutex_unlock(&libro->mutex);
+
+            confirmar(libro, bytes, registros, ids);
+
+            pthread_mutex_lock(&libro->mutex);
+            confirmados = bytes;
+            libro->confirmaciones++;
+        }
+        if (fin) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&libro->mutex);
+    return NULL;
+}
+
+/**
+ * @brief Lee y comprueba la cabecera de un libro existente.
+ *
+ * @return 0 si es un libro válido, -1 si no.
+ */
+static int leer_cabecera(int fd, CabeceraLibro *cabecera) {
+    if (pread(fd, cabecera, sizeof(*cabecera), 0) != (ssize_t)sizeof(*cabecera) ||
+        memcmp(cabecera->magico, LIBRO_MAGICO, sizeof(LIBRO_MAGICO)) != 0 ||
+        cabecera->version != LIBRO_VERSION || cabecera->bytes < sizeof(CabeceraLibro)) {
+        return -1;
+    }
+    return 0;
+}
+
+int libro_abrir(Libro *libro, const char *ruta) {
+    char indice[MAX_RUTA];
+    CabeceraLibro cabecera = {LIBRO_MAGICO, LIBRO_VERSION, 0, sizeof(CabeceraLibro), 0, {0}};
+    const CabeceraRegistro *registro;
+    pthread_condattr_t atributos;
+    struct stat estado;
+    uint64_t desplazamiento, fin;
+
+    memset(libro, 0, sizeof(*libro));
+    libro->fd = libro->fd_indice = -1;
+    if (ruta_indice(indice, ruta) != 0) {
+        return -1;
+    }
+    if ((libro->fd = open(ruta, O_RDWR | O_CREAT, 0644)) == -1) {
+        perror("open libro");
+        return -1;
+    }
+    if (fstat(libro->fd, &estado) == -1) {
+        perror("fstat libro");
+        goto error;
+    }
+    if (estado.st_size == 0) {
+        if (pwrite(libro->fd, &cabecera, sizeof(cabecera), 0) != (ssize_t)sizeof(cabecera)) {
+            perror("pwrite libro");
+            goto error;
+        }
+    } else if (leer_cabecera(libro->fd, &cabecera) != 0) {
+        fprintf(stderr, "%s no es un libro de bloques\n", ruta);
+        goto error;
+    }
+    fin = cabecera.bytes;
+    if (fin > (uint64_t)estado.st_size && estado.st_size > 0) {
+        fin = (uint64_t)estado.st_size;
+    }
+    if (crecer(libro->fd, (void **)&libro->mapa, &libro->capacidad, fin) != 0) {
+        goto error;
+    }
+
+    /* El índice se rehace siempre desde lo confirmado, así que no puede quedar desfasado */
+    if ((libro->fd_indice = open(indice, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1) {
+        perror("open indice");
+        goto error;
+    }
+    if (crecer(libro->fd_indice, (void **)&libro->indice, &libro->capacidad_indice, sizeof(CabeceraIndice)) != 0) {
+        goto error;
+    }
+    desplazamiento = sizeof(CabeceraLibro);
+    while (desplazamiento + sizeof(CabeceraRegistro) <= fin) {
+        registro = (const CabeceraRegistro *)(libro->mapa + desplazamiento);
+        if (registro->bytes > BLOQUE_MAX_BYTES || desplazamiento + tamano_registro(registro->bytes) > fin) {
+            break;
+        }
+        if (registro->id >= 0 && indexar(libro, registro->id, desplazamiento) != 0) {
+            goto error;
+        }
+        libro->registros++;
+        desplazamiento += tamano_registro(registro->bytes);
+    }
+    /* Lo que hubiera detrás del último registro completo se sobrescribe */
+    libro->bytes = desplazamiento;
+    confirmar(libro, libro->bytes, libro->registros, libro->ids);
+
+    libro->bytes_listos = libro->bytes;
+    libro->registros_listos = libro->registros;
+    libro->ids_listos = libro->ids;
+    pthread_mutex_init(&libro->mutex, NULL);
+    pthread_condattr_init(&atributos);
+    pthread_condattr_setclock(&atributos, CLOCK_MONOTONIC);
+    pthread_cond_init(&libro->aviso, &atributos);
+    pthread_condattr_destroy(&atributos);
+    if (pthread_create(&libro->hilo, NULL, confirmador, libro) != 0) {
+        perror("pthread_create");
+        pthread_mutex_destroy(&libro->mutex);
+        pthread_cond_destroy(&libro->aviso);
+        goto error;
+    }
+    return 0;
+
+error:
+    if (libro->indice) {
+        munmap(libro->indice, libro->capacidad_indice);
+    }
+    if (libro->mapa) {
+        munmap(libro->mapa, libro->capacidad);
+    }
+    if (libro->fd_indice != -1) {
+        close(libro->fd_indice);
+    }
+    close(libro->fd);
+    return -1;
+}
+
+int libro_anotar(Libro *libro, int id, const void *bloque, size_t bytes) {
+    uint64_t desplazamiento = libro->bytes, ocupa = tamano_registro(bytes);
+    CabeceraRegistro registro = {(uint32_t)bytes, id};
+
+    if (desplazamiento + ocupa > libro->capacidad &&
+        crecer(libro->fd, (void **)&libro->mapa, &libro->capacidad, desplazamiento + ocupa) != 0) {
+        return -1;
+    }
+    memcpy(libro->mapa + desplazamiento, &registro, sizeof(registro));
+    memcpy(libro->mapa + desplazamiento + sizeof(registro), bloque, bytes);
+    if (id >= 0 && indexar(libro, id, desplazamiento) != 0) {
+        return -1;
+    }
+    libro->bytes += ocupa;
+    libro->registros++;
+
+    /* Solo se pasa el progreso al hilo; las llamadas al sistema las hace él */
+    pthread_mutex_lock(&libro->mutex);
+    libro->bytes_listos = libro->bytes;
+    libro->registros_listos = libro->registros;
+    libro->ids_listos = libro->ids;
+    if (++libro->sin_confirmar == LIBRO_GRUPO) {
+        pthread_cond_signal(&libro->aviso);
+    }
+    pthread_mutex_unlock(&libro->mutex);
+    return 0;
+}
+
+void libro_cerrar(Libro *libro) {
+    pthread_mutex_lock(&libro->mutex);
+    libro->fin = true;
+    pthread_cond_signal(&libro->aviso);
+    pthread_mutex_unlock(&libro->mutex);
+    pthread_join(libro->hilo, NULL);
+
+    pthread_mutex_destroy(&libro->mutex);
+    pthread_cond_destroy(&libro->aviso);
+    munmap(libro->mapa, libro->capacidad);
+    munmap(libro->indice, libro->capacidad_indice);
+    /* Se devuelve al sistema lo reservado de más al crecer */
+    if (ftruncate(libro->fd, (off_t)libro->bytes) == -1 ||
+        ftruncate(libro->fd_indice, (off_t)(sizeof(CabeceraIndice) + libro->ids * sizeof(uint64_t))) == -1) {
+        perror("ftruncate libro");
+    }
+    close(libro->fd);
+    close(libro->fd_indice);
+}
+
+int libro_leer(LibroLectura *lectura, const char *ruta) {
+    char indice[MAX_RUTA];
+    CabeceraLibro cabecera;
+    CabeceraIndice cabecera_indice;
+    struct stat estado;
+    void *mapa;
+    int fd;
+
+    memset(lectura, 0, sizeof(*lectura));
+    if (ruta_indice(indice, ruta) != 0) {
+        return -1;
+    }
+    if ((fd = open(ruta, O_RDONLY)) == -1) {
+        perror("open libro");
+        return -1;
+    }
+    if (leer_cabecera(fd, &cabecera) != 0 || fstat(fd, &estado) == -1) {
+        fprintf(stderr, "%s no es un libro de bloques\n", ruta);
+        close(fd);
+        return -1;
+    }
+    lectura->tamano = cabecera.bytes < (uint64_t)estado.st_size ? cabecera.bytes : (size_t)estado.st_size;
+    lectura->registros = cabecera.registros;
+    mapa = mmap(NULL, lectura->tamano, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapa == MAP_FAILED) {
+        perror("mmap libro");
+        return -1;
+    }
+    lectura->mapa = mapa;
+
+    /* Sin índice el libro se puede recorrer igualmente; solo falla la búsqueda por id */
+    if ((fd = open(indice, O_RDONLY)) == -1) {
+        return 0;
+    }
+    if (pread(fd, &cabecera_indice, sizeof(cabecera_indice), 0) == (ssize_t)sizeof(cabecera_indice) &&
+        memcmp(cabecera_indice.magico, INDICE_MAGICO, sizeof(INDICE_MAGICO)) == 0 &&
+        cabecera_indice.version == LIBRO_VERSION && fstat(fd, &estado) == 0 &&
+        sizeof(CabeceraIndice) + cabecera_indice.ids * sizeof(uint64_t) <= (uint64_t)estado.st_size) {
+        lectura->tamano_indice = sizeof(CabeceraIndice) + cabecera_indice.ids * sizeof(uint64_t);
+        mapa = mmap(NULL, lectura->tamano_indice, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapa != MAP_FAILED) {
+            lectura->indice = mapa;
+            lectura->ids = cabecera_indice.ids;
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+const void *libro_buscar(const LibroLectura *lectura, int id, size_t *bytes) {
+    const CabeceraRegistro *registro;
+    uint64_t desplazamiento;
+
+    if (!lectura->indice || id < 0 || (uint64_t)id >= lectura->ids) {
+        return NULL;
+    }
+    desplazamiento = lectura->indice[INDICE_PRIMERA + (uint64_t)id];
+    /* Un 0 es un id sin bloque; más allá de lo confirmado, un registro que aún no cuenta */
+    if (desplazamiento < sizeof(CabeceraLibro) || desplazamiento + sizeof(CabeceraRegistro) > lectura->tamano) {
+        return NULL;
+    }
+    registro = (const CabeceraRegistro *)(lectura->mapa + desplazamiento);
+    if (registro->id != id || registro->bytes > BLOQUE_MAX_BYTES ||
+        desplazamiento + tamano_registro(registro->bytes) > lectura->tamano) {
+        return NULL;
+    }
+    *bytes = registro->bytes;
+    return registro + 1;
+}
+
+const void *libro_siguiente(const LibroLectura *lectura, uint64_t *desplazamiento, int *id, size_t *bytes) {
+    const CabeceraRegistro *registro;
+
+    if (*desplazamiento < sizeof(CabeceraLibro)) {
+        *desplazamiento = sizeof(CabeceraLibro);
+    }
+    if (*desplazamiento + sizeof(CabeceraRegistro) > lectura->tamano) {
+        return NULL;
+    }
+    registro = (const CabeceraRegistro *)(lectura->mapa + *desplazamiento);
+    if (registro->bytes > BLOQUE_MAX_BYTES || *desplazamiento + tamano_registro(registro->bytes) > lectura->tamano) {
+        return NULL;
+    }
+    *id = registro->id;
+    *bytes = registro->bytes;
+    *desplazamiento += tamano_registro(registro->bytes);
+    return registro + 1;
+}
+
+void libro_soltar(LibroLectura *lectura) {
+    if (lectura->mapa) {
+        munmap((void *)lectura->mapa, lectura->tamano);
+    }
+    if (lectura->indice) {
+        munmap((void *)lectura->indice, lectura->tamano_indice);
+    }
+}
@@ -0,0 +1,174 @@
+/**
+ * @file libro.h
+ * @brief Libro mayor: registro persistente, solo de añadir, de los bloques validados.
+ *
+ * El libro es un fichero proyectado en memoria con una cabecera y, detrás, un registro por
+ * bloque: una cabecera de registro con la longitud y el id, y el bloque en formato compacto
+ * completo (con la marca de validado). Junto a él, `<libro>.idx` guarda un índice denso
+ * id -> desplazamiento, así que cualquier bloque se encuentra en O(1).
+ *
+ * El comprobador añade registros copiando en la proyección, sin llamadas al sistema. Un
+ * hilo aparte confirma por grupos: cada LIBRO_GRUPO bloques o cada LIBRO_INTERVALO_MS
+ * hace fdatasync() de los datos y del índice y solo después escribe en la cabecera hasta
+ * dónde llega lo confirmado. Tras una caída, lo que haya detrás de ese punto se ignora.
+ *
+ * Si el fichero ya existe se sigue añadiendo al final. Si un id se repite (otra red que
+ * empieza de nuevo en el bloque 1), el índice apunta al registro más reciente.
+ */
+
+#ifndef LIBRO_H
+#define LIBRO_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bloque.h"
+
+#define LIBRO_MAGICO "LIBROBQ" /**< Identificador al principio del libro */
+#define INDICE_MAGICO "INDICEB" /**< Identificador al principio del índice */
+#define LIBRO_VERSION 1 /**< Versión del formato del libro y del índice */
+#define LIBRO_GRUPO 256 /**< Bloques que se confirman juntos como mucho */
+#define LIBRO_INTERVALO_MS 100 /**< Tiempo máximo que un bloque espera a ser confirmado */
+#define LIBRO_CRECIMIENTO (4 << 20) /**< Bytes mínimos que crece el fichero cada vez */
+#define LIBRO_ALINEACION 8 /**< Alineación de cada registro */
+
+/**
+ * @brief Cabecera del libro. Solo la escribe el hilo que confirma.
+ */
+typedef struct {
+    char magico[8];     /**< LIBRO_MAGICO, con terminador */
+    uint32_t version;   /**< LIBRO_VERSION */
+    uint32_t reservado;
+    uint64_t bytes;     /**< Bytes confirmados, cabecera incluida */
+    uint64_t registros; /**< Registros confirmados */
+    unsigned char relleno[32];
+} CabeceraLibro;
+
+/**
+ * @brief Cabecera del índice; le sigue un uint64_t por id.
+ */
+typedef struct {
+    char magico[8];     /**< INDICE_MAGICO, con terminador */
+    uint32_t version;   /**< LIBRO_VERSION */
+    uint32_t reservado;
+    uint64_t ids;       /**< Entradas válidas: mayor id confirmado más uno */
+    unsigned char relleno[40];
+} CabeceraIndice;
+
+/**
+ * @brief Cabecera de cada registro; le siguen `bytes` bytes del bloque compacto.
+ */
+typedef struct {
+    uint32_t bytes; /**< Longitud del bloque */
+    int32_t id;     /**< Id del bloque */
+} CabeceraRegistro;
+
+_Static_assert(sizeof(CabeceraLibro) == 64, "La cabecera del libro ocupa una línea");
+_Static_assert(sizeof(CabeceraIndice) == 64, "La cabecera del índice ocupa una línea");
+
+/**
+ * @brief Libro abierto para añadir bloques.
+ */
+typedef struct {
+    int fd;                    /**< Fichero del libro */
+    int fd_indice;             /**< Fichero del índice */
+    unsigned char *mapa;       /**< Proyección del libro */
+    size_t capacidad;          /**< Bytes proyectados del libro */
+    uint64_t *indice;          /**< Proyección del índice, cabecera incluida */
+    size_t capacidad_indice;   /**< Bytes proyectados del índice */
+    uint64_t bytes;            /**< Bytes escritos; solo lo toca el comprobador */
+    uint64_t registros;        /**< Registros escritos */
+    uint64_t ids;              /**< Mayor id escrito más uno */
+    pthread_t hilo;            /**< Hilo que confirma */
+    pthread_mutex_t mutex;     /**< Protege lo que se pasa al hilo */
+    pthread_cond_t aviso;      /**< Hay un grupo completo o hay que terminar */
+    uint64_t bytes_listos;     /**< Bytes escritos que el hilo puede confirmar */
+    uint64_t registros_listos; /**< Registros escritos que el hilo puede confirmar */
+    uint64_t ids_listos;       /**< Ids escritos que el hilo puede confirmar */
+    uint64_t sin_confirmar;    /**< Registros escritos desde el último aviso */
+    bool fin;                  /**< El hilo debe confirmar lo que quede y terminar */
+    uint64_t confirmaciones;   /**< Grupos confirmados */
+} Libro;
+
+/**
+ * @brief Libro proyectado en modo solo lectura.
+ */
+typedef struct {
+    const unsigned char *mapa; /**< Proyección del libro */
+    size_t tamano;             /**< Bytes proyectados: los confirmados */
+    const uint64_t *indice;    /**< Desplazamientos por id, o NULL si no hay índice */
+    size_t tamano_indice;      /**< Bytes proyectados del índice */
+    uint64_t ids;              /**< Entradas del índice */
+    uint64_t registros;        /**< Registros confirmados */
+} LibroLectura;
+
+/**
+ * @brief Abre o crea un libro para añadir bloques y arranca el hilo que confirma.
+ *
+ * El índice se reconstruye a partir de los registros confirmados.
+ *
+ * @param libro Libro a rellenar.
+ * @param ruta Ruta del libro; el índice es `<ruta>.idx`.
+ * @return 0 si todo va bien, -1 en caso de error.
+ */
+int libro_abrir(Libro *libro, const char *ruta);
+
+/**
+ * @brief Añade un bloque al final del libro.
+ *
+ * @param libro Libro abierto.
+ * @param id Id del bloque.
+ * @param bloque Bloque en formato compacto.
+ * @param bytes Longitud del bloque.
+ * @return 0 si todo va bien, -1 si el fichero no ha podido crecer.
+ */
+int libro_anotar(Libro *libro, int id, const void *bloque, size_t bytes);
+
+/**
+ * @brief Confirma lo que quede, para el hilo y cierra el libro.
+ *
+ * @param libro Libro abierto.
+ */
+void libro_cerrar(Libro *libro);
+
+/**
+ * @brief Proyecta en solo lectura la parte confirmada de un libro y su índice.
+ *
+ * @param lectura Libro a rellenar.
+ * @param ruta Ruta del libro.
+ * @return 0 si todo va bien, -1 si no existe o no es un libro.
+ */
+int libro_leer(LibroLectura *lectura, const char *ruta);
+
+/**
+ * @brief Busca un bloque por id en O(1).
+ *
+ * @param lectura Libro proyectado.
+ * @param id Id buscado.
+ * @param bytes Longitud del bloque encontrado.
+ * @return El bloque en formato compacto, o NULL si no está.
+ */
+const void *libro_buscar(const LibroLectura *lectura, int id, size_t *bytes);
+
+/**
+ * @brief Recorre los registros en orden de escritura.
+ *
+ * @param lectura Libro proyectado.
+ * @param desplazamiento Registro actual; se pone a sizeof(CabeceraLibro) para empezar y
+ *        se avanza al siguiente.
+ * @param id Id del registro devuelto.
+ * @param bytes Longitud del bloque devuelto.
+ * @return El bloque en formato compacto, o NULL al llegar al final.
+ */
+const void *libro_siguiente(const LibroLectura *lectura, uint64_t *desplazamiento, int *id, size_t *bytes);
+
+/**
+ * @brief Deshace las proyecciones de un libro leído.
+ *
+ * @param lectura Libro proyectado.
+ */
+void libro_soltar(LibroLectura *lectura);
+
+#endif
@@ -0,0 +1,148 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metricas.h"
+
+/**
+ * @brief Toma una casilla para este proceso: una libre o la de un proceso muerto.
+ *
+ * @return La casilla, o NULL si todas son de procesos vivos.
+ */
+static ProcesoMetricas *tomar_casilla_metricas(SegmentoMetricas *segmento) {
+    pid_t yo = getpid(), otro;
+
+    for (int i = 0; i < METRICAS_PROCESOS; i++) {
+        otro = 0;
+        if (atomic_compare_exchange_strong(&segmento->procesos[i].pid, &otro, yo)) {
+            return &segmento->procesos[i];
+        }
+    }
+    for (int i = 0; i < METRICAS_PROCESOS; i++) {
+        otro = atomic_load(&segmento->procesos[i].pid);
+        if (otro > 0 && kill(otro, 0) == -1 && errno == ESRCH &&
+            atomic_compare_exchange_strong(&segmento->procesos[i].pid, &otro, yo)) {
+            return &segmento->procesos[i];
+        }
+    }
+    return NULL;
+}
+
+uint64_t metricas_instante(const Metricas *metricas) {
+    struct timespec ahora;
+
+    if (!metricas) {
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ahora);
+    return (uint64_t)ahora.tv_sec * 1000000000ULL + (uint64_t)ahora.tv_nsec;
+}
+
+int metricas_abrir(Metricas *metricas, TipoProceso tipo, int hilos) {
+    ProcesoMetricas *proceso;
+    struct stat info;
+    uint32_t version = 0;
+    int fd;
+
+    if ((fd = shm_open(SHM_NAME_METRICAS, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR)) == -1) {
+        perror("shm_open metricas");
+        return -1;
+    }
+    if (fstat(fd, &info) == -1) {
+        perror("fstat metricas");
+        close(fd);
+        return -1;
+    }
+    /* Un segmento nuevo queda a ceros, que ya es un estado válido */
+    if (info.st_size == 0 && ftruncate(fd, sizeof(SegmentoMetricas)) == -1) {
+        perror("ftruncate metricas");
+        close(fd);
+        return -1;
+    }
+    if (info.st_size != 0 && (size_t)info.st_size != sizeof(SegmentoMetricas)) {
+        fprintf(stderr, "%s no es un segmento de métricas de la versión %d\n", SHM_NAME_METRICAS, METRICAS_VERSION);
+        close(fd);
+        return -1;
+    }
+    metricas->segmento = mmap(NULL, sizeof(SegmentoMetricas), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (metricas->segmento == MAP_FAILED) {
+        perror("mmap metricas");
+        return -1;
+    }
+    if (!atomic_compare_exchange_strong(&metricas->segmento->version, &version, METRICAS_VERSION) &&
+        version != METRICAS_VERSION) {
+        fprintf(stderr, "%s no es un segmento de métricas de la versión %d\n", SHM_NAME_METRICAS, METRICAS_VERSION);
+        munmap(metricas->segmento, sizeof(SegmentoMetricas));
+        return -1;
+    }
+    if ((proceso = tomar_casilla_metricas(metricas->segmento)) == NULL) {
+        fprintf(stderr, "No quedan casillas de métricas (%d procesos vivos)\n", METRICAS_PROCESOS);
+        munmap(metricas->segmento, sizeof(SegmentoMetricas));
+        return -1;
+    }
+
+    /* La casilla puede traer los contadores de su dueño anterior */
+    atomic_store(&proceso->tipo, PROCESO_LIBRE);
+    for (int c = 0; c < MET_CONTADORES; c++) {
+        atomic_store_explicit(&proceso->contadores[c], 0, memory_order_relaxed);
+    }
+    for (int h = 0; h < METRICAS_HILOS; h++) {
+        atomic_store_explicit(&proceso->hashes[h].hashes, 0, memory_order_relaxed);
+        atomic_store_explicit(&proceso->hashes[h].cpu, -1, memory_order_relaxed);
+    }
+    proceso->hilos = (uint32_t)(hilos < METRICAS_HILOS ? hilos : METRICAS_HILOS);
+    metricas->proceso = proceso;
+    proceso->arranque_ns = metricas_instante(metricas);
+    /* El tipo se publica el último: quien lo lee ve la casilla ya preparada */
+    atomic_store_explicit(&proceso->tipo, tipo, memory_order_release);
+    return 0;
+}
+
+int metricas_leer(const SegmentoMetricas **segmento) {
+    struct stat info;
+    int fd;
+
+    if ((fd = shm_open(SHM_NAME_METRICAS, O_RDONLY, 0)) == -1) {
+        perror("shm_open metricas");
+        return -1;
+    }
+    if (fstat(fd, &info) == -1 || (size_t)info.st_size != sizeof(SegmentoMetricas)) {
+        fprintf(stderr, "%s no es un segmento de métricas de la versión %d\n", SHM_NAME_METRICAS, METRICAS_VERSION);
+        close(fd);
+        return -1;
+    }
+    *segmento = mmap(NULL, sizeof(SegmentoMetricas), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (*segmento == MAP_FAILED) {
+        perror("mmap metricas");
+        return -1;
+    }
+    if (atomic_load(&(*segmento)->version) != METRICAS_VERSION) {
+        fprintf(stderr, "%s no es un segmento de métricas de la versión %d\n", SHM_NAME_METRICAS, METRICAS_VERSION);
+        munmap((void *)*segmento, sizeof(SegmentoMetricas));
+        return -1;
+    }
+    return 0;
+}
+
+_Atomic uint64_t *metricas_hashes(Metricas *metricas, int hilo) {
+    return &metricas->proceso->hashes[hilo].hashes;
+}
+
+void metricas_fijar_cpu(Metricas *metricas, int hilo, int cpu) {
+    if (hilo < METRICAS_HILOS) {
+        atomic_store_explicit(&metricas->proceso->hashes[hilo].cpu, cpu, memory_order_relaxed);
+    }
+}
+
+void metricas_cerrar(Metricas *metricas) {
+    atomic_store(&metricas->proceso->tipo, PROCESO_LIBRE);
+    atomic_store(&metricas->proceso->pid, 0);
+    munmap(metricas->segmento, sizeof(SegmentoMetricas));
+}
@@ -0,0 +1,182 @@
+/**
+ * @file metricas.h
+ * @brief Contadores en vivo de mineros, comprobador y monitor en un segmento compartido.
+ *
+ * Cada proceso toma con un CAS una casilla del segmento SHM_NAME_METRICAS al arrancar y la
+ * devuelve al salir. En la casilla cada contador tiene un único escritor: los del proceso
+ * los escribe su hilo principal y los hashes de cada hilo minero, el propio hilo, en su
+ * línea de caché. Escribir es una carga y un almacenamiento relajados, sin operaciones
+ * atómicas de lectura-modificación-escritura, sin bloqueos ni llamadas al sistema.
+ *
+ * Los contadores solo crecen (salvo los de nivel, como la profundidad de la cola), así que
+ * top_mineros calcula las tasas restando dos lecturas separadas por un intervalo.
+ */
+
+#ifndef METRICAS_H
+#define METRICAS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SHM_NAME_METRICAS "/metricas_red" /**< Nombre del segmento de métricas */
+#define METRICAS_VERSION 2 /**< Versión del formato del segmento */
+#define METRICAS_PROCESOS 128 /**< Procesos que pueden publicar a la vez */
+#define METRICAS_HILOS 100 /**< Hilos mineros por proceso, como MAX_THREADS */
+
+/**
+ * @brief Papel del proceso que ocupa una casilla.
+ */
+typedef enum {
+    PROCESO_LIBRE,       /**< Casilla sin usar */
+    PROCESO_MINERO,      /**< Un minero */
+    PROCESO_COMPROBADOR, /**< El comprobador */
+    PROCESO_MONITOR      /**< Un monitor, el de terminal o uno añadido con --seguir */
+} TipoProceso;
+
+/**
+ * @brief Contadores de un proceso; cada papel usa los suyos.
+ */
+typedef enum {
+    MET_RONDAS,            /**< Minero: rondas jugadas */
+    MET_GANADAS,           /**< Minero: rondas en las que propuso el bloque */
+    MET_PERDIDAS,          /**< Minero: rondas en las que otro propuso el bloque */
+    MET_VOTOS,             /**< Minero: votos emitidos como perdedor */
+    MET_ESPERA_MUTEX,      /**< Minero: ns esperando el semáforo mutex */
+    MET_ESPERA_MUTEX_RONDA,/**< Minero: ns esperando el semáforo mutex_ronda */
+    MET_ESPERA_GANADOR,    /**< Minero: ns esperando el semáforo ganador */
+    MET_ESPERA_ENTRADA,    /**< Minero: ns esperando el semáforo entry_mutex */
+    MET_ESPERA_PUERTA,     /**< Minero: ns esperando el semáforo entry_gate */
+    MET_ESPERA_RONDA,      /**< Minero: ns dormido en el futex de ronda */
+    MET_ESPERA_VOTOS,      /**< Minero: ns esperando los votos como ganador */
+    MET_BLOQUES,           /**< Comprobador: bloques recibidos; monitor: bloques impresos */
+    MET_VALIDOS,           /**< Comprobador: bloques con la solución correcta */
+    MET_INVALIDOS,         /**< Comprobador: bloques con la solución incorrecta */
+    MET_COLA,              /**< Comprobador: bloques pendientes en el transporte (nivel) */
+    MET_ANILLO,            /**< Comprobador: bloques del anillo del monitor sin leer (nivel) */
+    MET_SALTADOS,          /**< Monitor: bloques perdidos por quedarse atrás */
+    MET_CONTADORES
+} ContadorMetricas;
+
+#define MET_ESPERAS MET_ESPERA_MUTEX /**< Primer contador de espera */
+#define MET_N_ESPERAS (MET_ESPERA_VOTOS - MET_ESPERA_MUTEX + 1) /**< Contadores de espera */
+
+/**
+ * @brief Hashes calculados por un hilo minero, en su propia línea de caché.
+ */
+typedef struct {
+    _Alignas(64) _Atomic uint64_t hashes;
+    _Atomic int32_t cpu; /**< CPU a la que está fijado el hilo, o -1 */
+} HashesHilo;
+
+/**
+ * @brief Casilla de un proceso.
+ */
+typedef struct {
+    _Alignas(64) _Atomic pid_t pid; /**< Proceso que la ocupa, 0 si está libre */
+    _Atomic uint32_t tipo; /**< TipoProceso; se publica el último al tomar la casilla */
+    uint32_t hilos; /**< Hilos mineros del proceso */
+    uint64_t arranque_ns; /**< Instante CLOCK_MONOTONIC en que tomó la casilla */
+    _Alignas(64) _Atomic uint64_t contadores[MET_CONTADORES]; /**< Contadores del hilo principal */
+    HashesHilo hashes[METRICAS_HILOS]; /**< Hashes de cada hilo minero */
+} ProcesoMetricas;
+
+/**
+ * @brief Contenido del segmento; a ceros ya es válido.
+ */
+typedef struct {
+    _Atomic uint32_t version; /**< METRICAS_VERSION, o 0 si nadie lo ha abierto todavía */
+    ProcesoMetricas procesos[METRICAS_PROCESOS]; /**< Casillas de los procesos */
+} SegmentoMetricas;
+
+/**
+ * @brief Métricas abiertas por un proceso.
+ */
+typedef struct {
+    SegmentoMetricas *segmento; /**< Proyección del segmento */
+    ProcesoMetricas *proceso; /**< Casilla del proceso */
+} Metricas;
+
+/**
+ * @brief Abre o crea el segmento de métricas y toma una casilla para este proceso.
+ *
+ * Reutiliza las casillas libres y las de procesos que murieron sin devolverla.
+ *
+ * @param metricas Métricas a rellenar.
+ * @param tipo Papel del proceso.
+ * @param hilos Hilos mineros del proceso, hasta METRICAS_HILOS.
+ * @return 0 si todo va bien, -1 en caso de error.
+ */
+int metricas_abrir(Metricas *metricas, TipoProceso tipo, int hilos);
+
+/**
+ * @brief Proyecta el segmento de métricas solo para leerlo.
+ *
+ * @param segmento Proyección del segmento.
+ * @return 0 si todo va bien, -1 si no existe o es de otra versión.
+ */
+int metricas_leer(const SegmentoMetricas **segmento);
+
+/**
+ * @brief Suma a un contador del proceso; solo lo llama el hilo principal.
+ *
+ * @param metricas Métricas abiertas, o NULL para no contar.
+ * @param contador Contador.
+ * @param valor Cantidad a sumar.
+ */
+static inline void metricas_sumar(Metricas *metricas, ContadorMetricas contador, uint64_t valor) {
+    _Atomic uint64_t *c;
+
+    if (metricas) {
+        c = &metricas->proceso->contadores[contador];
+        atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + valor, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Fija el valor de un contador de nivel; solo lo llama el hilo principal.
+ *
+ * @param metricas Métricas abiertas, o NULL para no contar.
+ * @param contador Contador.
+ * @param valor Nuevo valor.
+ */
+static inline void metricas_fijar(Metricas *metricas, ContadorMetricas contador, uint64_t valor) {
+    if (metricas) {
+        atomic_store_explicit(&metricas->proceso->contadores[contador], valor, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Contador de hashes de un hilo minero, para entregárselo al pool.
+ *
+ * @param metricas Métricas abiertas.
+ * @param hilo Índice del hilo en el pool.
+ * @return El contador del hilo.
+ */
+_Atomic uint64_t *metricas_hashes(Metricas *metricas, int hilo);
+
+/**
+ * @brief Publica la CPU a la que se ha fijado un hilo minero.
+ *
+ * @param metricas Métricas abiertas.
+ * @param hilo Índice del hilo en el pool.
+ * @param cpu CPU, o -1 si el hilo no está fijado.
+ */
+void metricas_fijar_cpu(Metricas *metricas, int hilo, int cpu);
+
+/**
+ * @brief Instante actual de CLOCK_MONOTONIC en nanosegundos.
+ *
+ * @param metricas Métricas abiertas, o NULL para no leer el reloj.
+ * @return El instante, o 0 si las métricas son NULL.
+ */
+uint64_t metricas_instante(const Metricas *metricas);
+
+/**
+ * @brief Devuelve la casilla y deshace la proyección del segmento.
+ *
+ * @param metricas Métricas abiertas.
+ */
+void metricas_cerrar(Metricas *metricas);
+
+#endif
@@ -1,63 +1,72 @@
 #include "minero.h"
 
-/**
- * @brief Función auxiliar segura para realizar sem_wait con control de errores.
- * 
- * @param sem Puntero al semáforo a esperar.
- * @param msg Mensaje de error en caso de fallo.
- */
-bool safe_sem_wait(sem_t *sem, const char *msg) {
-    while (sem_wait(sem) == -1) {
-        if (errno != EINTR) {
-            perror(msg);
-            return false;
-        }
-        if (got_signal_SIGINT || got_signal_SIGALARM) {
-            return false;
-        }
-    }
-    return true;
-}
-
-/**
- * @brief Función auxiliar segura para realizar sem_post con control de errores.
- * 
- * @param sem Puntero al semáforo a liberar.
- * @param msg Mensaje de error en caso de fallo.
- */
-bool safe_sem_post(sem_t *sem, const char *msg) {
-    while (sem_post(sem) == -1) {
-        if (errno != EINTR) {
-            perror(msg);
-            return false;
-        }
-        if (got_signal_SIGINT || got_signal_SIGALARM) {
-            return false;
-        }
-    }
-    return true;
-}
+/* Contadores en vivo del minero, o NULL si no se ha podido abrir el segmento */
+static Metricas *metricas = NULL;
+/* Registro de eventos del minero, o NULL si no los anota */
+static Eventos *eventos = NULL;
 
 /* Variables globales para la gestión de señales */
 volatile sig_atomic_t got_signal_SIGINT = 0;
 volatile sig_atomic_t got_signal_SIGALARM = 0; 
-volatile sig_atomic_t got_signal_SIGUSR1 = 0;
-volatile sig_atomic_t got_signal_SIGUSR2 = 0;
+
+/**
+ * @brief Dice si una señal recibida debe cortar la espera de un semáforo.
+ */
+static bool senal_recibida(void) {
+    return got_signal_SIGINT || got_signal_SIGALARM;
+}
 
 void handle_sigint() {
     got_signal_SIGINT = 1;
+    eventos_anotar(eventos, EVENTO_SENAL, -1, SIGINT);
 }
 
-void handler_sigusr1() {
-    got_signal_SIGUSR1 = 1;
+void handler_sigalrm() {
+    got_signal_SIGALARM = 1;
+    eventos_anotar(eventos, EVENTO_SENAL, -1, SIGALRM);
 }
 
-void handler_sigusr2() {
-    got_signal_SIGUSR2 = 1;
+/* Casilla del minero en el registro, o -1 si no está registrado */
+static int mi_casilla = -1;
+
+/**
+ * @brief Saca una casilla de la lista de libres del registro.
+ * 
+ * @param segmento Segmento de memoria compartida del sistema.
+ * @return Índice de la casilla, o -1 si el registro está lleno.
+ */
+int tomar_casilla(SharedMemMiner *segmento) {
+    uint64_t cabeza;
+    int casilla;
+
+    cabeza = atomic_load(&segmento->libres);
+    do {
+        casilla = LIBRES_CASILLA(cabeza);
+        if (casilla == -1) {
+            return -1;
+        }
+        /* La etiqueta cambia en cada operación: si la casilla se tomó y se devolvió
+         * entretanto, el CAS falla aunque la cabeza vuelva a apuntar a ella */
+    } while (!atomic_compare_exchange_weak(&segmento->libres, &cabeza,
+                 LIBRES(LIBRES_ETIQUETA(cabeza) + 1,
+                        (int)atomic_load(&registro_de(segmento)[casilla].siguiente_libre) - 1)));
+    return casilla;
 }
 
-void handler_sigalrm() {
-    got_signal_SIGALARM = 1;
+/**
+ * @brief Devuelve una casilla a la lista de libres del registro.
+ * 
+ * @param segmento Segmento de memoria compartida del sistema.
+ * @param casilla Índice de la casilla.
+ */
+void devolver_casilla(SharedMemMiner *segmento, int casilla) {
+    uint64_t cabeza;
+
+    cabeza = atomic_load(&segmento->libres);
+    do {
+        atomic_store(&registro_de(segmento)[casilla].siguiente_libre, (uint32_t)(LIBRES_CASILLA(cabeza) + 1));
+    } while (!atomic_compare_exchange_weak(&segmento->libres, &cabeza,
+                                           LIBRES(LIBRES_ETIQUETA(cabeza) + 1, casilla)));
 }
 
 /**
@@ -66,43 +75,38 @@ void handler_sigalrm() {
  * Elimina el registro del minero en el sistema y envía un mensaje de salida al monitor.
  * 
  * @param segmento Segmento de memoria compartida del sistema.
- * @param mq Cola de mensajes para la comunicación con el comprobador.
+ * @param transporte Transporte por el que se envían los bloques al comprobador.
  */
-void salir(SharedMemMiner **segmento, mqd_t *mq){
+void salir(SharedMemMiner **segmento, Transporte *transporte){
     int contador = 0;
-    Bloque envio = {0};  // inicializa todo a cero
+    CabeceraBloque envio = {0};  // inicializa todo a cero
+    char mensaje[BLOQUE_MAX_BYTES];
+    size_t bytes;
 
     /* Debo borrar todos mis datos del segmento del sistema */
-    /* Salir de la lista de pids, votos_mineros y monedas_mineros */
-    safe_sem_wait(&(*segmento)->semaforos.mutex, "salir");
-    for (int i = 0; i < MAX_MINERS; i++){
-        if ((*segmento)->pid[i] == getpid()){
-            (*segmento)->pid[i] = -1;
-            (*segmento)->votos_mineros[i].pid = -1;
-            (*segmento)->votos_mineros[i].voto = -1;
-            (*segmento)->monedas_mineros[i].monedas = -1;
-            (*segmento)->monedas_mineros[i].pid = -1;
-            break;
-        }
-    }
-    /* Comprobar si soy el último minero */
-    for (int i = 0; i < MAX_MINERS; i++) {
-        if ((*segmento)->pid[i] != -1){
-            contador++;
-        }
+    /* Liberar la casilla del registro */
+    if (mi_casilla != -1) {
+        atomic_store(&registro_de(*segmento)[mi_casilla].pid, -1);
+        monedas_de(*segmento)[mi_casilla].monedas = -1;
+        monedas_de(*segmento)[mi_casilla].pid = -1;
+        devolver_casilla(*segmento, mi_casilla);
+        mi_casilla = -1;
+        /* Comprobar si soy el último minero */
+        contador = atomic_fetch_sub(&(*segmento)->mineros_registrados, 1) - 1;
+    } else {
+        contador = atomic_load(&(*segmento)->mineros_registrados);
     }
-    safe_sem_post(&(*segmento)->semaforos.mutex, "salir");
     if (contador == 0){
         /* Soy el último minero, enviar codigo de salida al monitor */
         /* Rellenar el bloque con datos a enviar */
         envio.solucion = COD_SALIDA;
-        /* Enviar el bloque completo */
-        if (mq_send(*mq, (const char*)&envio, sizeof(Bloque), 0) == -1) {
-            perror("Error en mq_send");
-            mq_close(*mq);
+        bytes = bloque_codificar(&envio, BLOQUE_COMPLETO, NULL, 0, mensaje);
+        if (transporte_enviar(transporte, mensaje, bytes) == -1) {
+            perror("Error al enviar el bloque de salida");
+            transporte_cerrar(transporte);
             exit(EXIT_FAILURE);
         }    
-        mq_unlink(QUEUE_NAME);
+        transporte_borrar(transporte);
         shm_unlink(SHM_NAME);
     }
 
@@ -111,13 +115,14 @@ void salir(SharedMemMiner **segmento, mqd_t *mq){
 /**
  * @brief Función que configura las señales para el proceso minero.
  * 
- * Registra los manejadores de señales para SIGINT, SIGALRM, SIGUSR1 y SIGUSR2.
+ * Registra los manejadores de señales para SIGINT y SIGALRM. El inicio de ronda y la
+ * votación se notifican con futex en el segmento compartido, no con señales.
  * 
  * @return 0 si la configuración es exitosa, -1 en caso contrario.
  */
 int setup_signals(){
     sigset_t mask, oset;
-    struct sigaction sa_usr1, sa_usr2, sa_int, sa_alrm;
+    struct sigaction sa_int, sa_alrm;
 
 
     sigfillset(&oset);
@@ -126,24 +131,6 @@ int setup_signals(){
         return(EXIT_FAILURE);
     }
 
-    /* Configurar el handler para SIGUSR1 */
-    sa_usr1.sa_handler = handler_sigusr1;
-    sigemptyset(&sa_usr1.sa_mask);
-    sa_usr1.sa_flags = SA_RESTART;
-    if (sigaction(SIGUSR1, &sa_usr1, NULL) < 0) {
-        perror("sigaction");
-        return(EXIT_FAILURE);
-    }
-
-    /* Configurar el handler para SIGUSR2 */
-    sa_usr2.sa_handler = handler_sigusr2;
-    sigemptyset(&sa_usr2.sa_mask);
-    sa_usr2.sa_flags = SA_RESTART;
-    if (sigaction(SIGUSR2, &sa_usr2, NULL) < 0) {
-        perror("sigaction");
-        return(EXIT_FAILURE);
-    }
-
     /* Configurar el handler para SIGINT */
     sa_int.sa_handler = handle_sigint;
     sigemptyset(&sa_int.sa_mask); 
@@ -162,10 +149,8 @@ int setup_signals(){
         exit(EXIT_FAILURE);
     }
 
-    /* Desbloquear solo SIGUSR1, SIGUSR2, SIGALRM y SIGINT */
+    /* Desbloquear solo SIGALRM y SIGINT */
     sigemptyset(&mask);
-    sigaddset(&mask, SIGUSR1);
-    sigaddset(&mask, SIGUSR2);
     sigaddset(&mask, SIGINT);
     sigaddset(&mask, SIGALRM);
 
@@ -177,31 +162,155 @@ int setup_signals(){
     return EXIT_SUCCESS;
 }
 
+/* Red a la que pertenece el minero y época de la ronda que está jugando */
+static SharedMemMiner *red = NULL;
+static uint32_t ronda_vista = 0;
+/* Traza de latencia de las rondas, o NULL si el minero no traza */
+static Traza *traza = NULL;
+
+/**
+ * @brief Función que espera a que una época del segmento compartido alcance un valor.
+ * 
+ * Duerme en el futex de la palabra hasta que su valor llegue a `valor` (o lo supere, por
+ * si el minero se ha quedado atrás alguna ronda), o hasta recibir SIGINT o SIGALRM.
+ * 
+ * @param epoca Palabra de época del segmento compartido.
+ * @param valor Época esperada.
+ * @return true si se alcanzó la época, false si se recibió SIGINT o SIGALRM.
+ */
+bool esperar_epoca(_Atomic uint32_t *epoca, uint32_t valor) {
+    uint32_t actual;
+
+    while (!got_signal_SIGINT && !got_signal_SIGALARM) {
+        actual = atomic_load(epoca);
+        /* Comparación con signo de la diferencia: sigue siendo correcta al dar la vuelta */
+        if ((int32_t)(actual - valor) >= 0) {
+            return true;
+        }
+        futex_esperar(epoca, actual, ESPERA_FUTEX_MS);
+    }
+    return false;
+}
+
 /**
- * @brief Función que envía una señal a todos los mineros registrados en el sistema.
+ * @brief Función que abre una nueva ronda para todos los mineros registrados.
+ * 
+ * Un incremento de la época y un único FUTEX_WAKE despiertan a todos los mineros que
+ * esperan la ronda, sea cual sea su número.
  * 
- * @param sig Señal a enviar.
  * @param segmento Segmento de memoria compartida del sistema.
- * @param no_enviar PID del minero que no debe recibir la señal.
  */
-void enviar_señal(int sig, SharedMemMiner *segmento, pid_t no_enviar){
-    /* Enviar señal a todos los mineros */
-    for (int i = 0; i < MAX_MINERS; i++){
-        if (segmento->pid[i] != -1 && segmento->pid[i] != no_enviar){
-            if (kill(segmento->pid[i], sig) == -1) {
-                switch (errno) {
-                    case ESRCH:
-                        fprintf(stderr, "Error: no existe el proceso %d\n", segmento->pid[i]);
-                        break;
-                    case EPERM:
-                        fprintf(stderr, "Error: sin permisos para señal %d al proceso %d\n", sig, segmento->pid[i]);
-                        break;
-                    default:
-                        fprintf(stderr, "Error al enviar señal %d a %d: %s\n",
-                                sig, segmento->pid[i], strerror(errno));
-                }
-            }
+void anunciar_ronda(SharedMemMiner *segmento) {
+    traza_abrir_ronda(traza, segmento->bloque_actual.id, traza_instante(traza));
+    eventos_anotar(eventos, EVENTO_RONDA, segmento->bloque_actual.id, 0);
+    atomic_fetch_add(&segmento->epoca_ronda, 1);
+    futex_despertar_todos(&segmento->epoca_ronda);
+}
+
+/**
+ * @brief Función que abre la votación de la ronda en curso.
+ * 
+ * Vacía la urna, publica la época de la ronda votada y despierta a todos los votantes
+ * con un único FUTEX_WAKE. Los hilos mineros ven la votación abierta en su siguiente tramo.
+ * 
+ * @param segmento Segmento de memoria compartida del sistema.
+ */
+void anunciar_votacion(SharedMemMiner *segmento) {
+    /* El ganador ya ha votado a favor */
+    atomic_store(&segmento->urna, URNA(ronda_vista, 1, 0));
+    atomic_store(&segmento->epoca_voto, ronda_vista);
+    futex_despertar_todos(&segmento->epoca_voto);
+}
+
+/**
+ * @brief Indica si ya se ha abierto la votación de la ronda que juega este minero.
+ * 
+ * @return true si otro minero (o este mismo) ya ha propuesto una solución.
+ */
+bool votacion_abierta(void) {
+    /* Una votación de una ronda posterior también significa que esta ya tiene ganador */
+    return red && (int32_t)(atomic_load_explicit(&red->epoca_voto, memory_order_acquire) - ronda_vista) >= 0;
+}
+
+/**
+ * @brief Deposita el voto del minero en la urna y avisa al ganador.
+ * 
+ * El voto se anota primero en la casilla del minero, pasándola de una ronda anterior a la
+ * actual: si ya era de esta ronda el minero ya ha votado y no vuelve a sumar. Después solo
+ * cuenta si la urna sigue siendo la de la ronda del minero: un votante rezagado no puede
+ * sumar su voto a la votación de otra ronda.
+ * 
+ * @param segmento Segmento de memoria compartida del sistema.
+ * @param a_favor true para aprobar el bloque, false para rechazarlo.
+ */
+void depositar_voto(SharedMemMiner *segmento, bool a_favor) {
+    _Atomic uint64_t *casilla = &votos_de(segmento)[mi_casilla].voto;
+    uint64_t celda, urna;
+
+    celda = atomic_load(casilla);
+    do {
+        if (VOTO_RONDA(celda) == ronda_vista) {
+            return;
+        }
+    } while (!atomic_compare_exchange_weak(casilla, &celda,
+                                           VOTO(ronda_vista, a_favor ? VOTO_A_FAVOR : VOTO_EN_CONTRA)));
+
+    urna = atomic_load(&segmento->urna);
+    do {
+        if (URNA_RONDA(urna) != ronda_vista) {
+            return;
+        }
+    } while (!atomic_compare_exchange_weak(&segmento->urna, &urna, urna + (a_favor ? URNA(0, 1, 0) : URNA(0, 0, 1))));
+
+    atomic_fetch_add(&segmento->votos_recibidos, 1);
+    futex_despertar_todos(&segmento->votos_recibidos);
+}
+
+/**
+ * @brief Espera los votos de la ronda hasta que el resultado esté decidido.
+ * 
+ * Vuelve en cuanto hay mayoría a favor, en cuanto ya no puede haberla, cuando han votado
+ * todos los mineros o cuando vence el plazo, lo que ocurra antes.
+ * 
+ * @param segmento Segmento de memoria compartida del sistema.
+ * @param mineros Número de mineros registrados, incluido el ganador.
+ * @param plazo_ms Tiempo máximo de espera en milisegundos.
+ * @return El contenido de la urna al cerrar la votación.
+ */
+uint64_t esperar_votos(SharedMemMiner *segmento, int mineros, long int plazo_ms) {
+    struct timespec ahora, limite;
+    uint64_t urna;
+    uint32_t recibidos;
+    long int restante_ms;
+    int aprobados, emitidos;
+
+    clock_gettime(CLOCK_MONOTONIC, &limite);
+    limite.tv_sec += plazo_ms / 1000;
+    limite.tv_nsec += (plazo_ms % 1000) * 1000000L;
+    if (limite.tv_nsec >= 1000000000L) {
+        limite.tv_sec++;
+        limite.tv_nsec -= 1000000000L;
+    }
+
+    while (true) {
+        /* Se lee el contador antes que la urna para no perder un voto entre ambas lecturas */
+        recibidos = atomic_load(&segmento->votos_recibidos);
+        urna = atomic_load(&segmento->urna);
+        aprobados = URNA_APROBADOS(urna);
+        emitidos = URNA_EMITIDOS(urna);
+        if (aprobados > mineros / 2 || aprobados + (mineros - emitidos) <= mineros / 2 || emitidos >= mineros) {
+            return urna;
+        }
+        if (got_signal_SIGINT || got_signal_SIGALARM) {
+            return urna;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &ahora);
+        restante_ms = (limite.tv_sec - ahora.tv_sec) * 1000 + (limite.tv_nsec - ahora.tv_nsec + 999999L) / 1000000L;
+        if (restante_ms <= 0) {
+            return urna;
         }
+        futex_esperar(&segmento->votos_recibidos, recibidos,
+                      restante_ms < ESPERA_FUTEX_MS ? restante_ms : ESPERA_FUTEX_MS);
     }
 }
 
@@ -214,14 +323,23 @@ void enviar_señal(int sig, SharedMemMiner *segmento, pid_t no_enviar){
  * 
  * @param fd_shm Descriptor del segmento de memoria compartida.
  * @param segmento Puntero al segmento de memoria compartida.
- * @param mq Cola de mensajes para la comunicación con el comprobador.
+ * @param transporte Transporte por el que se envían los bloques al comprobador.
+ * @param capacidad Número de casillas del registro de mineros.
+ * @param instantanea Instantánea de la que continuar, o NULL para empezar en el bloque 1.
  */
-bool primer_minero(int fd_shm, SharedMemMiner **segmento, mqd_t *mq){
+bool primer_minero(int fd_shm, SharedMemMiner **segmento, Transporte *transporte, int capacidad, const Instantanea *instantanea){
+    static Monedas restauradas[BLOQUE_MAX_CARTERAS];
+    CabeceraBloque actual, anterior;
+    struct timespec antes, despues;
+    SharedMemMiner disposicion;
+    size_t tamano;
+    int n_restauradas, con_monedas = 0;
+
+    disponer_segmento(&disposicion, capacidad);
+    tamano = disposicion.tamano;
+
     /* Comprobar que el monitor esté activo */
-    *mq = mq_open(QUEUE_NAME, O_RDWR);
-    if (*mq == (mqd_t)-1) {
-        printf("Error al abrir la cola de mensajes\n");
-        perror("Error al abrir la cola");
+    if (transporte_abrir(transporte, ANILLO_NAME, QUEUE_NAME) != 0) {
         return false;
     }
     
@@ -234,14 +352,14 @@ bool primer_minero(int fd_shm, SharedMemMiner **segmento, mqd_t *mq){
 
     /* Iniciar el sistema */
     /* Dar tamaño al segmento de MEM compartida del sistema */
-    if (ftruncate(fd_shm, sizeof(SharedMemMiner)) == -1) {
+    if (ftruncate(fd_shm, tamano) == -1) {
         perror("ftruncate\n");
         fflush(stdout);
         close(fd_shm);
         return false;
     }
     /* Enlazarlo a su espacio de memoria */
-    (*segmento) = mmap(NULL, sizeof(SharedMemMiner), PROT_READ | PROT_WRITE, MAP_SHARED, fd_shm, 0);
+    (*segmento) = mmap(NULL, tamano, PROT_READ | PROT_WRITE, MAP_SHARED, fd_shm, 0);
     close(fd_shm);
     if ((*segmento) == MAP_FAILED) {
         perror("mmap\n");
@@ -284,13 +402,19 @@ bool primer_minero(int fd_shm, SharedMemMiner **segmento, mqd_t *mq){
     }
 
     safe_sem_wait(&(*segmento)->semaforos.mutex, "mutex");
-    for (int i = 0; i < MAX_MINERS; i++) {
-        (*segmento)->pid[i] = -1;
-        (*segmento)->votos_mineros[i].pid = -1;
-        (*segmento)->votos_mineros[i].voto = -1;
-        (*segmento)->monedas_mineros[i].pid = -1;
-        (*segmento)->monedas_mineros[i].monedas = -1;
+    memcpy((*segmento)->magico, REGISTRO_MAGICO, sizeof((*segmento)->magico));
+    disponer_segmento(*segmento, capacidad);
+    /* Todas las casillas libres, encadenadas en orden */
+    for (int i = 0; i < capacidad; i++) {
+        atomic_init(&votos_de(*segmento)[i].voto, VOTO(0, VOTO_EN_CONTRA));
+        atomic_init(&registro_de(*segmento)[i].pid, -1);
+        atomic_init(&registro_de(*segmento)[i].siguiente_libre, (i + 1 < capacidad) ? (uint32_t)(i + 2) : 0);
+        monedas_de(*segmento)[i].pid = -1;
+        monedas_de(*segmento)[i].monedas = -1;
+        enviadas_de(*segmento)[i].pid = -1;
+        enviadas_de(*segmento)[i].monedas = -1;
     }
+    atomic_init(&(*segmento)->libres, LIBRES(0, 0));
     (*segmento)->bloque_anterior.id = -1;
     (*segmento)->bloque_anterior.objetivo = 0;
     (*segmento)->bloque_anterior.solucion = 0;
@@ -303,15 +427,41 @@ bool primer_minero(int fd_shm, SharedMemMiner **segmento, mqd_t *mq){
     (*segmento)->bloque_actual.ganador = -1;
     (*segmento)->bloque_actual.total_votos = -1;
     (*segmento)->bloque_actual.votos_positivos = -1;
+    /* Las rondas empiezan en la época 1, así que ninguna votación coincide con la 0 */
+    atomic_init(&(*segmento)->epoca_ronda, 0);
+    atomic_init(&(*segmento)->epoca_voto, 0);
+    atomic_init(&(*segmento)->cursor_cooperativo, CURSOR(1, 0));
+    atomic_init(&(*segmento)->ronda_resuelta, 0);
+    atomic_init(&(*segmento)->urna, URNA(0, 0, 0));
+    atomic_init(&(*segmento)->votos_recibidos, 0);
+    atomic_init(&(*segmento)->mineros_registrados, 0);
+    /* Con instantánea se sigue desde el último bloque en vez de desde el 1 */
+    clock_gettime(CLOCK_MONOTONIC, &antes);
+    if (instantanea && instantanea_restaurar(instantanea, &actual, &anterior, restauradas, &n_restauradas) == 0) {
+        (*segmento)->bloque_actual = actual;
+        (*segmento)->bloque_anterior = anterior;
+        atomic_init(&(*segmento)->cursor_cooperativo, CURSOR(actual.id, 0));
+        atomic_init(&(*segmento)->ronda_resuelta, actual.id - 1);
+        /* Las casillas siguen libres pero guardan las monedas que hereda quien las tome */
+        for (int i = 0; i < n_restauradas && i < capacidad; i++) {
+            monedas_de(*segmento)[i].monedas = restauradas[i].monedas;
+            con_monedas += restauradas[i].monedas > 0;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &despues);
+        printf("[%d] Restored block %d and %d wallets from the snapshot in %.3f ms\n", getpid(), actual.id,
+               con_monedas, (despues.tv_sec - antes.tv_sec) * 1e3 + (despues.tv_nsec - antes.tv_nsec) / 1e6);
+        fflush(stdout);
+    }
     safe_sem_post(&(*segmento)->semaforos.mutex, "mutex");
+    /* A partir de aquí los demás mineros pueden usar el segmento */
+    atomic_store(&(*segmento)->version, REGISTRO_VERSION);
 
     /* Esperamos 50ms por si se han unido ya mineros para empezar */
     usleep(5 * 1000);
 
-    /* Mandamos SIGUSR1 a los que estén registrados y empezamos la ronda */
+    /* Despertamos a los que estén registrados y empezamos la ronda */
     safe_sem_wait(&(*segmento)->semaforos.mutex_ronda, "mutex_ronda");
-    enviar_señal(SIGUSR1, (*segmento), getpid());
-    got_signal_SIGUSR1 = 1;
+    anunciar_ronda(*segmento);
 
     return true;
 }
@@ -324,15 +474,16 @@ bool primer_minero(int fd_shm, SharedMemMiner **segmento, mqd_t *mq){
  * 
  * @param fd_shm Descriptor del segmento de memoria compartida.
  * @param segmento Puntero al segmento de memoria compartida.
- * @param mq Cola de mensajes para la comunicación con el comprobador.
+ * @param transporte Transporte por el que se envían los bloques al comprobador.
  */
-bool otro_minero(int fd_shm, SharedMemMiner **segmento, mqd_t *mq){
+bool otro_minero(int fd_shm, SharedMemMiner **segmento, Transporte *transporte){
+    struct stat info;
+    uint32_t version;
+    size_t tamano;
+
     usleep(1 * 1000);
     /* Enlazarlo a su espacio de memoria */
-    *mq = mq_open(QUEUE_NAME, O_RDWR);
-    if (*mq == (mqd_t)-1){
-        printf("Error al abrir la cola de mensajes\n");
-        perror("Error al abrir la cola");
+    if (transporte_abrir(transporte, ANILLO_NAME, QUEUE_NAME) != 0) {
         return false;
     }
 
@@ -341,20 +492,40 @@ bool otro_minero(int fd_shm, SharedMemMiner **segmento, mqd_t *mq){
         perror("shm_open");
         return false;
     }
+    /* Esperar a que el primer minero dé tamaño al segmento */
+    while (fstat(fd_shm, &info) == 0 && (size_t)info.st_size < sizeof(SharedMemMiner)) {
+        usleep(1 * 1000);
+    }
+    /* Primero solo la cabecera, que dice el tamaño real */
     *segmento = mmap(NULL, sizeof(SharedMemMiner), PROT_READ | PROT_WRITE, MAP_SHARED, fd_shm, 0);
-    close(fd_shm);
     if (*segmento == MAP_FAILED) {
         perror("mmap\n");
         fflush(stdout);
+        close(fd_shm);
         return false;
     }
     /* Esperar a que el primer minero inicie el sistema */
-    /* Comprobar si se ha inicializado */
-    // safe_sem_wait(&segmento->semaforos.mutex, "mutex"); Solo leo, no hace falta
-    while ((*segmento)->bloque_actual.id <= 0) {
+    while ((version = atomic_load(&(*segmento)->version)) == 0) {
         usleep(1 * 1000);
     }
-    //safe_sem_post(&segmento->semaforos.mutex, "mutex");
+    if (memcmp((*segmento)->magico, REGISTRO_MAGICO, sizeof((*segmento)->magico)) != 0 ||
+        version != REGISTRO_VERSION) {
+        printf("El segmento %s no es de la versión %d de la red de mineros\n", SHM_NAME, REGISTRO_VERSION);
+        munmap(*segmento, sizeof(SharedMemMiner));
+        close(fd_shm);
+        return false;
+    }
+    tamano = (*segmento)->tamano;
+    munmap(*segmento, sizeof(SharedMemMiner));
+    *segmento = mmap(NULL, tamano, PROT_READ | PROT_WRITE, MAP_SHARED, fd_shm, 0);
+    close(fd_shm);
+    if (*segmento == MAP_FAILED) {
+        perror("mmap\n");
+        fflush(stdout);
+        return false;
+    }
+    /* Las rondas ya anunciadas no son para este minero; espera a la siguiente */
+    ronda_vista = atomic_load(&(*segmento)->epoca_ronda);
     return true;
 }
 
@@ -368,117 +539,114 @@ bool otro_minero(int fd_shm, SharedMemMiner **segmento, mqd_t *mq){
  * 
  * @param solucion Solución encontrada por el minero.
  * @param wallet Puntero al wallet del minero.
- * @param mq Cola de mensajes para la comunicación con el comprobador.
+ * @param transporte Transporte por el que se envían los bloques al comprobador.
  * @param segmento Segmento de memoria compartida del sistema.
+ * @param opciones Opciones del minero: plazo de la votación y formato de las carteras.
  */
-bool ganador(int solucion, int *wallet, mqd_t mq, SharedMemMiner **segmento){
-    int mineros = 0;
-    int espera_maxima = 0;
-    Bloque envio = {0};  // inicializa todo a cero
-    bool terminado = false;
+bool ganador(int solucion, int *wallet, Transporte *transporte, SharedMemMiner **segmento, const OpcionesMinero *opciones){
+    /* Carteras del bloque: estáticas por tamaño, solo las usa el hilo principal */
+    static Monedas vista[MAX_MINERS], completas[MAX_MINERS], cambios[2 * MAX_MINERS];
+    EntradaRegistro *registro = registro_de(*segmento);
+    Monedas *monedas = monedas_de(*segmento);
+    Monedas *enviadas = enviadas_de(*segmento);
+    char mensaje[BLOQUE_MAX_BYTES];
+    int n_completas = 0, n_cambios = 0, n_casillas = 0;
+    size_t bytes;
+    int mineros, ronda = (*segmento)->bloque_actual.id;
+    uint64_t urna, antes;
 
     /* Introduce la solución al bloque actual y vota (obviamente a favor) */
     safe_sem_wait(&(*segmento)->semaforos.mutex, "mutex");
-    /* Establecer todos los votos a 0 */
-    for (int i = 0; i < MAX_MINERS; i++) {
-        (*segmento)->votos_mineros[i].voto = 0;
-    }
     (*segmento)->bloque_actual.solucion = solucion;
     (*segmento)->bloque_actual.ganador = getpid();
-    for (int i = 0; i < MAX_MINERS && !terminado; i++) {
-            if ((*segmento)->votos_mineros[i].pid == getpid()){
-                (*segmento)->votos_mineros[i].voto = 1;
-                terminado = true;
-            }
-        }
     safe_sem_post(&(*segmento)->semaforos.mutex, "mutex");
-    /* Enviar la señal SIGUSR2 a todos los mineros */
-    enviar_señal(SIGUSR2, (*segmento), getpid());
-    /* Contar mineros registrados */
-    for (int i = 0; i < MAX_MINERS; i++) {
-        if ((*segmento)->pid[i] != -1) {
-            mineros++;
-        }
-    }
-    usleep(1 * 1000);
+    atomic_store(&votos_de(*segmento)[mi_casilla].voto, VOTO(ronda_vista, VOTO_A_FAVOR));
+    eventos_anotar(eventos, EVENTO_VOTO, ronda, 1);
+    /* Abrir la votación para todos los mineros */
+    anunciar_votacion(*segmento);
+    traza_cruzar(traza, ronda, MARCA_VOTACION, FASE_VOTACION, MARCA_GANADOR);
+    mineros = atomic_load(&(*segmento)->mineros_registrados);
     safe_sem_post(&(*segmento)->semaforos.ganador, "ganador");
-    /* Esperar a que todos los mineros voten */
-    while((*segmento)->bloque_actual.total_votos < mineros && espera_maxima < 500){
-        usleep(1 * 1000);
-        espera_maxima++;
-    }
+    /* Esperar a que la votación quede decidida */
+    antes = metricas_instante(metricas);
+    urna = esperar_votos(*segmento, mineros, opciones->plazo_votacion_ms);
+    metricas_sumar(metricas, MET_ESPERA_VOTOS, metricas_instante(metricas) - antes);
+    traza_cruzar(traza, ronda, MARCA_VOTOS, FASE_VOTOS, MARCA_VOTACION);
+    eventos_anotar(eventos, EVENTO_VOTOS, ronda, URNA_APROBADOS(urna));
 
     /* Contar votos */
     safe_sem_wait(&(*segmento)->semaforos.mutex, "mutex");
-    (*segmento)->bloque_actual.votos_positivos = 0;
-    (*segmento)->bloque_actual.total_votos = 0;
-    for (int i = 0; i < MAX_MINERS; i++) {
-        if ((*segmento)->votos_mineros[i].voto == 1) {
-            (*segmento)->bloque_actual.votos_positivos++;
-        }
-        if ((*segmento)->votos_mineros[i].pid != -1 && (*segmento)->votos_mineros[i].voto != -1) {
-            (*segmento)->bloque_actual.total_votos++;
-        }
-    }
+    (*segmento)->bloque_actual.votos_positivos = URNA_APROBADOS(urna);
+    (*segmento)->bloque_actual.total_votos = URNA_EMITIDOS(urna);
     /* Si es aprobado se añade una moneda */
     if ((*segmento)->bloque_actual.votos_positivos > mineros / 2){
         /* Añadir monedas al wallet */
-        for (int i = 0; i < MAX_MINERS; i++) {
-            if ((*segmento)->monedas_mineros[i].pid == getpid()) {
-                (*segmento)->monedas_mineros[i].monedas++;
-                (*wallet)++;
-            }
-        }
+        monedas_de(*segmento)[mi_casilla].monedas++;
+        (*wallet)++;
         (*segmento)->bloque_actual.correcto = true;
     }
     else {
         (*segmento)->bloque_actual.correcto = false;
     }
-    for (int i = 0; i < MAX_MINERS; i++) {
-        (*segmento)->bloque_actual.monedas_mineros[i].pid = (*segmento)->monedas_mineros[i].pid; 
-        (*segmento)->bloque_actual.monedas_mineros[i].monedas = (*segmento)->monedas_mineros[i].monedas;
-    }
-    /* Envia el bloque por la cola de mensajes al comprobador */
-    /* Rellenar el bloque con datos a enviar */
-    envio.id            = (*segmento)->bloque_actual.id;
-    envio.objetivo      = (*segmento)->bloque_actual.objetivo;
-    envio.solucion      = (*segmento)->bloque_actual.solucion;
-    envio.ganador       = (*segmento)->bloque_actual.ganador;
-    for (int i = 0; i < MAX_MINERS; i++) {
-        if ((*segmento)->votos_mineros[i].voto != -1) {
-            envio.monedas_mineros[i].pid     = (*segmento)->monedas_mineros[i].pid;
-            envio.monedas_mineros[i].monedas = (*segmento)->monedas_mineros[i].monedas;
+    /* Envia el bloque por la cola de mensajes al comprobador, solo con las carteras vivas
+     * o, en modo delta, con las que han cambiado desde el último bloque enviado */
+    for (uint32_t i = 0; i < (*segmento)->capacidad; i++) {
+        vista[i].pid = -1;
+        vista[i].monedas = -1;
+        if (atomic_load_explicit(&registro[i].pid, memory_order_acquire) != -1) {
+            vista[i] = monedas[i];
+            completas[n_completas++] = vista[i];
+        }
+        /* La instantánea va por casillas hasta la última con monedas, ocupada o por heredar */
+        if (monedas[i].monedas > 0) {
+            n_casillas = (int)i + 1;
+        }
+        if (enviadas[i].pid != -1 && enviadas[i].pid != vista[i].pid) {
+            cambios[n_cambios].pid = enviadas[i].pid;
+            cambios[n_cambios++].monedas = BLOQUE_BAJA;
+        }
+        if (vista[i].pid != -1 && (vista[i].pid != enviadas[i].pid || vista[i].monedas != enviadas[i].monedas)) {
+            cambios[n_cambios++] = vista[i];
         }
     }
-    envio.total_votos     = (*segmento)->bloque_actual.total_votos;
-    envio.votos_positivos = (*segmento)->bloque_actual.votos_positivos;
-    /* Enviar el bloque completo */
-    if (mq_send(mq, (const char*)&envio, sizeof(Bloque), 0) == -1) {
-        perror("Error en mq_send");
-        mq_close(mq);
+    if (opciones->carteras_delta && n_cambios < n_completas) {
+        bytes = bloque_codificar(&(*segmento)->bloque_actual, BLOQUE_DELTA, cambios, n_cambios, mensaje);
+    } else {
+        bytes = bloque_codificar(&(*segmento)->bloque_actual, BLOQUE_COMPLETO, completas, n_completas, mensaje);
+    }
+    /* Se marca antes de enviar: el comprobador puede validarlo antes de que vuelva el envío */
+    traza_cruzar(traza, ronda, MARCA_ENVIO, FASE_ENVIO, MARCA_VOTOS);
+    eventos_anotar(eventos, EVENTO_ENVIO, ronda, (int64_t)bytes);
+    if (transporte_enviar(transporte, mensaje, bytes) == -1) {
+        perror("Error al enviar el bloque");
+        transporte_cerrar(transporte);
         return false;
     }    
+    metricas_sumar(metricas, MET_GANADAS, 1);
+    /* El comprobador ya conoce estas carteras: son la base del siguiente delta */
+    memcpy(enviadas, vista, (*segmento)->capacidad * sizeof(Monedas));
     /* Prepara la siguiente ronda */
     /* Desecha el último bloque, el bloque actual pasa a ser el último y crea uno nuevo */
     /* Establece como objetivo la solucion anterior */
     (*segmento)->bloque_anterior = (*segmento)->bloque_actual;
     (*segmento)->bloque_actual.id++;
+    atomic_store(&(*segmento)->cursor_cooperativo, CURSOR((*segmento)->bloque_actual.id, 0));
     (*segmento)->bloque_actual.objetivo = (*segmento)->bloque_anterior.solucion;
     (*segmento)->bloque_actual.solucion = pow_hash((*segmento)->bloque_actual.solucion);
     (*segmento)->bloque_actual.ganador = getpid();
     (*segmento)->bloque_actual.correcto = false;
     (*segmento)->bloque_actual.total_votos = 0;
     (*segmento)->bloque_actual.votos_positivos = 0;
-    for (int i = 0; i < MAX_MINERS; i++) {
-        if ((*segmento)->votos_mineros[i].pid != -1) {
-            (*segmento)->votos_mineros[i].voto = 0;
-        }
+    /* Un primer minero arrancado después puede seguir desde aquí */
+    if (opciones->instantanea) {
+        instantanea_guardar(opciones->instantanea, &(*segmento)->bloque_actual, &(*segmento)->bloque_anterior,
+                            monedas, n_casillas);
     }
     safe_sem_post(&(*segmento)->semaforos.mutex, "mutex");
     usleep(1 * 1000); // Esperar 25ms para que los mineros se preparen
-    /* Enviar la señal SIGUSR1 a los mineros */
-    enviar_señal(SIGUSR1, (*segmento), getpid());
-    got_signal_SIGUSR1 = 1;
+    /* Abrir la siguiente ronda */
+    anunciar_ronda(*segmento);
+    traza_fase(traza, FASE_CIERRE, traza_marca(traza, ronda, MARCA_ENVIO), traza_marca(traza, ronda + 1, MARCA_RONDA));
 
     return true;
 }
@@ -487,177 +655,200 @@ bool ganador(int solucion, int *wallet, mqd_t mq, SharedMemMiner **segmento){
 /**
  * @brief Función que gestiona la salida de un minero del sistema.
  * 
- * Si el minero no es el ganador, se registra su voto y se espera a la señal SIGUSR1 
- * para comenzar una nueva ronda.
+ * Si el minero no es el ganador, espera a que se abra la votación, registra su voto y
+ * vuelve para esperar el inicio de una nueva ronda.
  * 
  * @param segmento Segmento de memoria compartida del sistema.
  * @return true si el minero sigue en el sistema, false si ha terminado.
  */
 bool perdedor(SharedMemMiner **segmento){
-    sigset_t emptymask;
-    bool terminado = false;
-    /* Esperar a que el ganador envíe la señal SIGUSR2 */
-    sigfillset(&emptymask);
-    sigdelset(&emptymask, SIGUSR2);
-    sigdelset(&emptymask, SIGINT);
-    sigdelset(&emptymask, SIGALRM);
+    bool a_favor;
 
-    /* Esperar SIGUSR2 para comenzar */
-    /* Si se recibe SIGUSR2 se terminan todos los hilos y se pasa a la votación */
-    while(!got_signal_SIGUSR2 && !got_signal_SIGINT && !got_signal_SIGALARM){
-        sigsuspend(&emptymask);
-    }
-    got_signal_SIGUSR2 = 0;
-
-    if (got_signal_SIGINT || got_signal_SIGALARM) {
+    metricas_sumar(metricas, MET_PERDIDAS, 1);
+    /* Esperar a que el ganador abra la votación de esta ronda */
+    if (!esperar_epoca(&(*segmento)->epoca_voto, ronda_vista)) {
         return false;
     }
+    if (atomic_load(&(*segmento)->epoca_voto) != ronda_vista) {
+        /* La votación de esta ronda ya se cerró y empezó otra: el voto no contaría */
+        return true;
+    }
 
-    usleep(1 * 1000); // Esperar 1ms para que los mineros se preparen
-    /* Comprueba el bloque actual y vota */
+    /* Comprueba el bloque actual y vota en su propia casilla, sin semáforos: el ganador
+     * escribió la solución antes de abrir la votación y no la cambia hasta cerrarla */
+    a_favor = (*segmento)->bloque_actual.objetivo == pow_hash((*segmento)->bloque_actual.solucion);
+    depositar_voto(*segmento, a_favor);
+    eventos_anotar(eventos, EVENTO_VOTO, (*segmento)->bloque_actual.id, a_favor);
+    metricas_sumar(metricas, MET_VOTOS, 1);
+    /* Vuelve a minero(), que espera en el futex de ronda hasta la siguiente */
+    return true;
+}
 
-    safe_sem_wait(&(*segmento)->semaforos.mutex, "mutex");
+/* Red y bloque que se están minando cuando el minero trabaja en modo cooperativo */
+static SharedMemMiner *red_cooperativa = NULL;
+static int ronda_cooperativa = 0;
 
-    if ((*segmento)->bloque_actual.objetivo == pow_hash((*segmento)->bloque_actual.solucion)){
-        for (int i = 0; i < MAX_MINERS && !terminado; i++) {
-            if ((*segmento)->votos_mineros[i].pid == getpid()){
-                (*segmento)->votos_mineros[i].voto = 1;
-                terminado = true;
-            }
-        }
-        
-    }
-    else {
-        // Perdedor vota NO (0) en su propia casilla
-        for (int i = 0; i < MAX_MINERS && !terminado; i++) {
-            if ((*segmento)->votos_mineros[i].pid == getpid()) {
-                (*segmento)->votos_mineros[i].voto = 0;
-                terminado = true;
-            }
-        }
+/**
+ * @brief Indica a los hilos mineros si deben abandonar la ronda en curso.
+ * 
+ * @return true si se ha abierto la votación, se ha recibido SIGINT o SIGALRM o, en modo
+ * cooperativo, si otro minero ya ha encontrado la solución del bloque.
+ */
+bool parar_minado(void) {
+    if (red_cooperativa &&
+        atomic_load_explicit(&red_cooperativa->ronda_resuelta, memory_order_relaxed) >= ronda_cooperativa) {
+        return true;
     }
-    safe_sem_post(&(*segmento)->semaforos.mutex, "mutex");
-    /* Entra en espera no activa hasta recibir SIGUSR1 para una nueva ronda */
-    return true;
+    return votacion_abierta() || got_signal_SIGALARM || got_signal_SIGINT;
 }
 
 /**
- * @brief Función que ejecuta un hilo minero.
+ * @brief Reclama un tramo del cursor compartido por los mineros cooperativos.
  * 
- * Cada hilo busca una solución dentro de su rango asignado. Si encuentra una coincidencia 
- * con el valor objetivo, actualiza la variable compartida de solución y termina la ejecución.
+ * El cursor lleva el id del bloque al que pertenece, así que un minero rezagado de la
+ * ronda anterior no puede consumir nonces de la nueva.
  * 
- * @param data Puntero a una estructura ThreadData con los datos del hilo.
- * @return NULL siempre.
+ * @param ctx Segmento de memoria compartida del sistema.
+ * @param tramo Número de nonces a reclamar.
+ * @param inicio Primer nonce del tramo reclamado.
+ * @param fin Fin del tramo reclamado (no incluido).
+ * @return true si se ha reclamado un tramo, false si el cursor está agotado o es de otra ronda.
  */
-void *miner_thread(void *data) {
-    int i;
-    long int end, target;
-    ThreadData *thread_data;
+bool reclamar_cooperativo(void *ctx, long int tramo, long int *inicio, long int *fin) {
+    SharedMemMiner *segmento = (SharedMemMiner *)ctx;
+    uint64_t cursor;
+    long int siguiente;
+
+    cursor = atomic_load(&segmento->cursor_cooperativo);
+    do {
+        if (CURSOR_RONDA(cursor) != ronda_cooperativa) {
+            return false;
+        }
+        siguiente = CURSOR_NONCE(cursor);
+        if (siguiente >= POW_LIMIT) {
+            return false;
+        }
+        *fin = (POW_LIMIT - siguiente > tramo) ? siguiente + tramo : POW_LIMIT;
+    } while (!atomic_compare_exchange_weak(&segmento->cursor_cooperativo, &cursor,
+                                           CURSOR(ronda_cooperativa, *fin)));
 
-    thread_data = (ThreadData *)data;
+    *inicio = siguiente;
+    return true;
+}
 
-    end = thread_data->end;
-    target = thread_data->target;
-    for (i = thread_data->start; i < end; i++) {
-        if (pow_hash(i) == target) {
-            *(thread_data->found) = 1;
-            *(thread_data->solution) = i;
+/**
+ * @brief Registra al minero en una casilla libre del registro, en O(1).
+ * 
+ * @param segmento Segmento de memoria compartida del sistema.
+ * @param wallet Monedas con las que entra el minero; se le suman las que herede la casilla.
+ * @return true si se ha registrado, false si no queda ninguna casilla libre.
+ */
+bool registrar(SharedMemMiner *segmento, int *wallet) {
+    int heredadas;
 
-            return NULL;
-        }
-        if (*(thread_data->found) == 1)
-            return NULL;
+    mi_casilla = tomar_casilla(segmento);
+    if (mi_casilla == -1) {
+        return false;
+    }
+    /* Una casilla libre solo guarda monedas si la red se ha restaurado de una instantánea */
+    heredadas = monedas_de(segmento)[mi_casilla].monedas;
+    if (heredadas > 0) {
+        *wallet += heredadas;
+    }
+    monedas_de(segmento)[mi_casilla].pid = getpid();
+    monedas_de(segmento)[mi_casilla].monedas = *wallet;
+    atomic_store(&votos_de(segmento)[mi_casilla].voto, VOTO(0, VOTO_EN_CONTRA));
+    /* El pid se publica el último: quien lo ve ocupado ya ve la cartera */
+    atomic_store(&registro_de(segmento)[mi_casilla].pid, getpid());
+    atomic_fetch_add(&segmento->mineros_registrados, 1);
+    return true;
+}
 
-        if (got_signal_SIGUSR2) {
-            *(thread_data->found) = -1;
-            *(thread_data->solution) = -1;
-            return NULL;
-        }
+/**
+ * @brief Fija cada hilo del pool a una CPU según la topología y la ocupación de la red.
+ *
+ * @param pool Pool de hilos ya creado.
+ * @param segmento Segmento de la red, con la ocupación de las CPUs.
+ * @param cpus CPU de cada hilo, o -1 si se queda sin fijar.
+ */
+static void colocar_hilos(PoolMineros *pool, SharedMemMiner *segmento, int *cpus) {
+    Topologia topologia;
+    int fijados = 0;
 
-        if (got_signal_SIGALARM || got_signal_SIGINT) {
-            *(thread_data->found) = -1;
-            *(thread_data->solution) = -1;
-            return NULL;
-        }   
+    for (int j = 0; j < pool->n_hilos; j++) {
+        cpus[j] = -1;
     }
-
-    return NULL;
+    if (afinidad_detectar(&topologia) != 0) {
+        printf("[%d] Unknown CPU topology, threads are not pinned\n", getpid());
+        fflush(stdout);
+        return;
+    }
+    for (int j = 0; j < pool->n_hilos; j++) {
+        cpus[j] = afinidad_colocar(&topologia, &segmento->ocupacion_cpus, pool->hilos[j]);
+        fijados += cpus[j] != -1;
+        if (metricas) {
+            metricas_fijar_cpu(metricas, j, cpus[j]);
+        }
+    }
+    printf("[%d] Pinned %d of %d threads over %d CPUs (%d allowed, %d cores, %d L3 domains)\n", getpid(), fijados,
+           pool->n_hilos, topologia.n_cpus, topologia.permitidas, topologia.nucleos, topologia.dominios_l3);
+    fflush(stdout);
 }
 
 /**
  * @brief Función principal del proceso minero.
  * 
- * Inicializa la minería dividiendo el trabajo entre múltiples hilos, gestiona la comunicación 
+ * Reparte la minería entre los hilos del pool, gestiona la comunicación 
  * con el monitor y verifica los resultados obtenidos.
  * 
- * @param N_THREADS Número de hilos a crear para la minería.
- * @param mq Cola de mensajes para la comunicación con el comprobador.
+ * @param pool Pool de hilos mineros creado en main().
+ * @param opciones Opciones de línea de comandos del minero.
+ * @param transporte Transporte por el que se envían los bloques al comprobador.
  * @param segmento Segmento de memoria compartida para la comunicación con el monitor.
  * @param wallet Puntero al wallet del minero.
  */
-int minero(int N_THREADS, mqd_t mq, SharedMemMiner **segmento, int *wallet) {
-    long int target, range, solution;
-    sigset_t emptymask;
-    pthread_t *threads;
-    ThreadData *thread_data;
-    int found, j;
-    bool registrado = false;
+int minero(PoolMineros *pool, const OpcionesMinero *opciones, Transporte *transporte, SharedMemMiner **segmento, int *wallet) {
+    long int solution, objetivo;
+    uint64_t despertar, inicio, encontrada = 0, tomado, antes;
+    int found, ronda;
 
     /* Verifico que no esté en la tabla */
-    for (int i = 0; i < MAX_MINERS; i++) {
-        if ((*segmento)->pid[i] == getpid()) {
-            registrado = true;
-        }
-    }
-
-    if (!registrado) {
+    if (mi_casilla == -1) {
         safe_sem_wait(&(*segmento)->entry_mutex, "entry_mutex");
         if ((*segmento)->can_enter) {
             // se registra inmediatamente
-            for (int i = 0; i < MAX_MINERS; i++) {
-                if ((*segmento)->pid[i] == -1) {
-                    (*segmento)->pid[i]                = getpid();
-                    (*segmento)->votos_mineros[i].pid  = getpid();
-                    (*segmento)->votos_mineros[i].voto = -1;
-                    (*segmento)->monedas_mineros[i].pid= getpid();
-                    (*segmento)->monedas_mineros[i].monedas = *wallet;
-                    break;
-                }
-            }
             safe_sem_post(&(*segmento)->entry_mutex, "entry_mutex");
         } else {
             // ronda ya empezó, cuenta y espera
             (*segmento)->waiters_count++;
             safe_sem_post(&(*segmento)->entry_mutex, "entry_mutex");
-            safe_sem_wait(&(*segmento)->entry_gate, "entry_gate");
-            // al despertar, se registra
-            for (int i = 0; i < MAX_MINERS; i++) {
-                if ((*segmento)->pid[i] == -1) {
-                    (*segmento)->pid[i]                = getpid();
-                    (*segmento)->votos_mineros[i].pid  = getpid();
-                    (*segmento)->votos_mineros[i].voto = -1;
-                    (*segmento)->monedas_mineros[i].pid= getpid();
-                    (*segmento)->monedas_mineros[i].monedas = *wallet;
-                    break;
-                }
+            if (!safe_sem_wait(&(*segmento)->entry_gate, "entry_gate")) {
+                return 0;
             }
         }
+        // al entrar, se registra
+        if (!registrar(*segmento, wallet)) {
+            printf("[%d] No free slot in the network, leaving\n", getpid());
+            fflush(stdout);
+            /* Sale ordenadamente, como si se hubiera recibido SIGINT */
+            got_signal_SIGINT = 1;
+            return 0;
+        }
     }
 
     /* PARTE COMUN 1) */
-    /* Esperar a que el primer minero envíe la señal SIGUSR1 */
-    /* Enmascarar señales que no sean las esperadas */
-    sigfillset(&emptymask);
-    sigdelset(&emptymask, SIGUSR1);
-    sigdelset(&emptymask, SIGINT);
-    sigdelset(&emptymask, SIGALRM);
-
-    /* Esperar SIGUSR1 para comenzar */
-    while(!got_signal_SIGUSR1 && !got_signal_SIGINT && !got_signal_SIGALARM){
-        sigsuspend(&emptymask);
+    /* Esperar a que se abra una ronda posterior a la última jugada */
+    antes = metricas_instante(metricas);
+    if (!esperar_epoca(&(*segmento)->epoca_ronda, ronda_vista + 1)) {
+        return 0;
     }
-    got_signal_SIGUSR1 = 0;
+    metricas_sumar(metricas, MET_ESPERA_RONDA, metricas_instante(metricas) - antes);
+    metricas_sumar(metricas, MET_RONDAS, 1);
+    despertar = traza_instante(traza);
+    ronda_vista = atomic_load(&(*segmento)->epoca_ronda);
+    ronda = (*segmento)->bloque_actual.id;
+    eventos_anotar(eventos, EVENTO_DESPERTAR, ronda, ronda_vista);
+    traza_fase(traza, FASE_DESPERTAR, traza_marca(traza, ronda, MARCA_RONDA), despertar);
 
     usleep(10 * 1000); // Esperar 10ms para que los mineros se preparen
 
@@ -671,97 +862,78 @@ int minero(int N_THREADS, mqd_t mq, SharedMemMiner **segmento, int *wallet) {
         return 0;
     }
 
-    if (N_THREADS < 1) {
-        return 1;
-    }
-
-    if (N_THREADS > MAX_THREADS) {
-        fprintf(stderr, "Error: Number of threads exceeded\n");
-        fflush(stdout);
-        return 1;
-    }
-
-    threads = (pthread_t *)malloc(sizeof(pthread_t) * N_THREADS);
-    if (!threads) {
-        perror("malloc() threads failure\n");
-        fflush(stdout);
-        return 1;
-    }
-    thread_data = (ThreadData *)malloc(sizeof(ThreadData) * N_THREADS);
-    if (!thread_data) {
-        perror("malloc() thread_data failure\n");
-        fflush(stdout);
-        free(threads);
-        return 1;
-    }
-
     /* ---PROCESO MINERO--- */
     printf("[%d] Generating blocks...\n", getpid());
     fflush(stdout);
 
 
-    found = 0;
-    solution = -1;
-    range = POW_LIMIT / N_THREADS;
-    target = (*segmento)->bloque_actual.objetivo;
-
-    for (j = 0; j < N_THREADS; j++) {
-        thread_data[j].start = j * range;
-        thread_data[j].end = (j == N_THREADS - 1) ? POW_LIMIT : (j + 1) * range;
-        thread_data[j].target = target;
-        thread_data[j].solution = &solution;
-        thread_data[j].found = &found;
-
-        pthread_create(&threads[j], NULL, miner_thread, &thread_data[j]);
+    /* Los hilos del pool ya existen, solo se les entrega el nuevo objetivo */
+    objetivo = (*segmento)->bloque_actual.objetivo;
+    inicio = traza_instante(traza);
+    traza_fase(traza, FASE_ARRANQUE, despertar, inicio);
+    if (opciones->tabla) {
+        /* Modo tabla: la solución se consulta en O(1), sin búsqueda */
+        solution = tabla_pow_buscar(opciones->tabla, objetivo);
+        found = (solution != -1) ? 1 : 0;
+    } else if (opciones->cooperativo) {
+        red_cooperativa = *segmento;
+        ronda_cooperativa = (*segmento)->bloque_actual.id;
+        found = pool_minar(pool, objetivo, reclamar_cooperativo, *segmento, &solution);
+        if (found == 0) {
+            /* Cursor agotado sin solución: se perdió algún tramo, se recorre todo el rango */
+            found = pool_minar(pool, objetivo, NULL, NULL, &solution);
+        }
+    } else {
+        found = pool_minar(pool, objetivo, NULL, NULL, &solution);
     }
-
-    for (j = 0; j < N_THREADS; j++) {
-        pthread_join(threads[j], NULL);
+    if (found == 1) {
+        encontrada = traza_instante(traza);
+        traza_fase(traza, FASE_MINADO, inicio, encontrada);
+        eventos_anotar(eventos, EVENTO_SOLUCION, ronda, solution);
+        /* Los mineros cooperativos dejan de reclamar tramos de este bloque */
+        atomic_store(&(*segmento)->ronda_resuelta, (*segmento)->bloque_actual.id);
     }
 
     if (got_signal_SIGINT || got_signal_SIGALARM) {
-        free(thread_data);
-        free(threads);
         return 0;
     }
 
     /* Si se obtiene la solución trata de convertirse en GANADOR usando los semaforos */
-    if (found) {
-        safe_sem_wait(&(*segmento)->semaforos.ganador, "ganador");
-        if (got_signal_SIGUSR2) {
+    if (found == 1) {
+        if (!safe_sem_wait(&(*segmento)->semaforos.ganador, "ganador")) {
+            /* Interrumpido por SIGINT o SIGALRM sin el semáforo: no puede proponer el bloque */
+            return 0;
+        }
+        tomado = traza_instante(traza);
+        traza_fase(traza, FASE_SEMAFORO, encontrada, tomado);
+        if (votacion_abierta()) {
             /* He perdido, no soy el ganador*/
             safe_sem_post(&(*segmento)->semaforos.ganador, "ganador");
             if (!perdedor(segmento)) {
-                free(thread_data);
-                free(threads);
-                return 1;
-            }       
+                /* Interrumpido por SIGINT o SIGALRM: sale ordenadamente desde main() */
+                return 0;
+            }
         }
-        /* Soy el ganador */
+        /* Soy el ganador; ganador() libera el semáforo en cuanto abre la votación */
         else {
-            if (!ganador(solution, wallet, mq, segmento)) {
-                free(thread_data);
-                free(threads);
-                safe_sem_post(&(*segmento)->semaforos.ganador, "ganador");
+            traza_marcar(traza, ronda, MARCA_SOLUCION, encontrada);
+            traza_marcar(traza, ronda, MARCA_GANADOR, tomado);
+            if (!ganador(solution, wallet, transporte, segmento, opciones)) {
                 return 1;
             }
         }
-        safe_sem_post(&(*segmento)->semaforos.ganador, "ganador");
     }
 
     if (got_signal_SIGINT || got_signal_SIGALARM) {
-        free(thread_data);
-        free(threads);
         return 0;
     }
 
-    if (got_signal_SIGUSR2) {
+    if (found != 1) {
         /* He perdido, no soy el ganador*/
         if (!perdedor(segmento)) {
-            free(thread_data);
-            free(threads);
-            return 1;
-        }       
+            /* Interrumpido por SIGINT o SIGALRM: sale ordenadamente desde main() */
+            return 0;
+        }
     }
 
     safe_sem_wait(&(*segmento)->entry_mutex, "entry_mutex");
@@ -771,26 +943,83 @@ int minero(int N_THREADS, mqd_t mq, SharedMemMiner **segmento, int *wallet) {
     }
     (*segmento)->waiters_count = 0;
     safe_sem_post(&(*segmento)->entry_mutex, "entry_mutex");
-    
-    free(thread_data);
-    free(threads);
+
     return 0;
 }
 
 int main(int argc, char const *argv[]) {
     SharedMemMiner *segmento = NULL;
-    mqd_t mq;
+    PoolMineros pool;
+    OpcionesMinero opciones = {0};
+    TablaPow tabla;
+    Instantanea instantanea;
+    Traza traza_minero;
+    Eventos eventos_minero;
+    int cpus_hilos[MAX_THREADS];
+    Metricas metricas_minero;
+    Transporte transporte = {.mq = (mqd_t)-1};
     int n_hilos, n_seconds;
     int fd_shm;
     int wallet = 0;
 
-    if (argc != 3)
+    opciones.plazo_votacion_ms = PLAZO_VOTACION_MS;
+    opciones.capacidad = MAX_MINERS;
+    if (argc < 3)
     {
         printf("\nError en parametros\n");
+        printf("Uso: %s <segundos> <hilos> [--cooperativo] [--tabla <fichero>] [--plazo-votacion <ms>] [--capacidad <mineros>] [--carteras-delta] [--instantanea <fichero>] [--traza] [--eventos <directorio>] [--afinidad]\n", argv[0]);
         fflush(stdout);
         exit(EXIT_FAILURE);
     }
 
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--cooperativo") == 0) {
+            opciones.cooperativo = true;
+        } else if (strcmp(argv[i], "--tabla") == 0 && i + 1 < argc) {
+            if (tabla_pow_abrir(&tabla, argv[++i]) != 0) {
+                exit(EXIT_FAILURE);
+            }
+            opciones.tabla = &tabla;
+        } else if (strcmp(argv[i], "--plazo-votacion") == 0 && i + 1 < argc) {
+            opciones.plazo_votacion_ms = atol(argv[++i]);
+            if (opciones.plazo_votacion_ms <= 0) {
+                printf("\nEl plazo de votación debe ser superior a 0 ms.\n");
+                fflush(stdout);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--afinidad") == 0) {
+            opciones.afinidad = true;
+        } else if (strcmp(argv[i], "--carteras-delta") == 0) {
+            opciones.carteras_delta = true;
+        } else if (strcmp(argv[i], "--instantanea") == 0 && i + 1 < argc) {
+            if (instantanea_abrir(&instantanea, argv[++i]) != 0) {
+                exit(EXIT_FAILURE);
+            }
+            opciones.instantanea = &instantanea;
+        } else if (strcmp(argv[i], "--traza") == 0) {
+            if (traza_abrir(&traza_minero) != 0) {
+                exit(EXIT_FAILURE);
+            }
+            traza = &traza_minero;
+        } else if (strcmp(argv[i], "--eventos") == 0 && i + 1 < argc) {
+            if (eventos_abrir(&eventos_minero, argv[++i], EVENTOS_MINERO) != 0) {
+                exit(EXIT_FAILURE);
+            }
+            eventos = &eventos_minero;
+        } else if (strcmp(argv[i], "--capacidad") == 0 && i + 1 < argc) {
+            opciones.capacidad = atoi(argv[++i]);
+            if (opciones.capacidad <= 0 || opciones.capacidad > MAX_MINERS) {
+                printf("\nLa capacidad debe ser superior a 0 y no mayor a %d mineros.\n", MAX_MINERS);
+                fflush(stdout);
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            printf("\nOpción desconocida: %s\n", argv[i]);
+            fflush(stdout);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     n_seconds = atoi(argv[1]);
     if (n_seconds <= 0)
     {
@@ -799,19 +1028,32 @@ int main(int argc, char const *argv[]) {
         exit(EXIT_FAILURE);
     }
     n_hilos = atoi(argv[2]);
-    if (n_hilos <= 0 && n_hilos > MAX_THREADS)
+    if (n_hilos <= 0 || n_hilos > MAX_THREADS)
     {
         printf("\nEl número de hilos debe ser superior a 0 y no mayor a %d\n", MAX_THREADS);
         fflush(stdout);
         exit(EXIT_FAILURE);
     }
 
+    /* Los hilos mineros se crean una sola vez y se reutilizan en todas las rondas */
+    if (pool_crear(&pool, n_hilos, parar_minado) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    /* Sin segmento de métricas el minero sigue, solo que no publica sus contadores */
+    if (metricas_abrir(&metricas_minero, PROCESO_MINERO, n_hilos) == 0) {
+        metricas = &metricas_minero;
+        for (int j = 0; j < n_hilos; j++) {
+            pool_contar_hashes(&pool, j, metricas_hashes(metricas, j));
+        }
+    }
+    sincro_configurar(metricas, senal_recibida);
+
     /* Configurar señales */
     /* Establecer alarma */
     /* Configurar handlers y mascaras*/
     if (setup_signals() == EXIT_FAILURE) {
-        mq_close(mq);
-        mq_unlink(QUEUE_NAME);
+        transporte_cerrar(&transporte);
+        transporte_borrar(&transporte);
         shm_unlink(SHM_NAME);
         exit(EXIT_FAILURE);
     }
@@ -823,9 +1065,9 @@ int main(int argc, char const *argv[]) {
         if (errno == EEXIST){
             /* Ya existía el fichero*/
             /* Me he unido al sistema */
-            if(!otro_minero(fd_shm, &segmento, &mq)){
-                mq_close(mq);
-                mq_unlink(QUEUE_NAME);
+            if(!otro_minero(fd_shm, &segmento, &transporte)){
+                transporte_cerrar(&transporte);
+                transporte_borrar(&transporte);
                 shm_unlink(SHM_NAME);
                 exit(EXIT_FAILURE);
             }
@@ -833,30 +1075,35 @@ int main(int argc, char const *argv[]) {
         else {
             perror("shm_open\n");
             fflush(stdout);
-            mq_close(mq);
-            mq_unlink(QUEUE_NAME);
+            transporte_cerrar(&transporte);
+            transporte_borrar(&transporte);
             shm_unlink(SHM_NAME);
             exit(EXIT_FAILURE);
         }
     } else {
         /* No existia */
         //-> Sí, soy el primer minero
-        if(!primer_minero(fd_shm, &segmento, &mq)){
-            mq_close(mq);
-            mq_unlink(QUEUE_NAME);
+        if(!primer_minero(fd_shm, &segmento, &transporte, opciones.capacidad, opciones.instantanea)){
+            transporte_cerrar(&transporte);
+            transporte_borrar(&transporte);
             shm_unlink(SHM_NAME);
             exit(EXIT_FAILURE);
         }
     }
 
 
+    red = segmento;
+    /* La ocupación de las CPUs está en el segmento: los hilos se colocan ya dentro de la red */
+    if (opciones.afinidad) {
+        colocar_hilos(&pool, segmento, cpus_hilos);
+    }
     alarm(n_seconds); // Establece la alarma
     /* Entrar en el sistema */
 
     while(got_signal_SIGALARM == 0 && got_signal_SIGINT == 0){
-        if(minero(n_hilos, mq, &segmento, &wallet) != 0){
-            mq_close(mq);
-            mq_unlink(QUEUE_NAME);
+        if(minero(&pool, &opciones, &transporte, &segmento, &wallet) != 0){
+            transporte_cerrar(&transporte);
+            transporte_borrar(&transporte);
             shm_unlink(SHM_NAME);
             exit(EXIT_FAILURE);
         }
@@ -872,10 +1119,10 @@ int main(int argc, char const *argv[]) {
     /* Minar */
 
         //-> No
-            /* Esperar a que el ganador envíe la señal SIGUSR2 */
-            /* Si se recibe SIGUSR2 se terminan todos los hilos y se pasa a la votación */
+            /* Esperar a que el ganador abra la votación */
+            /* Si se abre la votación se terminan todos los hilos y se pasa a votar */
             /* Comprueba el bloque actual y vota */
-            /* Entra en espera no activa hasta recibir SIGUSR1 para una nueva ronda */
+            /* Entra en espera no activa en el futex de ronda hasta una nueva ronda */
 
     /* IMPORTANTE, USAR SEMAFOROS PARA LAS RONDAS Y PERMITIR ENTRAR NUEVOS MINEROS O NO */
 
@@ -884,10 +1131,35 @@ int main(int argc, char const *argv[]) {
 
 
     /* Cola de mensajes PARA TODOS, la usará el ganador */
-    salir(&segmento, &mq);
+    salir(&segmento, &transporte);
+
+    pool_destruir(&pool);
+    pool_informe(&pool);
+    if (opciones.afinidad) {
+        for (int j = 0; j < n_hilos; j++) {
+            afinidad_liberar(&segmento->ocupacion_cpus, cpus_hilos[j]);
+        }
+    }
+    if (opciones.tabla) {
+        tabla_pow_cerrar(opciones.tabla);
+    }
+    if (opciones.instantanea) {
+        instantanea_cerrar(opciones.instantanea);
+    }
+    if (traza) {
+        traza_cerrar(traza);
+    }
+    if (eventos) {
+        /* Un manejador de señal ya no debe anotar en la proyección */
+        eventos = NULL;
+        eventos_cerrar(&eventos_minero);
+    }
+    if (metricas) {
+        metricas_cerrar(metricas);
+    }
 
-    munmap(segmento, sizeof(SharedMemMiner));
-    mq_close(mq);
+    munmap(segmento, segmento->tamano);
+    transporte_cerrar(&transporte);
     exit(EXIT_SUCCESS);
 }
 
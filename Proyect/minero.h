@@ -15,16 +15,54 @@
 #include <semaphore.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
 #include "pow.h"
+#include "bloque.h"
+#include "hilos.h"
+#include "tabla_pow.h"
+#include "futex.h"
+#include "transporte.h"
+#include "instantanea.h"
+#include "traza.h"
+#include "metricas.h"
+#include "sincro.h"
+#include "eventos.h"
+#include "afinidad.h"
 
 #define QUEUE_NAME "/cola_mensajes_con_monitor"
 #define SHM_NAME "/red_de_mineros"
 #define MAX_MSG_SIZE 100
 #define MAX_MSG_COUNT 7  
-#define MAX_MINERS 50
+#define MAX_MINERS BLOQUE_MAX_CARTERAS /**< Capacidad máxima del registro: las carteras de todos deben caber en un bloque */
 #define COD_SALIDA 10000000
 
-#define MAX_THREADS 100 /**< Número máximo de hilos permitidos en la minería */
+#define CURSOR(ronda, nonce) (((uint64_t)(uint32_t)(ronda) << 32) | (uint32_t)(nonce)) /**< Valor del cursor cooperativo */
+#define CURSOR_RONDA(cursor) ((int)((cursor) >> 32)) /**< Id del bloque del cursor cooperativo */
+#define CURSOR_NONCE(cursor) ((long int)((cursor) & 0xffffffffu)) /**< Siguiente nonce del cursor cooperativo */
+#define ESPERA_FUTEX_MS 50 /**< Espera máxima en un futex antes de volver a comprobar SIGINT y SIGALRM */
+#define PLAZO_VOTACION_MS 500 /**< Tiempo máximo por defecto que el ganador espera los votos */
+
+#define URNA(ronda, aprobados, rechazados) \
+    (((uint64_t)(uint32_t)(ronda) << 32) | ((uint64_t)(uint16_t)(aprobados) << 16) | (uint16_t)(rechazados)) /**< Valor de la urna */
+#define URNA_RONDA(urna) ((uint32_t)((urna) >> 32)) /**< Época de la ronda cuya votación recoge la urna */
+#define URNA_APROBADOS(urna) ((int)(((urna) >> 16) & 0xffffu)) /**< Votos a favor depositados en la urna */
+#define URNA_RECHAZADOS(urna) ((int)((urna) & 0xffffu)) /**< Votos en contra depositados en la urna */
+#define URNA_EMITIDOS(urna) (URNA_APROBADOS(urna) + URNA_RECHAZADOS(urna)) /**< Votos depositados en la urna */
+
+#define VOTO_EN_CONTRA 0
+#define VOTO_A_FAVOR 1
+#define VOTO(ronda, voto) (((uint64_t)(uint32_t)(ronda) << 32) | (uint32_t)(voto)) /**< Valor de una celda de voto */
+#define VOTO_RONDA(celda) ((uint32_t)((celda) >> 32)) /**< Época de la ronda en que se emitió el voto */
+#define VOTO_VALOR(celda) ((int)((celda) & 0xffffffffu)) /**< VOTO_A_FAVOR o VOTO_EN_CONTRA */
+
+#define REGISTRO_MAGICO "MINEROS" /**< Identifica el segmento de la red de mineros */
+#define REGISTRO_VERSION 5 /**< Versión del formato del segmento; cambia con la disposición de SharedMemMiner */
+
+#define LIBRES(etiqueta, casilla) (((uint64_t)(uint32_t)(etiqueta) << 32) | (uint32_t)((casilla) + 1)) /**< Cabeza de la lista de casillas libres */
+#define LIBRES_ETIQUETA(cabeza) ((uint32_t)((cabeza) >> 32)) /**< Contador de cambios de la cabeza, evita el problema ABA */
+#define LIBRES_CASILLA(cabeza) ((int)((cabeza) & 0xffffffffu) - 1) /**< Primera casilla libre, o -1 si no queda ninguna */
 
 /**
  * @brief Indica si se ha recibido la señal `SIGINT` (Ctrl+C).
@@ -36,16 +74,6 @@ extern volatile sig_atomic_t got_signal_SIGINT;
  */
 extern volatile sig_atomic_t got_signal_SIGALARM; 
 
-/**
- * @brief Indica si se ha recibido la señal `SIGUSR1` (Inicio de votación).
- */
-extern volatile sig_atomic_t got_signal_SIGUSR1;
-
-/**
- * @brief Indica si se ha recibido la señal `SIGUSR2` (Indicación para emitir un voto).
- */
-extern volatile sig_atomic_t got_signal_SIGUSR2;
-
 /**
  * @brief Manejador de la señal `SIGINT`.
  *
@@ -54,21 +82,6 @@ extern volatile sig_atomic_t got_signal_SIGUSR2;
  */
 void handle_sigint();
 
-/**
- * @brief Manejador de la señal `SIGINT`.
- *
- * Cuando se recibe SIGINT (Ctrl+C), esta función actualiza `got_signal_SIGINT`
- * para indicar que el programa debe finalizar.
- */
-void handler_sigusr1();
-
-/**
- * @brief Manejador de la señal `SIGUSR2`.
- *
- * Se usa para indicar a los votantes que deben emitir su voto.
- */
-void handler_sigusr2();
-
 /**
  * @brief Manejador de la señal `SIGALRM`.
  *
@@ -76,22 +89,6 @@ void handler_sigusr2();
  */
 void handler_sigalrm();
 
-/**
- * @struct ThreadData
- * @brief Estructura que almacena los datos necesarios para cada hilo minero.
- * 
- * Esta estructura contiene la información de los rangos de búsqueda, el objetivo a encontrar 
- * y punteros compartidos para comunicar el resultado entre los hilos.
- */
-typedef struct
-{
-    long int start;    /**< Inicio del rango de búsqueda */
-    long int end;      /**< Fin del rango de búsqueda */
-    long int target;   /**< Valor objetivo a encontrar */
-    long int *solution; /**< Puntero para almacenar la solución encontrada */
-    int *found;        /**< Indicador de si se encontró la solución */
-} ThreadData;
-
 /**
  * @brief Estructura que contiene los semáforos anónimos utilizados en el buffer compartido.
  */
@@ -101,44 +98,115 @@ typedef struct {
   sem_t ganador; /**< Semáforo que controla el registro de nuevos mineros */
 } Semaforo;
 
+/**
+ * @brief Casilla de voto de un minero, sola en su línea de caché.
+ *
+ * Solo la escribe su minero, así que votar no necesita ningún semáforo. El voto lleva la
+ * época de la ronda, de modo que no hay que borrar las casillas entre rondas. Votar pasa la
+ * casilla de una ronda anterior a la actual antes de sumar en la urna, así que cada minero
+ * suma como mucho un voto por ronda (ver depositar_voto()).
+ */
 typedef struct {
-    pid_t pid; /**< PID del minero */
-    int voto; /**< Voto del minero: 1 para aprobar, 0 para rechazar */ 
-} Voto;
-
-typedef struct {
-    pid_t pid; /**< PID del minero */
-    int monedas; /**< Cantidad de monedas del minero */
-} Monedas;
+    _Alignas(64) _Atomic uint64_t voto; /**< Ver VOTO() */
+} CeldaVoto;
 
 /**
- * @brief Representa un bloque de la cadena con objetivo, solución y validez.
+ * @brief Entrada del registro de mineros. Se escribe al entrar y salir de la red.
  */
 typedef struct {
-    int id;
-    int objetivo;  /**< Valor objetivo del bloque (resultado deseado del POW) */
-    int solucion;  /**< Solución propuesta para el POW */
-    pid_t ganador;
-    Monedas monedas_mineros[MAX_MINERS];
-    int total_votos;
-    int votos_positivos;
-    bool correcto; /**< Bandera que indica si la solución es válida */
-} Bloque;
+    _Atomic pid_t pid; /**< PID del minero, o -1 si la casilla está libre */
+    _Atomic uint32_t siguiente_libre; /**< Siguiente casilla de la lista de libres más uno, o 0 */
+} EntradaRegistro;
 
 /**
  * @brief Representa el segmento de memoria compartida del sistema.
+ *
+ * El segmento empieza con una cabecera versionada y le siguen, cada uno en sus propias
+ * líneas de caché, cuatro arrays de `capacidad` elementos: las casillas de voto (escritas
+ * por su minero en cada ronda, una por línea), el registro (pid y lista de libres), las
+ * carteras y las carteras tal como salieron en el último bloque enviado (estos dos solo
+ * los lee el ganador para armar el bloque). Su tamaño lo decide el primer
+ * minero. Unirse o salir de la red toma o devuelve una casilla de una lista de libres sin
+ * bloqueos, en O(1).
+ *
+ * Cada palabra en la que esperan o escriben muchos mineros a la vez está en su propia
+ * línea, para que escribir una no invalide la que leen los demás.
  */
 typedef struct {
-    pid_t pid[MAX_MINERS];
-    Voto votos_mineros[MAX_MINERS];
-    Monedas monedas_mineros[MAX_MINERS];
-    Bloque bloque_anterior;
-    Bloque bloque_actual; 
+    char magico[8]; /**< REGISTRO_MAGICO */
+    _Atomic uint32_t version; /**< REGISTRO_VERSION; se escribe la última, cuando el segmento ya está listo */
+    uint32_t capacidad; /**< Número de casillas de mineros */
+    size_t tamano; /**< Tamaño total del segmento en bytes */
+    size_t desp_votos; /**< Desplazamiento del array de CeldaVoto */
+    size_t desp_registro; /**< Desplazamiento del array de EntradaRegistro */
+    size_t desp_monedas; /**< Desplazamiento del array de Monedas */
+    size_t desp_enviadas; /**< Desplazamiento de las carteras del último bloque enviado, por casilla */
     Semaforo semaforos; /**< Estructura con semáforos de control */
     sem_t entry_mutex;    // protege can_enter y waiters_count
     sem_t entry_gate;     // puerta de entrada cerrada cuando ronda ≠ abierta
     int   waiters_count;  
     bool  can_enter;  
+    _Alignas(64) _Atomic uint32_t epoca_ronda; /**< Se incrementa al empezar cada ronda; los mineros esperan en ella */
+    _Alignas(64) _Atomic uint32_t epoca_voto; /**< Época de la ronda cuya votación está abierta; los votantes esperan en ella */
+    _Alignas(64) CabeceraBloque bloque_actual; /**< Solo la escribe el ganador, una vez por ronda */
+    CabeceraBloque bloque_anterior;
+    _Alignas(64) _Atomic uint64_t cursor_cooperativo; /**< Id del bloque en los 32 bits altos, siguiente nonce sin reclamar en los bajos */
+    _Atomic int ronda_resuelta; /**< Id del último bloque cuya solución ha encontrado algún minero */
+    _Alignas(64) _Atomic uint64_t urna; /**< Recuento de la votación abierta, ver URNA() */
+    _Atomic uint32_t votos_recibidos; /**< Se incrementa con cada voto depositado; el ganador espera en ella */
+    _Alignas(64) _Atomic int mineros_registrados; /**< Casillas ocupadas */
+    _Atomic uint64_t libres; /**< Cabeza de la lista de casillas libres, ver LIBRES() */
+    _Alignas(64) OcupacionCpus ocupacion_cpus; /**< Hilos fijados a cada CPU por los mineros con --afinidad */
 } SharedMemMiner;
 
+#define ALINEAR_LINEA(n) (((n) + 63) & ~(size_t)63) /**< Redondea n a un múltiplo de la línea de caché */
+
+/**
+ * @brief Calcula los desplazamientos de los arrays y el tamaño del segmento.
+ *
+ * @param segmento Cabecera a rellenar (capacidad, tamano y desp_*).
+ * @param capacidad Número de casillas de mineros.
+ */
+static inline void disponer_segmento(SharedMemMiner *segmento, int capacidad) {
+    segmento->capacidad = (uint32_t)capacidad;
+    segmento->desp_votos = ALINEAR_LINEA(sizeof(SharedMemMiner));
+    segmento->desp_registro = segmento->desp_votos + ALINEAR_LINEA((size_t)capacidad * sizeof(CeldaVoto));
+    segmento->desp_monedas = segmento->desp_registro + ALINEAR_LINEA((size_t)capacidad * sizeof(EntradaRegistro));
+    segmento->desp_enviadas = segmento->desp_monedas + ALINEAR_LINEA((size_t)capacidad * sizeof(Monedas));
+    segmento->tamano = segmento->desp_enviadas + ALINEAR_LINEA((size_t)capacidad * sizeof(Monedas));
+}
+
+/** @brief Casillas de voto del segmento. */
+static inline CeldaVoto *votos_de(SharedMemMiner *segmento) {
+    return (CeldaVoto *)((char *)segmento + segmento->desp_votos);
+}
+
+/** @brief Registro de mineros del segmento. */
+static inline EntradaRegistro *registro_de(SharedMemMiner *segmento) {
+    return (EntradaRegistro *)((char *)segmento + segmento->desp_registro);
+}
+
+/** @brief Carteras de los mineros del segmento. */
+static inline Monedas *monedas_de(SharedMemMiner *segmento) {
+    return (Monedas *)((char *)segmento + segmento->desp_monedas);
+}
+
+/** @brief Carteras del último bloque enviado, por casilla; base de los bloques delta. */
+static inline Monedas *enviadas_de(SharedMemMiner *segmento) {
+    return (Monedas *)((char *)segmento + segmento->desp_enviadas);
+}
+
+/**
+ * @brief Opciones de línea de comandos del minero, además de segundos e hilos.
+ */
+typedef struct {
+    bool cooperativo; /**< Reclamar tramos del cursor compartido en lugar de recorrer todo el rango */
+    TablaPow *tabla;  /**< Tabla precalculada para resolver el objetivo sin buscar, o NULL */
+    long plazo_votacion_ms; /**< Tiempo máximo que espera los votos cuando gana una ronda */
+    int capacidad; /**< Casillas del registro si este minero crea la red */
+    bool carteras_delta; /**< Enviar solo las carteras cambiadas desde el bloque anterior */
+    Instantanea *instantanea; /**< Instantánea que guarda el ganador y de la que arranca el primer minero, o NULL */
+    bool afinidad; /**< Fijar cada hilo a una CPU según la topología y los demás mineros */
+} OpcionesMinero;
+
 #endif
\ No newline at end of file
@@ -1,104 +1,216 @@
 #include "monitor.h"
 
-bool safe_sem_wait(sem_t *sem, const char *msg) {
-    while (sem_wait(sem) == -1) {
-        if (errno != EINTR) {
-            perror(msg);
-            return false;
-        }
-    }
-    return true;
-}
+int setup_monitor(int fd_shm, AnilloDifusion **segmento){
+    size_t tamano;
 
-bool safe_sem_post(sem_t *sem, const char *msg) {
-    while (sem_post(sem) == -1) {
-        if (errno != EINTR) {
-            perror(msg);
-            return false;
-        }
-    }
-    return true;
-}
-
-int setup_monitor(int fd_shm, SharedMem **segmento){
     fd_shm = shm_open(SHM_NAME_MONITOR, O_RDWR, S_IRUSR | S_IWUSR);
     if (fd_shm == -1) {
         perror("shm_open");
-        return false;
+        return 1;
+    }
+    *segmento = mmap(NULL, sizeof(AnilloDifusion), PROT_READ | PROT_WRITE, MAP_SHARED, fd_shm, 0);
+    if (*segmento != MAP_FAILED) {
+        /* La cabecera dice cuántas posiciones tiene el anillo */
+        tamano = (*segmento)->tamano;
+        munmap(*segmento, sizeof(AnilloDifusion));
+        *segmento = mmap(NULL, tamano, PROT_READ | PROT_WRITE, MAP_SHARED, fd_shm, 0);
     }
-    *segmento = mmap(NULL, sizeof(SharedMem), PROT_READ | PROT_WRITE, MAP_SHARED, fd_shm, 0);
     close(fd_shm);
     if (*segmento == MAP_FAILED) {
         perror("mmap\n");
         fflush(stdout);
-        return false;
+        return 1;
     }
     return 0;
 }
 
-int monitor(SharedMem *segmento) {
-    int objetivo, solucion, out;
-    bool correcto;
-    int id, ganador, votos_positivos, total_votos;
-    Monedas monedas_mineros[MAX_MINERS];
+/**
+ * @brief Imprime los bloques que lee un lector del anillo hasta el bloque de salida.
+ *
+ * Los bloques se formatean en memoria y los escribe el hilo de la salida asíncrona, así
+ * que un terminal lento no retiene la casilla del lector ni frena al comprobador.
+ *
+ * @param segmento Anillo de difusión del comprobador.
+ * @param lector Casilla de lector ya ocupada.
+ * @param resumir Resumir los bloques que no dé tiempo a escribir en vez de esperar.
+ * @param traza Traza en la que marcar cada bloque impreso, o NULL para no trazar.
+ * @param metricas Métricas en las que contar los bloques impresos y saltados, o NULL.
+ * @param eventos Registro en el que anotar cada bloque impreso, o NULL.
+ * @return 0 al terminar, 1 si no se ha podido crear la salida.
+ */
+int monitor(AnilloDifusion *segmento, int lector, bool resumir, Traza *traza, Metricas *metricas, Eventos *eventos) {
+    static Monedas monedas_mineros[BLOQUE_MAX_CARTERAS];
+    static unsigned char copia[BLOQUE_MAX_BYTES];
+    static SalidaAsincrona salida;
+    CabeceraBloque bloque = {0};
+    uint64_t saltados;
+    size_t bytes;
+    uint64_t impreso;
+    int n_monedas, formato;
 
-    printf("[%d] Printing blocks...\n", getpid());
     fflush(stdout);
+    if (salida_crear(&salida, STDOUT_FILENO, resumir) != 0) {
+        difusion_salir(segmento, lector);
+        return 1;
+    }
+    salida_texto(&salida, "[%d] Printing blocks...\n", getpid());
+    salida_entregar(&salida);
 
-    do {
-        safe_sem_wait(&segmento->semaforos.sem_fill, "sem_fill");
-        safe_sem_wait(&segmento->semaforos.mutex, "mutex");
-        out = segmento->out;
-        id = segmento->bloques[out].id;
-        objetivo = segmento->bloques[out].objetivo;
-        solucion = segmento->bloques[out].solucion;
-        ganador = segmento->bloques[out].ganador;
-        for (int i = 0; i < MAX_MINERS; i++) {
-            monedas_mineros[i].pid = segmento->bloques[out].monedas_mineros[i].pid;
-            monedas_mineros[i].monedas = segmento->bloques[out].monedas_mineros[i].monedas;
-        }
-        total_votos = segmento->bloques[out].total_votos;
-        votos_positivos = segmento->bloques[out].votos_positivos;
-        correcto = segmento->bloques[out].correcto;
-        segmento->out = (out + 1) % MAX_BLOQUES;
-        safe_sem_post(&segmento->semaforos.mutex, "mutex");
-        safe_sem_post(&segmento->semaforos.sem_empty, "sem_empty");
-
-        if (solucion == COD_SALIDA) {
-            break;
-        }
-
-        fprintf(stdout, "Id:         %5d\n", id);
-        fprintf(stdout, "Winner:     %5d\n", ganador);
-        fprintf(stdout, "Target:     %5d\n", objetivo);
-        fprintf(stdout, "Solution:   %5d ", solucion);
-        if (correcto) {
-            fprintf(stdout, "(validated)\n");
-        } else {
-            fprintf(stdout, "(incorrect)\n");
-        }
-        fprintf(stdout, "Votes:      %d/%d\n", total_votos, votos_positivos);
-        fprintf(stdout, "Wallets:    ");
-        for (int i = 0; i < MAX_MINERS; i++) {
-            if (monedas_mineros[i].pid != -1 && monedas_mineros[i].pid != 0) {
-                fprintf(stdout, "%d:%d ", monedas_mineros[i].pid, monedas_mineros[i].monedas);
+    while (bloque.solucion != COD_SALIDA && difusion_esperar(segmento, lector) == 0) {
+        /* Se vacían de una pasada todos los bloques listos y se entregan juntos al escritor */
+        while (bloque.solucion != COD_SALIDA && (bytes = difusion_leer(segmento, lector, copia, &saltados)) > 0) {
+            if (saltados) {
+                salida_texto(&salida, "[%d] Skipped %llu blocks (reader too slow)\n\n", getpid(), (unsigned long long)saltados);
+                metricas_sumar(metricas, MET_SALTADOS, saltados);
+            }
+            n_monedas = bloque_decodificar(copia, bytes, &bloque, &formato, monedas_mineros);
+            if (n_monedas != -1 && bloque.solucion != COD_SALIDA) {
+                salida_bloque(&salida, &bloque, monedas_mineros, n_monedas);
+                impreso = traza_cruzar(traza, bloque.id, MARCA_IMPRESO, FASE_IMPRESION, MARCA_VALIDADO);
+                traza_fase(traza, FASE_RONDA, traza_marca(traza, bloque.id, MARCA_RONDA), impreso);
+                metricas_sumar(metricas, MET_BLOQUES, 1);
+                eventos_anotar(eventos, EVENTO_IMPRESO, bloque.id, 0);
             }
         }
-        fprintf(stdout, "\n\n");
-        fflush(stdout);
-    } while(solucion != COD_SALIDA);
+        salida_entregar(&salida);
+    }
+    difusion_salir(segmento, lector);
 
-    printf("[%d] Finishing\n", getpid());
-    fflush(stdout);
+    salida_texto(&salida, "[%d] Finishing\n", getpid());
+    salida_destruir(&salida);
 
     return 0;
 }
 
-int main() {
+/**
+ * @brief Se une como lector adicional al anillo de un monitor que ya está en marcha.
+ *
+ * @param politica DIFUSION_ESPERAR o DIFUSION_SALTAR.
+ * @param resumir Resumir los bloques que no dé tiempo a escribir.
+ * @param traza Traza en la que marcar cada bloque impreso, o NULL para no trazar.
+ * @param metricas Métricas en las que contar los bloques, o NULL.
+ * @param eventos Registro en el que anotar cada bloque impreso, o NULL.
+ */
+static void seguir(int politica, bool resumir, Traza *traza, Metricas *metricas, Eventos *eventos) {
+    AnilloDifusion *segmento;
+    int lector;
+
+    if (setup_monitor(0, &segmento) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    lector = difusion_unirse(segmento, politica, getpid());
+    if (lector == -1) {
+        fprintf(stderr, "No quedan casillas de lector en el anillo del monitor\n");
+        exit(EXIT_FAILURE);
+    }
+    monitor(segmento, lector, resumir, traza, metricas, eventos);
+    if (metricas) {
+        metricas_cerrar(metricas);
+    }
+    if (eventos) {
+        eventos_cerrar(eventos);
+    }
+    munmap(segmento, segmento->tamano);
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char const *argv[]) {
     int fd_shm = 0;
     pid_t pid;
-    mqd_t mq;
-    SharedMem *segmento = NULL;
+    Transporte transporte = {.mq = (mqd_t)-1};
+    AnilloDifusion *segmento = NULL;
+    TablaPow tabla, *con_tabla = NULL;
+    Libro libro, *con_libro = NULL;
+    const char *ruta_libro = NULL;
+    Traza traza, *con_traza = NULL;
+    Metricas metricas, *con_metricas = NULL;
+    Exportador exportador, *con_exportador = NULL;
+    Eventos eventos, *con_eventos = NULL;
+    const char *dir_eventos = NULL;
+    int puerto = 0;
+    bool trazar = false;
+    int politica = DIFUSION_ESPERAR, lector;
+    bool seguidor = false, resumir = false, politica_dada = false;
+    int tipo = TRANSPORTE_COLA, celdas = ANILLO_CELDAS_POR_DEFECTO;
+    int profundidad_pedida = PROFUNDIDAD_POR_DEFECTO;
+    uint32_t profundidad = 2;
+    size_t tamano;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--tabla") == 0 && i + 1 < argc) {
+            if (tabla_pow_abrir(&tabla, argv[++i]) != 0) {
+                exit(EXIT_FAILURE);
+            }
+            con_tabla = &tabla;
+        } else if (strcmp(argv[i], "--anillo") == 0) {
+            /* Número de celdas opcional: --anillo [celdas] */
+            tipo = TRANSPORTE_ANILLO;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                celdas = atoi(argv[++i]);
+            }
+            if (celdas < 2 || celdas > ANILLO_MAX_CELDAS) {
+                fprintf(stderr, "El anillo debe tener entre 2 y %d celdas\n", ANILLO_MAX_CELDAS);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--profundidad") == 0 && i + 1 < argc) {
+            profundidad_pedida = atoi(argv[++i]);
+            if (profundidad_pedida < 2 || profundidad_pedida > MAX_PROFUNDIDAD) {
+                fprintf(stderr, "La profundidad debe estar entre 2 y %d bloques\n", MAX_PROFUNDIDAD);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--libro") == 0 && i + 1 < argc) {
+            ruta_libro = argv[++i];
+        } else if (strcmp(argv[i], "--traza") == 0) {
+            trazar = true;
+        } else if (strcmp(argv[i], "--eventos") == 0 && i + 1 < argc) {
+            dir_eventos = argv[++i];
+        } else if (strcmp(argv[i], "--metricas-puerto") == 0 && i + 1 < argc) {
+            puerto = atoi(argv[++i]);
+            if (puerto < 1 || puerto > 65535) {
+                fprintf(stderr, "El puerto debe estar entre 1 y 65535\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--seguir") == 0) {
+            seguidor = true;
+        } else if (strcmp(argv[i], "--resumir") == 0) {
+            resumir = true;
+        } else if (strcmp(argv[i], "--politica") == 0 && i + 1 < argc && strcmp(argv[i + 1], "esperar") == 0) {
+            politica = DIFUSION_ESPERAR;
+            politica_dada = true;
+            i++;
+        } else if (strcmp(argv[i], "--politica") == 0 && i + 1 < argc && strcmp(argv[i + 1], "saltar") == 0) {
+            politica = DIFUSION_SALTAR;
+            politica_dada = true;
+            i++;
+        } else {
+            fprintf(stderr, "Uso: %s [--tabla <fichero>] [--anillo [celdas]] [--profundidad <bloques>] [--libro <fichero>] [--traza] [--eventos <directorio>] [--metricas-puerto <puerto>] [--politica esperar|saltar] [--resumir]\n"
+                            "     %s --seguir [--traza] [--eventos <directorio>] [--politica esperar|saltar] [--resumir]\n", argv[0], argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    /* Lector adicional de un monitor en marcha: si no se pide otra política, no frena al comprobador */
+    if (seguidor && !politica_dada) {
+        politica = DIFUSION_SALTAR;
+    }
+    /* Un lector adicional traza con su propia casilla */
+    if (trazar && seguidor) {
+        if (traza_abrir(&traza) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        con_traza = &traza;
+    }
+    if (seguidor) {
+        if (metricas_abrir(&metricas, PROCESO_MONITOR, 0) == 0) {
+            con_metricas = &metricas;
+        }
+        if (dir_eventos) {
+            if (eventos_abrir(&eventos, dir_eventos, EVENTOS_MONITOR) != 0) {
+                exit(EXIT_FAILURE);
+            }
+            con_eventos = &eventos;
+        }
+        seguir(politica, resumir, con_traza, con_metricas, con_eventos);
+    }
 
         if ((fd_shm = shm_open(SHM_NAME_MONITOR, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR)) == -1) {
         if (errno == EEXIST){
@@ -108,21 +220,31 @@ int main() {
         }
     }
 
+    /* La profundidad se redondea a potencia de dos para indexar con una máscara */
+    while (profundidad < (uint32_t)profundidad_pedida) {
+        profundidad <<= 1;
+    }
+    tamano = difusion_tamano(profundidad);
+
     /* Resize of the memory segment. */
-    if (ftruncate(fd_shm, sizeof(SharedMem)) == -1) {
+    if (ftruncate(fd_shm, (off_t)tamano) == -1) {
         perror("ftruncate\n");
         fflush(stdout);
         close(fd_shm);
         return 1;
     }
     /* Mapping of the memory segment. */
-    segmento = mmap(NULL, sizeof(SharedMem), PROT_READ | PROT_WRITE, MAP_SHARED, fd_shm, 0);
+    segmento = mmap(NULL, tamano, PROT_READ | PROT_WRITE, MAP_SHARED, fd_shm, 0);
     close(fd_shm);
     if (segmento == MAP_FAILED) {
         perror("mmap\n");
         fflush(stdout);
         return 1;
     }
+    /* Antes del fork: el monitor hereda el anillo iniciado y su casilla de lector, así que
+       no se pierde ningún bloque aunque el comprobador publique antes de que arranque */
+    difusion_iniciar(segmento, profundidad);
+    lector = difusion_unirse(segmento, politica, 0);
 
     pid = fork();
     if (pid == -1) {
@@ -130,19 +252,71 @@ int main() {
         exit(EXIT_FAILURE);
     } else if (pid == 0) {
         /* Soy el monitor */
-        usleep(100 * 1000);
-        // if (setup_monitor(fd_shm, &segmento) == 1) {
-        //     fprintf(stderr, "Error setting up comprobador\n");
-        //     exit(EXIT_FAILURE);
-        // }
-        monitor(segmento);
+        /* Cada proceso toma su casilla de la traza, así que se abre después del fork */
+        if (trazar) {
+            if (traza_abrir(&traza) != 0) {
+                exit(EXIT_FAILURE);
+            }
+            con_traza = &traza;
+        }
+        if (metricas_abrir(&metricas, PROCESO_MONITOR, 0) == 0) {
+            con_metricas = &metricas;
+        }
+        /* Cada proceso escribe su propio fichero de eventos */
+        if (dir_eventos) {
+            if (eventos_abrir(&eventos, dir_eventos, EVENTOS_MONITOR) != 0) {
+                exit(EXIT_FAILURE);
+            }
+            con_eventos = &eventos;
+        }
+        monitor(segmento, lector, resumir, con_traza, con_metricas, con_eventos);
     } else {
         /* Soy el comprobador */
-        if (setup_comprobador(&segmento, &mq) == 1) {
+        atomic_store(&segmento->lectores[lector].pid, pid);
+        if (setup_comprobador(&transporte, tipo, celdas) == 1) {
             fprintf(stderr, "Error setting up comprobador\n");
             exit(EXIT_FAILURE);
         }
-        comprobador(segmento, &mq);
+        /* El hilo que confirma el libro solo hace falta en el comprobador: se crea tras el fork */
+        if (ruta_libro) {
+            if (libro_abrir(&libro, ruta_libro) != 0) {
+                fprintf(stderr, "Error opening the ledger %s\n", ruta_libro);
+                exit(EXIT_FAILURE);
+            }
+            con_libro = &libro;
+        }
+        if (trazar) {
+            if (traza_abrir(&traza) != 0) {
+                exit(EXIT_FAILURE);
+            }
+            con_traza = &traza;
+        }
+        if (metricas_abrir(&metricas, PROCESO_COMPROBADOR, 0) == 0) {
+            con_metricas = &metricas;
+        }
+        if (dir_eventos) {
+            if (eventos_abrir(&eventos, dir_eventos, EVENTOS_COMPROBADOR) != 0) {
+                exit(EXIT_FAILURE);
+            }
+            con_eventos = &eventos;
+        }
+        /* El exportador solo lee lo que el comprobador ya publica en su casilla de métricas */
+        if (puerto) {
+            if (!con_metricas || exportador_iniciar(&exportador, puerto, con_metricas, con_traza) != 0) {
+                fprintf(stderr, "Error starting the metrics endpoint on 127.0.0.1:%d\n", puerto);
+                exit(EXIT_FAILURE);
+            }
+            con_exportador = &exportador;
+            printf("[%d] Serving metrics on http://127.0.0.1:%d/metrics\n", getpid(), puerto);
+            fflush(stdout);
+        }
+        comprobador(segmento, &transporte, con_tabla, con_libro, con_traza, con_metricas, con_exportador, con_eventos);
+        if (con_exportador) {
+            exportador_parar(con_exportador);
+        }
+        if (con_libro) {
+            libro_cerrar(con_libro);
+        }
 
         wait(NULL);
     }  
@@ -150,9 +324,21 @@ int main() {
     fprintf(stdout, "Finishing monitor\n");
     fflush(stdout);
 
-    mq_close(mq);
-    munmap(segmento, sizeof(SharedMem));
-    mq_unlink(QUEUE_NAME);
+    transporte_cerrar(&transporte);
+    if (con_tabla) {
+        tabla_pow_cerrar(con_tabla);
+    }
+    if (con_traza) {
+        traza_cerrar(con_traza);
+    }
+    if (con_metricas) {
+        metricas_cerrar(con_metricas);
+    }
+    if (con_eventos) {
+        eventos_cerrar(con_eventos);
+    }
+    munmap(segmento, tamano);
+    transporte_borrar(&transporte);
     shm_unlink(SHM_NAME_MONITOR);
     exit(EXIT_SUCCESS);
 }
@@ -4,7 +4,7 @@
  * 
  * Este archivo contiene la definición de las estructuras necesarias para la comunicación entre
  * los procesos Comprobador y Monitor a través de memoria compartida, incluyendo el esquema 
- * de productor-consumidor implementado con semáforos anónimos. Además, se definen funciones 
+ * de un productor y varios lectores implementado con un anillo de difusión. Además, se definen funciones 
  * auxiliares seguras para el manejo de semáforos.
  * 
  * Es una parte fundamental del sistema de verificación de bloques basado en la técnica de 
@@ -32,74 +32,44 @@
 
 #include "pow.h"
 #include "minero.h"
+#include "tabla_pow.h"
+#include "bloque.h"
+#include "transporte.h"
+#include "difusion.h"
+#include "salida.h"
+#include "libro.h"
+#include "traza.h"
+#include "metricas.h"
+#include "exportador.h"
+#include "eventos.h"
 
 #define SHM_NAME_MONITOR "/monitor" /**< Nombre del segmento de memoria compartida */
-#define MAX_BLOQUES 6
-
-/**
- * @brief Estructura que contiene los semáforos anónimos utilizados en el buffer compartido.
- */
-typedef struct {
-  sem_t mutex; /**< Semáforo de exclusión mutua */
-  sem_t sem_empty; /**< Semáforo que controla los espacios vacíos */
-  sem_t sem_fill; /**< Semáforo que controla los bloques disponibles */
-} Semaforo_monitor;
-
-/**
- * @brief Representa el segmento de memoria compartida con el buffer circular y semáforos.
- */
-typedef struct {
-  Bloque bloques[MAX_BLOQUES]; /**< Array circular de bloques verificados */
-  Semaforo_monitor semaforos; /**< Estructura con semáforos de control */
-  int out; /**< Índice de lectura del buffer */
-  int in; /**< Índice de escritura del buffer */
-} SharedMem;
-
-/**
- * @brief Función auxiliar segura para realizar sem_wait con control de errores.
- * 
- * Esta función intenta realizar un sem_wait en el semáforo proporcionado. Si se interrumpe
- * por una señal, vuelve a intentar la operación. En caso de error, imprime un mensaje y 
- * devuelve false.
- * 
- * @param sem Puntero al semáforo a esperar.
- * @param msg Mensaje de error en caso de fallo.
- * 
- * @return true si la operación fue exitosa, false en caso contrario.
- */
-bool safe_sem_wait(sem_t *sem, const char *msg);
-
-/**
- * @brief Función auxiliar segura para realizar sem_post con control de errores.
- * 
- * Esta función intenta realizar un sem_post en el semáforo proporcionado. Si se interrumpe
- * por una señal, vuelve a intentar la operación. En caso de error, imprime un mensaje y 
- * devuelve false.
- * 
- * @param sem Puntero al semáforo a liberar.
- * @param msg Mensaje de error en caso de fallo.
- * 
- * @return true si la operación fue exitosa, false en caso contrario.
- */
-bool safe_sem_post(sem_t *sem, const char *msg);
+#define PROFUNDIDAD_POR_DEFECTO 64 /**< Bloques que caben por defecto entre comprobador y monitor */
+#define MAX_PROFUNDIDAD 4096 /**< Mayor profundidad admitida del buffer del monitor */
 
 /**
  * @brief Función principal del proceso Comprobador.
  * 
  * Esta función implementa la lógica del proceso Comprobador, que inicializa el segmento 
- * de memoria compartida, los semáforos anónimos, recibe bloques desde una cola de mensajes,
+ * de memoria compartida, recibe bloques desde el transporte de los mineros,
  * los valida usando la función POW y los introduce en el buffer compartido. El proceso se 
  * ejecuta hasta recibir un bloque especial con el objetivo 10000000, tras lo cual limpia 
  * los recursos utilizados.
  * 
  * @param fd_shm Descriptor del segmento de memoria compartida previamente abierto.
  * @param segmento Puntero al segmento de memoria compartida.
- * @param mq Cola de mensajes para recibir bloques.
+ * @param transporte Transporte por el que se reciben los bloques.
+ * @param tabla Tabla precalculada con la que validar las soluciones, o NULL para usar pow_hash.
+ * @param libro Libro en el que guardar cada bloque validado, o NULL para no guardarlos.
+ * @param traza Traza en la que marcar cada bloque validado, o NULL para no trazar.
+ * @param metricas Métricas en las que contar los bloques, o NULL para no publicarlas.
+ * @param exportador Exportador en el que contar cada bloque por ganador, o NULL si no hay.
+ * @param eventos Registro en el que anotar cada bloque validado, o NULL.
  * 
  * @return 0 si finaliza correctamente, 1 en caso de error.
  */
-void comprobador(SharedMem *segmento, mqd_t *mq);
+void comprobador(AnilloDifusion *segmento, Transporte *transporte, const TablaPow *tabla, Libro *libro, Traza *traza, Metricas *metricas, Exportador *exportador, Eventos *eventos);
 
-int setup_comprobador(SharedMem **segmento, mqd_t *mq);
+int setup_comprobador(Transporte *transporte, int tipo, int celdas);
 
 #endif
\ No newline at end of file
@@ -1,11 +1,371 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "pow.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define POW_X86 1
+#endif
+
 #define PRIME POW_LIMIT
-#define BIG_X 435679812
-#define BIG_Y 100001819
+#define BIG_X POW_BIG_X
+#define BIG_Y POW_BIG_Y
+
+/* f(x + k) = f(x) + (k X % P) mod P, so each lane advances by a constant step */
+#define STEP(k) (((long int)(k) * BIG_X) % PRIME)
+
+/* Largest nonce for which X x + Y does not overflow; beyond it only pow_hash applies */
+#define NONCE_MAX ((LONG_MAX - BIG_Y) / BIG_X)
 
 long int pow_hash(long int x)
 {
   long int result = (x * BIG_X + BIG_Y) % PRIME;
   return result;
 }
+
+/* Kernels work on [start, end) with 0 <= start <= end <= NONCE_MAX */
+typedef struct
+{
+  const char *name;
+  void (*batch)(long int start, long int end, long int *out);
+  long int (*search)(long int start, long int end, long int target);
+} PowKernel;
+
+static void batch_scalar(long int start, long int end, long int *out)
+{
+  long int x, h;
+
+  if (start >= end)
+    return;
+
+  h = pow_hash(start);
+  for (x = start; x < end; x++)
+  {
+    *out++ = h;
+    h += STEP(1);
+    if (h >= PRIME)
+      h -= PRIME;
+  }
+}
+
+static long int search_scalar(long int start, long int end, long int target)
+{
+  long int x, h;
+
+  if (start >= end)
+    return -1;
+
+  h = pow_hash(start);
+  for (x = start; x < end; x++)
+  {
+    if (h == target)
+      return x;
+    h += STEP(1);
+    if (h >= PRIME)
+      h -= PRIME;
+  }
+  return -1;
+}
+
+#ifdef POW_X86
+
+/*
+ * All hashes are below PRIME < 2^24, so they fit in 32-bit lanes. After adding
+ * the step a lane is below 2 PRIME, and min_epu32(h, h - PRIME) keeps h - PRIME
+ * only when it did not wrap around.
+ */
+
+__attribute__((target("sse4.1"))) static void batch_sse4(long int start, long int end, long int *out)
+{
+  long int x = start;
+  uint32_t init[4];
+  __m128i h, step, p;
+  int j;
+
+  if (end - start >= 4)
+  {
+    for (j = 0; j < 4; j++)
+      init[j] = (uint32_t)pow_hash(start + j);
+    h = _mm_loadu_si128((const __m128i *)init);
+    step = _mm_set1_epi32(STEP(4));
+    p = _mm_set1_epi32(PRIME);
+    for (; x + 4 <= end; x += 4, out += 4)
+    {
+      _mm_storeu_si128((__m128i *)out, _mm_cvtepu32_epi64(h));
+      _mm_storeu_si128((__m128i *)(out + 2), _mm_cvtepu32_epi64(_mm_srli_si128(h, 8)));
+      h = _mm_add_epi32(h, step);
+      h = _mm_min_epu32(h, _mm_sub_epi32(h, p));
+    }
+  }
+  batch_scalar(x, end, out);
+}
+
+__attribute__((target("sse4.1"))) static long int search_sse4(long int start, long int end, long int target)
+{
+  long int x = start;
+  uint32_t init[16];
+  __m128i h0, h1, h2, h3, eq, step, p, t;
+  int j;
+
+  if (end - start >= 16)
+  {
+    for (j = 0; j < 16; j++)
+      init[j] = (uint32_t)pow_hash(start + j);
+    h0 = _mm_loadu_si128((const __m128i *)init);
+    h1 = _mm_loadu_si128((const __m128i *)(init + 4));
+    h2 = _mm_loadu_si128((const __m128i *)(init + 8));
+    h3 = _mm_loadu_si128((const __m128i *)(init + 12));
+    step = _mm_set1_epi32(STEP(16));
+    p = _mm_set1_epi32(PRIME);
+    t = _mm_set1_epi32((int)target);
+    for (; x + 16 <= end; x += 16)
+    {
+      eq = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi32(h0, t), _mm_cmpeq_epi32(h1, t)),
+                        _mm_or_si128(_mm_cmpeq_epi32(h2, t), _mm_cmpeq_epi32(h3, t)));
+      if (!_mm_testz_si128(eq, eq))
+        return search_scalar(x, x + 16, target);
+      h0 = _mm_add_epi32(h0, step);
+      h1 = _mm_add_epi32(h1, step);
+      h2 = _mm_add_epi32(h2, step);
+      h3 = _mm_add_epi32(h3, step);
+      h0 = _mm_min_epu32(h0, _mm_sub_epi32(h0, p));
+      h1 = _mm_min_epu32(h1, _mm_sub_epi32(h1, p));
+      h2 = _mm_min_epu32(h2, _mm_sub_epi32(h2, p));
+      h3 = _mm_min_epu32(h3, _mm_sub_epi32(h3, p));
+    }
+  }
+  return search_scalar(x, end, target);
+}
+
+__attribute__((target("avx2"))) static void batch_avx2(long int start, long int end, long int *out)
+{
+  long int x = start;
+  uint32_t init[8];
+  __m256i h, step, p;
+  int j;
+
+  if (end - start >= 8)
+  {
+    for (j = 0; j < 8; j++)
+      init[j] = (uint32_t)pow_hash(start + j);
+    h = _mm256_loadu_si256((const __m256i *)init);
+    step = _mm256_set1_epi32(STEP(8));
+    p = _mm256_set1_epi32(PRIME);
+    for (; x + 8 <= end; x += 8, out += 8)
+    {
+      _mm256_storeu_si256((__m256i *)out, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(h)));
+      _mm256_storeu_si256((__m256i *)(out + 4), _mm256_cvtepu32_epi64(_mm256_extracti128_si256(h, 1)));
+      h = _mm256_add_epi32(h, step);
+      h = _mm256_min_epu32(h, _mm256_sub_epi32(h, p));
+    }
+  }
+  batch_scalar(x, end, out);
+}
+
+__attribute__((target("avx2"))) static long int search_avx2(long int start, long int end, long int target)
+{
+  long int x = start;
+  uint32_t init[32];
+  __m256i h0, h1, h2, h3, eq, step, p, t;
+  int j;
+
+  if (end - start >= 32)
+  {
+    for (j = 0; j < 32; j++)
+      init[j] = (uint32_t)pow_hash(start + j);
+    h0 = _mm256_loadu_si256((const __m256i *)init);
+    h1 = _mm256_loadu_si256((const __m256i *)(init + 8));
+    h2 = _mm256_loadu_si256((const __m256i *)(init + 16));
+    h3 = _mm256_loadu_si256((const __m256i *)(init + 24));
+    step = _mm256_set1_epi32(STEP(32));
+    p = _mm256_set1_epi32(PRIME);
+    t = _mm256_set1_epi32((int)target);
+    for (; x + 32 <= end; x += 32)
+    {
+      eq = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi32(h0, t), _mm256_cmpeq_epi32(h1, t)),
+                           _mm256_or_si256(_mm256_cmpeq_epi32(h2, t), _mm256_cmpeq_epi32(h3, t)));
+      if (!_mm256_testz_si256(eq, eq))
+        return search_scalar(x, x + 32, target);
+      h0 = _mm256_add_epi32(h0, step);
+      h1 = _mm256_add_epi32(h1, step);
+      h2 = _mm256_add_epi32(h2, step);
+      h3 = _mm256_add_epi32(h3, step);
+      h0 = _mm256_min_epu32(h0, _mm256_sub_epi32(h0, p));
+      h1 = _mm256_min_epu32(h1, _mm256_sub_epi32(h1, p));
+      h2 = _mm256_min_epu32(h2, _mm256_sub_epi32(h2, p));
+      h3 = _mm256_min_epu32(h3, _mm256_sub_epi32(h3, p));
+    }
+  }
+  return search_scalar(x, end, target);
+}
+
+__attribute__((target("avx512f"))) static void batch_avx512(long int start, long int end, long int *out)
+{
+  long int x = start;
+  uint32_t init[16];
+  __m512i h, step, p;
+  int j;
+
+  if (end - start >= 16)
+  {
+    for (j = 0; j < 16; j++)
+      init[j] = (uint32_t)pow_hash(start + j);
+    h = _mm512_loadu_si512((const void *)init);
+    step = _mm512_set1_epi32(STEP(16));
+    p = _mm512_set1_epi32(PRIME);
+    for (; x + 16 <= end; x += 16, out += 16)
+    {
+      _mm512_storeu_si512((void *)out, _mm512_cvtepu32_epi64(_mm512_castsi512_si256(h)));
+      _mm512_storeu_si512((void *)(out + 8), _mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(h, 1)));
+      h = _mm512_add_epi32(h, step);
+      h = _mm512_min_epu32(h, _mm512_sub_epi32(h, p));
+    }
+  }
+  batch_scalar(x, end, out);
+}
+
+__attribute__((target("avx512f"))) static long int search_avx512(long int start, long int end, long int target)
+{
+  long int x = start;
+  uint32_t init[64];
+  __m512i h0, h1, h2, h3, step, p, t;
+  __mmask16 eq;
+  int j;
+
+  if (end - start >= 64)
+  {
+    for (j = 0; j < 64; j++)
+      init[j] = (uint32_t)pow_hash(start + j);
+    h0 = _mm512_loadu_si512((const void *)init);
+    h1 = _mm512_loadu_si512((const void *)(init + 16));
+    h2 = _mm512_loadu_si512((const void *)(init + 32));
+    h3 = _mm512_loadu_si512((const void *)(init + 48));
+    step = _mm512_set1_epi32(STEP(64));
+    p = _mm512_set1_epi32(PRIME);
+    t = _mm512_set1_epi32((int)target);
+    for (; x + 64 <= end; x += 64)
+    {
+      eq = _mm512_cmpeq_epi32_mask(h0, t) | _mm512_cmpeq_epi32_mask(h1, t) |
+           _mm512_cmpeq_epi32_mask(h2, t) | _mm512_cmpeq_epi32_mask(h3, t);
+      if (eq)
+        return search_scalar(x, x + 64, target);
+      h0 = _mm512_add_epi32(h0, step);
+      h1 = _mm512_add_epi32(h1, step);
+      h2 = _mm512_add_epi32(h2, step);
+      h3 = _mm512_add_epi32(h3, step);
+      h0 = _mm512_min_epu32(h0, _mm512_sub_epi32(h0, p));
+      h1 = _mm512_min_epu32(h1, _mm512_sub_epi32(h1, p));
+      h2 = _mm512_min_epu32(h2, _mm512_sub_epi32(h2, p));
+      h3 = _mm512_min_epu32(h3, _mm512_sub_epi32(h3, p));
+    }
+  }
+  return search_scalar(x, end, target);
+}
+
+#endif
+
+/* Ordered from the least to the most capable kernel */
+static const PowKernel kernels[] = {
+    {"scalar", batch_scalar, search_scalar},
+#ifdef POW_X86
+    {"sse4", batch_sse4, search_sse4},
+    {"avx2", batch_avx2, search_avx2},
+    {"avx512", batch_avx512, search_avx512},
+#endif
+};
+
+static const PowKernel *kernel = &kernels[0];
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static int kernel_supported(const PowKernel *k)
+{
+#ifdef POW_X86
+  if (strcmp(k->name, "sse4") == 0)
+    return __builtin_cpu_supports("sse4.1");
+  if (strcmp(k->name, "avx2") == 0)
+    return __builtin_cpu_supports("avx2");
+  if (strcmp(k->name, "avx512") == 0)
+    return __builtin_cpu_supports("avx512f");
+#endif
+  return strcmp(k->name, "scalar") == 0;
+}
+
+static void kernel_select(void)
+{
+  const char *forced = getenv("POW_ISA");
+  size_t i;
+
+#ifdef POW_X86
+  __builtin_cpu_init();
+#endif
+  for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+  {
+    if (!kernel_supported(&kernels[i]))
+      break;
+    kernel = &kernels[i];
+    if (forced && strcmp(forced, kernels[i].name) == 0)
+      break;
+  }
+}
+
+static const PowKernel *kernel_get(void)
+{
+  pthread_once(&kernel_once, kernel_select);
+  return kernel;
+}
+
+void pow_hash_batch(long int start, long int n, long int *out)
+{
+  long int i;
+
+  if (n <= 0)
+    return;
+
+  if (start < 0 || start > NONCE_MAX - n)
+  {
+    for (i = 0; i < n; i++)
+      out[i] = pow_hash(start + i);
+    return;
+  }
+  kernel_get()->batch(start, start + n, out);
+}
+
+void pow_hash_list(const long int *x, long int n, long int *out)
+{
+  long int i;
+
+  for (i = 0; i < n; i++)
+    out[i] = (x[i] * BIG_X + BIG_Y) % PRIME;
+}
+
+long int pow_search_batch(long int start, long int end, long int target)
+{
+  long int x;
+
+  if (start >= end)
+    return -1;
+
+  if (start < 0 || end > NONCE_MAX)
+  {
+    for (x = start; x < end; x++)
+    {
+      if (pow_hash(x) == target)
+        return x;
+    }
+    return -1;
+  }
+  /* For x >= 0 the hash is always in [0, PRIME) */
+  if (target < 0 || target >= PRIME)
+    return -1;
+
+  return kernel_get()->search(start, end, target);
+}
+
+const char *pow_batch_isa(void)
+{
+  return kernel_get()->name;
+}
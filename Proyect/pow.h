@@ -13,6 +13,8 @@
 #define _POW_H
 
 #define POW_LIMIT 9997697 /*!< Maximum number for the hash result. */
+#define POW_BIG_X 435679812 /*!< Multiplier X of the hash function. */
+#define POW_BIG_Y 100001819 /*!< Addend Y of the hash function. */
 
 /**
  * @brief Computes the following hash function:
@@ -23,4 +25,52 @@
  */
 long int pow_hash(long int x);
 
+/**
+ * @brief Computes f(x) for every nonce of the contiguous block [start, start + n).
+ *
+ * The result is bit for bit the same as calling pow_hash() on each nonce, but
+ * consecutive hashes are obtained with additions and a conditional subtraction
+ * instead of a 64-bit division, several lanes at a time when the CPU allows it.
+ *
+ * @param start First nonce of the block.
+ * @param n Number of nonces to compute.
+ * @param out Output array of n elements, out[i] = f(start + i).
+ */
+void pow_hash_batch(long int start, long int n, long int *out);
+
+/**
+ * @brief Computes f(x) for n arbitrary nonces, such as the solutions of a run of blocks.
+ *
+ * The modulus is a compile-time constant, so the loop needs no division and no
+ * call per nonce.
+ *
+ * @param x Input array of n nonces.
+ * @param n Number of nonces.
+ * @param out Output array of n elements, out[i] = f(x[i]).
+ */
+void pow_hash_list(const long int *x, long int n, long int *out);
+
+/**
+ * @brief Searches the first nonce x in [start, end) such that f(x) == target.
+ *
+ * Uses the same division-free kernels as pow_hash_batch() without storing the
+ * intermediate hashes.
+ *
+ * @param start First nonce of the range.
+ * @param end End of the range (not included).
+ * @param target Value of f(x) to look for.
+ * @return The nonce found, or -1 if no nonce of the range matches.
+ */
+long int pow_search_batch(long int start, long int end, long int target);
+
+/**
+ * @brief Name of the kernel selected at runtime for the batch functions.
+ *
+ * The kernel is chosen by CPUID among "scalar", "sse4", "avx2" and "avx512".
+ * The environment variable POW_ISA can force a lower one (e.g. POW_ISA=scalar).
+ *
+ * @return Name of the selected kernel.
+ */
+const char *pow_batch_isa(void);
+
 #endif
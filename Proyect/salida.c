@@ -0,0 +1,228 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "salida.h"
+
+/**
+ * @brief Escribe `bytes` bytes aunque write() los acepte por partes.
+ *
+ * @return Número de llamadas a write(), o -1 si el destino ha fallado.
+ */
+static long escribir_todo(int fd, const char *datos, size_t bytes) {
+    long llamadas = 0;
+    ssize_t escritos;
+
+    while (bytes > 0) {
+        escritos = write(fd, datos, bytes);
+        if (escritos == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write");
+            return -1;
+        }
+        datos += escritos;
+        bytes -= (size_t)escritos;
+        llamadas++;
+    }
+    return llamadas;
+}
+
+static void *escritor(void *arg) {
+    SalidaAsincrona *salida = (SalidaAsincrona *)arg;
+    const char *datos;
+    size_t bytes;
+    long llamadas;
+    bool roto = false;
+
+    pthread_mutex_lock(&salida->mutex);
+    for (;;) {
+        while (salida->pendiente == NULL && !salida->fin) {
+            pthread_cond_wait(&salida->hay_trabajo, &salida->mutex);
+        }
+        if (salida->pendiente == NULL) {
+            break;
+        }
+        datos = salida->pendiente;
+        bytes = salida->bytes_pendientes;
+        pthread_mutex_unlock(&salida->mutex);
+
+        /* Si el destino falla se descarta el resto para no frenar al monitor */
+        llamadas = roto ? 0 : escribir_todo(salida->fd, datos, bytes);
+        roto = roto || llamadas == -1;
+
+        pthread_mutex_lock(&salida->mutex);
+        if (llamadas > 0) {
+            salida->escrituras += (uint64_t)llamadas;
+            salida->bytes_escritos += bytes;
+        }
+        salida->pendiente = NULL;
+        pthread_cond_signal(&salida->libre);
+    }
+    pthread_mutex_unlock(&salida->mutex);
+    return NULL;
+}
+
+int salida_crear(SalidaAsincrona *salida, int fd, bool resumir) {
+    salida->fd = fd;
+    salida->resumir = resumir;
+    salida->usados = 0;
+    salida->pendiente = NULL;
+    salida->bytes_pendientes = 0;
+    salida->fin = false;
+    salida->resumidos = 0;
+    salida->resumidos_validos = 0;
+    salida->primer_resumido = 0;
+    salida->ultimo_resumido = 0;
+    salida->escrituras = 0;
+    salida->bytes_escritos = 0;
+    salida->buffers[0] = malloc(SALIDA_CAPACIDAD);
+    salida->buffers[1] = malloc(SALIDA_CAPACIDAD);
+    if (!salida->buffers[0] || !salida->buffers[1]) {
+        perror("malloc");
+        free(salida->buffers[0]);
+        free(salida->buffers[1]);
+        return -1;
+    }
+    salida->actual = salida->buffers[0];
+    pthread_mutex_init(&salida->mutex, NULL);
+    pthread_cond_init(&salida->hay_trabajo, NULL);
+    pthread_cond_init(&salida->libre, NULL);
+    if (pthread_create(&salida->hilo, NULL, escritor, salida) != 0) {
+        perror("pthread_create");
+        free(salida->buffers[0]);
+        free(salida->buffers[1]);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Pasa el buffer actual al escritor, con el resumen pendiente al final.
+ *
+ * @param salida Salida iniciada.
+ * @param esperar Si el escritor está ocupado, esperar a que acabe en vez de volver.
+ * @return true si el buffer actual ha quedado vacío.
+ */
+static bool entregar(SalidaAsincrona *salida, bool esperar) {
+    bool entregado = false;
+    char *libre;
+
+    pthread_mutex_lock(&salida->mutex);
+    while (esperar && salida->pendiente != NULL) {
+        pthread_cond_wait(&salida->libre, &salida->mutex);
+    }
+    if (salida->pendiente == NULL) {
+        /* Los bloques contados van detrás de los que se formatearon antes que ellos */
+        if (salida->resumidos > 0) {
+            salida->usados += (size_t)snprintf(salida->actual + salida->usados, SALIDA_MAX_LINEA,
+                                               "[%d] Output too slow: blocks %d-%d summarized, %ld blocks (%ld validated, %ld incorrect)\n\n",
+                                               getpid(), salida->primer_resumido, salida->ultimo_resumido, salida->resumidos,
+                                               salida->resumidos_validos, salida->resumidos - salida->resumidos_validos);
+            salida->resumidos = 0;
+            salida->resumidos_validos = 0;
+        }
+        if (salida->usados > 0) {
+            libre = (salida->actual == salida->buffers[0]) ? salida->buffers[1] : salida->buffers[0];
+            salida->pendiente = salida->actual;
+            salida->bytes_pendientes = salida->usados;
+            salida->actual = libre;
+            salida->usados = 0;
+            pthread_cond_signal(&salida->hay_trabajo);
+        }
+        entregado = true;
+    }
+    pthread_mutex_unlock(&salida->mutex);
+    return entregado;
+}
+
+/**
+ * @brief Deja sitio para `bytes` bytes más la línea de resumen.
+ *
+ * @return true si hay sitio, false si en modo resumen no lo hay sin esperar.
+ */
+static bool hacer_sitio(SalidaAsincrona *salida, size_t bytes, bool puede_resumir) {
+    if (salida->usados + bytes + SALIDA_MAX_LINEA <= SALIDA_CAPACIDAD) {
+        return true;
+    }
+    if (puede_resumir && salida->resumir) {
+        return entregar(salida, false);
+    }
+    return entregar(salida, true);
+}
+
+void salida_bloque(SalidaAsincrona *salida, const CabeceraBloque *bloque, const Monedas *carteras, int n) {
+    char *p;
+    size_t resto;
+    int escritos;
+
+    if (!hacer_sitio(salida, SALIDA_MAX_BLOQUE, true)) {
+        /* El destino no da abasto: se cuenta el bloque para el resumen */
+        if (salida->resumidos == 0) {
+            salida->primer_resumido = bloque->id;
+        }
+        salida->ultimo_resumido = bloque->id;
+        salida->resumidos++;
+        salida->resumidos_validos += bloque->correcto;
+        return;
+    }
+
+    p = salida->actual + salida->usados;
+    resto = SALIDA_MAX_BLOQUE;
+    escritos = snprintf(p, resto,
+                        "Id:         %5d\n"
+                        "Winner:     %5d\n"
+                        "Target:     %5d\n"
+                        "Solution:   %5d %s\n"
+                        "Votes:      %d/%d\n"
+                        "Wallets:    ",
+                        bloque->id, bloque->ganador, bloque->objetivo, bloque->solucion,
+                        bloque->correcto ? "(validated)" : "(incorrect)",
+                        bloque->total_votos, bloque->votos_positivos);
+    p += escritos;
+    resto -= (size_t)escritos;
+    for (int i = 0; i < n; i++) {
+        escritos = snprintf(p, resto, "%d:%d ", carteras[i].pid, carteras[i].monedas);
+        p += escritos;
+        resto -= (size_t)escritos;
+    }
+    *p++ = '\n';
+    *p++ = '\n';
+    salida->usados = (size_t)(p - salida->actual);
+}
+
+void salida_texto(SalidaAsincrona *salida, const char *formato, ...) {
+    va_list argumentos;
+    int escritos;
+
+    hacer_sitio(salida, SALIDA_MAX_LINEA, false);
+    va_start(argumentos, formato);
+    escritos = vsnprintf(salida->actual + salida->usados, SALIDA_MAX_LINEA, formato, argumentos);
+    va_end(argumentos);
+    if (escritos > 0) {
+        salida->usados += (escritos < SALIDA_MAX_LINEA) ? (size_t)escritos : SALIDA_MAX_LINEA - 1;
+    }
+}
+
+void salida_entregar(SalidaAsincrona *salida) {
+    entregar(salida, false);
+}
+
+void salida_destruir(SalidaAsincrona *salida) {
+    /* Lo que quede se entrega; el escritor lo vuelca antes de ver `fin` */
+    entregar(salida, true);
+    pthread_mutex_lock(&salida->mutex);
+    salida->fin = true;
+    pthread_cond_signal(&salida->hay_trabajo);
+    pthread_mutex_unlock(&salida->mutex);
+    pthread_join(salida->hilo, NULL);
+
+    pthread_mutex_destroy(&salida->mutex);
+    pthread_cond_destroy(&salida->hay_trabajo);
+    pthread_cond_destroy(&salida->libre);
+    free(salida->buffers[0]);
+    free(salida->buffers[1]);
+}
@@ -0,0 +1,97 @@
+/**
+ * @file salida.h
+ * @brief Salida asíncrona del monitor: formato en memoria y escritura en otro hilo.
+ *
+ * El monitor formatea cada bloque en un buffer propio, sin pasar por stdio, y al final de
+ * cada tanda lo entrega a un hilo escritor que lo vuelca con write() grandes. Hay dos
+ * buffers: mientras el escritor vuelca uno, el monitor llena el otro, así que un terminal
+ * o una tubería lentos solo frenan al monitor cuando los dos están llenos.
+ *
+ * En modo resumen el monitor no se frena nunca: si los dos buffers están llenos deja de
+ * formatear bloques y solo los cuenta, y cuando el escritor vuelve a estar libre escribe
+ * una línea con el resumen de los que no ha podido mostrar.
+ */
+
+#ifndef SALIDA_H
+#define SALIDA_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bloque.h"
+
+#define SALIDA_CAPACIDAD (1 << 20) /**< Bytes de cada uno de los dos buffers */
+#define SALIDA_MAX_BLOQUE (256 + BLOQUE_MAX_CARTERAS * 24) /**< Mayor texto de un bloque formateado */
+#define SALIDA_MAX_LINEA 512 /**< Mayor línea de texto o de resumen */
+
+/**
+ * @brief Salida con su hilo escritor.
+ */
+typedef struct {
+    pthread_t hilo; /**< Hilo escritor */
+    pthread_mutex_t mutex; /**< Protege el intercambio de buffers */
+    pthread_cond_t hay_trabajo; /**< Hay un buffer pendiente o hay que terminar */
+    pthread_cond_t libre; /**< El escritor ha terminado con su buffer */
+    int fd; /**< Descriptor de destino */
+    bool resumir; /**< Contar en vez de esperar cuando el escritor no da abasto */
+    char *buffers[2]; /**< Memoria de los dos buffers */
+    char *actual; /**< Buffer que llena el monitor */
+    size_t usados; /**< Bytes ocupados de `actual` */
+    char *pendiente; /**< Buffer entregado al escritor, o NULL */
+    size_t bytes_pendientes; /**< Bytes de `pendiente` */
+    bool fin; /**< El escritor debe terminar cuando vacíe lo pendiente */
+    long resumidos; /**< Bloques contados sin formatear desde el último resumen */
+    long resumidos_validos; /**< De ellos, los validados */
+    int primer_resumido; /**< Id del primer bloque contado */
+    int ultimo_resumido; /**< Id del último bloque contado */
+    uint64_t escrituras; /**< Llamadas a write() hechas por el escritor */
+    uint64_t bytes_escritos; /**< Bytes volcados por el escritor */
+} SalidaAsincrona;
+
+/**
+ * @brief Prepara los buffers y arranca el hilo escritor.
+ *
+ * @param salida Salida a iniciar.
+ * @param fd Descriptor en el que escribir.
+ * @param resumir Activa el modo resumen.
+ * @return 0 si todo va bien, -1 en caso de error.
+ */
+int salida_crear(SalidaAsincrona *salida, int fd, bool resumir);
+
+/**
+ * @brief Formatea un bloque en el buffer, o lo cuenta si está en modo resumen y no cabe.
+ *
+ * @param salida Salida iniciada.
+ * @param bloque Campos del bloque.
+ * @param carteras Carteras vivas.
+ * @param n Número de carteras.
+ */
+void salida_bloque(SalidaAsincrona *salida, const CabeceraBloque *bloque, const Monedas *carteras, int n);
+
+/**
+ * @brief Añade una línea de texto con formato printf. Nunca se resume.
+ *
+ * @param salida Salida iniciada.
+ * @param formato Formato de printf.
+ */
+void salida_texto(SalidaAsincrona *salida, const char *formato, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Entrega lo acumulado al escritor si está libre; si no, se sigue acumulando.
+ *
+ * Se llama al final de cada tanda de bloques. Nunca espera.
+ *
+ * @param salida Salida iniciada.
+ */
+void salida_entregar(SalidaAsincrona *salida);
+
+/**
+ * @brief Vuelca todo lo pendiente, para el escritor y libera los buffers.
+ *
+ * @param salida Salida iniciada.
+ */
+void salida_destruir(SalidaAsincrona *salida);
+
+#endif
@@ -0,0 +1,221 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "sincro.h"
+
+#ifdef SINCRO_PERFIL
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "traza.h"
+#endif
+
+/* Dónde se publican las esperas y cuándo se deja de reintentar */
+static Metricas *metricas = NULL;
+static bool (*abandonar)(void) = NULL;
+
+/**
+ * @brief Contador de tiempo de espera de un semáforo, por su nombre.
+ */
+static ContadorMetricas contador_espera(const char *nombre) {
+    static const char *nombres[MET_N_ESPERAS] = {"mutex", "mutex_ronda", "ganador", "entry_mutex", "entry_gate"};
+
+    for (int i = 0; i < MET_N_ESPERAS; i++) {
+        if (nombres[i] && strcmp(nombres[i], nombre) == 0) {
+            return (ContadorMetricas)(MET_ESPERAS + i);
+        }
+    }
+    return MET_CONTADORES;
+}
+
+#ifdef SINCRO_PERFIL
+
+/**
+ * @brief Perfil de un semáforo con nombre.
+ *
+ * Los semáforos solo los usa el hilo principal de cada proceso, así que el perfil tiene un
+ * único escritor y los histogramas se anotan con traza_anotar().
+ */
+typedef struct {
+    const char *nombre; /**< Nombre del semáforo, NULL si la casilla está libre */
+    uint64_t adquisiciones; /**< Esperas que acabaron con el semáforo tomado */
+    uint64_t inmediatas; /**< Adquisiciones resueltas por sem_trywait */
+    uint64_t bloqueantes; /**< Adquisiciones que tuvieron que dormir en sem_wait */
+    uint64_t fallidas; /**< Esperas cortadas por un error o una señal */
+    uint64_t liberaciones; /**< Llamadas a sem_post */
+    uint64_t tomado_ns; /**< Instante de la última adquisición aún no liberada, o 0 */
+    HistogramaTraza espera; /**< Espera de las adquisiciones que bloquearon */
+    HistogramaTraza retenido; /**< De la adquisición a la siguiente liberación de este proceso */
+} PerfilSemaforo;
+
+static PerfilSemaforo perfiles[SINCRO_NOMBRES];
+static bool volcado_registrado = false;
+
+static uint64_t instante_ns(void) {
+    struct timespec ahora;
+
+    clock_gettime(CLOCK_MONOTONIC, &ahora);
+    return (uint64_t)ahora.tv_sec * 1000000000ULL + (uint64_t)ahora.tv_nsec;
+}
+
+/**
+ * @brief Percentil de un histograma en microsegundos, con el punto medio de su cubeta.
+ */
+static double percentil_us(const HistogramaTraza *histograma, double q) {
+    uint64_t cuenta = atomic_load(&histograma->cuenta), maximo = atomic_load(&histograma->maximo);
+    uint64_t visto = 0, objetivo, medio;
+
+    if (cuenta == 0) {
+        return 0.0;
+    }
+    objetivo = (uint64_t)(q * (double)cuenta + 0.999999);
+    objetivo = objetivo ? objetivo : 1;
+    for (int c = 0; c < TRAZA_CUBETAS; c++) {
+        visto += atomic_load(&histograma->cubetas[c]);
+        if (visto >= objetivo) {
+            medio = c + 1 < TRAZA_CUBETAS ? (traza_cubeta_inicio(c) + traza_cubeta_inicio(c + 1) - 1) / 2
+                                          : traza_cubeta_inicio(c);
+            return (medio < maximo ? medio : maximo) / 1e3;
+        }
+    }
+    return maximo / 1e3;
+}
+
+static double media_us(const HistogramaTraza *histograma) {
+    uint64_t cuenta = atomic_load(&histograma->cuenta);
+
+    return cuenta ? (double)atomic_load(&histograma->suma) / (double)cuenta / 1e3 : 0.0;
+}
+
+/**
+ * @brief Vuelca el perfil de todos los semáforos usados; se registra con atexit().
+ */
+static void volcar_perfil(void) {
+    const PerfilSemaforo *p;
+
+    fprintf(stderr, "[%d] Semaphore profile (times in us)\n", getpid());
+    fprintf(stderr, "%-12s %9s %9s %9s %6s %9s %9s %9s %9s %9s %9s %9s %9s %9s\n", "semaphore", "acquires",
+            "immediate", "blocked", "failed", "posts", "wait-mean", "wait-p50", "wait-p99", "wait-max", "hold-mean",
+            "hold-p50", "hold-p99", "hold-max");
+    for (int i = 0; i < SINCRO_NOMBRES && perfiles[i].nombre; i++) {
+        p = &perfiles[i];
+        fprintf(stderr, "%-12s %9llu %9llu %9llu %6llu %9llu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+                p->nombre, (unsigned long long)p->adquisiciones, (unsigned long long)p->inmediatas,
+                (unsigned long long)p->bloqueantes, (unsigned long long)p->fallidas,
+                (unsigned long long)p->liberaciones, media_us(&p->espera),
+                percentil_us(&p->espera, 0.50), percentil_us(&p->espera, 0.99), atomic_load(&p->espera.maximo) / 1e3,
+                media_us(&p->retenido), percentil_us(&p->retenido, 0.50), percentil_us(&p->retenido, 0.99),
+                atomic_load(&p->retenido.maximo) / 1e3);
+    }
+}
+
+/**
+ * @brief Perfil de un semáforo por su nombre; lo crea la primera vez.
+ *
+ * @return El perfil, o NULL si ya hay SINCRO_NOMBRES semáforos perfilados.
+ */
+static PerfilSemaforo *perfil(const char *nombre) {
+    int i;
+
+    for (i = 0; i < SINCRO_NOMBRES && perfiles[i].nombre; i++) {
+        /* Los nombres son literales: casi siempre basta comparar el puntero */
+        if (perfiles[i].nombre == nombre || strcmp(perfiles[i].nombre, nombre) == 0) {
+            return &perfiles[i];
+        }
+    }
+    if (i == SINCRO_NOMBRES) {
+        return NULL;
+    }
+    if (!volcado_registrado) {
+        atexit(volcar_perfil);
+        volcado_registrado = true;
+    }
+    perfiles[i].nombre = nombre;
+    return &perfiles[i];
+}
+
+#endif
+
+void sincro_configurar(Metricas *metricas_proceso, bool (*abandonar_espera)(void)) {
+    metricas = metricas_proceso;
+    abandonar = abandonar_espera;
+}
+
+bool safe_sem_wait(sem_t *sem, const char *msg) {
+    ContadorMetricas contador;
+    uint64_t antes;
+    bool tomado = true;
+#ifdef SINCRO_PERFIL
+    PerfilSemaforo *p = perfil(msg);
+    uint64_t desde = instante_ns(), hasta;
+
+    if (sem_trywait(sem) == 0) {
+        if (p) {
+            p->adquisiciones++;
+            p->inmediatas++;
+            p->tomado_ns = desde;
+        }
+        return true;
+    }
+#else
+    if (sem_trywait(sem) == 0) {
+        return true;
+    }
+#endif
+    antes = metricas_instante(metricas);
+    while (sem_wait(sem) == -1) {
+        if (errno != EINTR) {
+            perror(msg);
+            tomado = false;
+            break;
+        }
+        if (abandonar && abandonar()) {
+            tomado = false;
+            break;
+        }
+    }
+    if (metricas && (contador = contador_espera(msg)) != MET_CONTADORES) {
+        metricas_sumar(metricas, contador, metricas_instante(metricas) - antes);
+    }
+#ifdef SINCRO_PERFIL
+    if (p && tomado) {
+        hasta = instante_ns();
+        p->adquisiciones++;
+        p->bloqueantes++;
+        p->tomado_ns = hasta;
+        traza_anotar(&p->espera, hasta - desde);
+    } else if (p) {
+        p->fallidas++;
+    }
+#endif
+    return tomado;
+}
+
+bool safe_sem_post(sem_t *sem, const char *msg) {
+#ifdef SINCRO_PERFIL
+    PerfilSemaforo *p = perfil(msg);
+
+    if (p) {
+        p->liberaciones++;
+        /* Retenido es lo que va de la adquisición a la liberación siguiente de este proceso;
+           en entry_gate, que se usa como señal, mide cuánto tarda el minero en abrir a otro */
+        if (p->tomado_ns) {
+            traza_anotar(&p->retenido, instante_ns() - p->tomado_ns);
+            p->tomado_ns = 0;
+        }
+    }
+#endif
+    while (sem_post(sem) == -1) {
+        if (errno != EINTR) {
+            perror(msg);
+            return false;
+        }
+        if (abandonar && abandonar()) {
+            return false;
+        }
+    }
+    return true;
+}
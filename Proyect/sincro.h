@@ -0,0 +1,64 @@
+/**
+ * @file sincro.h
+ * @brief Espera y liberación de los semáforos con control de errores, comunes a todos los procesos.
+ *
+ * safe_sem_wait() prueba primero sem_trywait(): si el semáforo está libre no lee el reloj.
+ * Si hay que bloquearse, el tiempo esperado se suma al contador MET_ESPERA_* del semáforo
+ * cuando el proceso publica métricas.
+ *
+ * Compilado con PERFIL=1 (define SINCRO_PERFIL), cada semáforo, identificado por el nombre
+ * que se pasa como mensaje, lleva además sus adquisiciones, cuántas fueron inmediatas y
+ * cuántas bloquearon, un histograma de la espera y otro del tiempo retenido (de tomarlo a
+ * la siguiente liberación del mismo proceso). Al salir, el proceso vuelca la tabla por la
+ * salida de error. Sin PERFIL el perfil no existe y no cuesta nada.
+ */
+
+#ifndef SINCRO_H
+#define SINCRO_H
+
+#include <semaphore.h>
+#include <stdbool.h>
+
+#include "metricas.h"
+
+#define SINCRO_NOMBRES 16 /**< Semáforos distintos que se perfilan por proceso */
+
+/**
+ * @brief Fija dónde se publican las esperas y cuándo dejar de reintentar.
+ *
+ * Sin llamarla, las esperas no se publican y una señal solo hace reintentar.
+ *
+ * @param metricas Métricas del proceso, o NULL para no publicar las esperas.
+ * @param abandonar Función que dice si una señal recibida debe cortar la espera, o NULL.
+ */
+void sincro_configurar(Metricas *metricas, bool (*abandonar)(void));
+
+/**
+ * @brief Función auxiliar segura para realizar sem_wait con control de errores.
+ *
+ * Esta función intenta realizar un sem_wait en el semáforo proporcionado. Si se interrumpe
+ * por una señal, vuelve a intentar la operación salvo que abandonar() diga lo contrario.
+ * En caso de error, imprime un mensaje y devuelve false.
+ *
+ * @param sem Puntero al semáforo a esperar.
+ * @param msg Mensaje de error en caso de fallo; también es el nombre del semáforo.
+ *
+ * @return true si la operación fue exitosa, false en caso contrario.
+ */
+bool safe_sem_wait(sem_t *sem, const char *msg);
+
+/**
+ * @brief Función auxiliar segura para realizar sem_post con control de errores.
+ *
+ * Esta función intenta realizar un sem_post en el semáforo proporcionado. Si se interrumpe
+ * por una señal, vuelve a intentar la operación salvo que abandonar() diga lo contrario.
+ * En caso de error, imprime un mensaje y devuelve false.
+ *
+ * @param sem Puntero al semáforo a liberar.
+ * @param msg Mensaje de error en caso de fallo; también es el nombre del semáforo.
+ *
+ * @return true si la operación fue exitosa, false en caso contrario.
+ */
+bool safe_sem_post(sem_t *sem, const char *msg);
+
+#endif
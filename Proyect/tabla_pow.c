@@ -0,0 +1,172 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pow.h"
+#include "tabla_pow.h"
+
+#define NONCES_POR_LOTE 65536 /* Hashes calculados por llamada a pow_hash_batch al generar */
+
+/**
+ * @brief Suma de comprobación FNV-1a de 64 bits sobre las entradas de la tabla.
+ *
+ * @param nonces Entradas de la tabla.
+ * @param entradas Número de entradas.
+ * @return La suma de comprobación.
+ */
+static uint64_t suma_tabla(const uint32_t *nonces, uint32_t entradas) {
+    uint64_t suma = 0xcbf29ce484222325ULL;
+    uint32_t i;
+
+    for (i = 0; i < entradas; i++) {
+        suma ^= nonces[i];
+        suma *= 0x100000001b3ULL;
+    }
+    return suma;
+}
+
+int tabla_pow_generar(const char *ruta) {
+    CabeceraTablaPow cabecera;
+    uint32_t *nonces;
+    long int *hashes;
+    long int x, n, i;
+    char temporal[4096];
+    FILE *fichero;
+
+    nonces = (uint32_t *)malloc(sizeof(uint32_t) * POW_LIMIT);
+    hashes = (long int *)malloc(sizeof(long int) * NONCES_POR_LOTE);
+    if (!nonces || !hashes) {
+        perror("malloc");
+        free(nonces);
+        free(hashes);
+        return -1;
+    }
+
+    /* f es biyectiva en [0, POW_LIMIT): cada objetivo recibe exactamente un nonce */
+    for (x = 0; x < POW_LIMIT; x += n) {
+        n = (POW_LIMIT - x < NONCES_POR_LOTE) ? POW_LIMIT - x : NONCES_POR_LOTE;
+        pow_hash_batch(x, n, hashes);
+        for (i = 0; i < n; i++) {
+            nonces[hashes[i]] = (uint32_t)(x + i);
+        }
+    }
+    free(hashes);
+
+    memset(&cabecera, 0, sizeof(cabecera));
+    memcpy(cabecera.magico, TABLA_POW_MAGICO, sizeof(cabecera.magico));
+    cabecera.version = TABLA_POW_VERSION;
+    cabecera.entradas = POW_LIMIT;
+    cabecera.primo = POW_LIMIT;
+    cabecera.big_x = POW_BIG_X;
+    cabecera.big_y = POW_BIG_Y;
+    cabecera.suma = suma_tabla(nonces, POW_LIMIT);
+
+    snprintf(temporal, sizeof(temporal), "%s.%d.tmp", ruta, getpid());
+    fichero = fopen(temporal, "wb");
+    if (!fichero) {
+        perror("fopen");
+        free(nonces);
+        return -1;
+    }
+    if (fwrite(&cabecera, sizeof(cabecera), 1, fichero) != 1 ||
+        fwrite(nonces, sizeof(uint32_t), POW_LIMIT, fichero) != POW_LIMIT) {
+        perror("fwrite");
+        fclose(fichero);
+        unlink(temporal);
+        free(nonces);
+        return -1;
+    }
+    free(nonces);
+    if (fclose(fichero) != 0) {
+        perror("fclose");
+        unlink(temporal);
+        return -1;
+    }
+    if (rename(temporal, ruta) == -1) {
+        perror("rename");
+        unlink(temporal);
+        return -1;
+    }
+    return 0;
+}
+
+int tabla_pow_abrir(TablaPow *tabla, const char *ruta) {
+    const CabeceraTablaPow *cabecera;
+    struct stat info;
+    long int muestra;
+    int fd;
+
+    tabla->mapa = NULL;
+    fd = open(ruta, O_RDONLY);
+    if (fd == -1) {
+        perror("open tabla");
+        return -1;
+    }
+    if (fstat(fd, &info) == -1) {
+        perror("fstat tabla");
+        close(fd);
+        return -1;
+    }
+    if ((size_t)info.st_size < sizeof(CabeceraTablaPow)) {
+        fprintf(stderr, "Error: %s no es una tabla POW\n", ruta);
+        close(fd);
+        return -1;
+    }
+    tabla->tamano = (size_t)info.st_size;
+    tabla->mapa = mmap(NULL, tabla->tamano, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (tabla->mapa == MAP_FAILED) {
+        perror("mmap tabla");
+        tabla->mapa = NULL;
+        return -1;
+    }
+
+    cabecera = (const CabeceraTablaPow *)tabla->mapa;
+    tabla->nonces = (const uint32_t *)(cabecera + 1);
+    tabla->entradas = cabecera->entradas;
+    if (memcmp(cabecera->magico, TABLA_POW_MAGICO, sizeof(cabecera->magico)) != 0 ||
+        cabecera->version != TABLA_POW_VERSION) {
+        fprintf(stderr, "Error: %s no es una tabla POW de la versión %d\n", ruta, TABLA_POW_VERSION);
+        tabla_pow_cerrar(tabla);
+        return -1;
+    }
+    if (cabecera->primo != POW_LIMIT || cabecera->big_x != POW_BIG_X || cabecera->big_y != POW_BIG_Y ||
+        cabecera->entradas != POW_LIMIT ||
+        tabla->tamano != sizeof(CabeceraTablaPow) + sizeof(uint32_t) * (size_t)POW_LIMIT) {
+        fprintf(stderr, "Error: la tabla %s se generó con otros parámetros de la función POW\n", ruta);
+        tabla_pow_cerrar(tabla);
+        return -1;
+    }
+    if (suma_tabla(tabla->nonces, tabla->entradas) != cabecera->suma) {
+        fprintf(stderr, "Error: la suma de comprobación de la tabla %s no coincide\n", ruta);
+        tabla_pow_cerrar(tabla);
+        return -1;
+    }
+    /* Unas muestras contra pow_hash por si la suma coincide por casualidad */
+    for (muestra = 0; muestra < POW_LIMIT; muestra += POW_LIMIT / 16) {
+        if (tabla->nonces[pow_hash(muestra)] != muestra) {
+            fprintf(stderr, "Error: la tabla %s no corresponde a la función POW\n", ruta);
+            tabla_pow_cerrar(tabla);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+long int tabla_pow_buscar(const TablaPow *tabla, long int objetivo) {
+    if (objetivo < 0 || objetivo >= (long int)tabla->entradas) {
+        return -1;
+    }
+    return tabla->nonces[objetivo];
+}
+
+void tabla_pow_cerrar(TablaPow *tabla) {
+    if (tabla->mapa) {
+        munmap(tabla->mapa, tabla->tamano);
+        tabla->mapa = NULL;
+    }
+}
@@ -0,0 +1,84 @@
+/**
+ * @file tabla_pow.h
+ * @brief Tabla precalculada objetivo -> nonce de la función POW.
+ *
+ * Como pow_hash() es una biyección afín módulo POW_LIMIT sobre [0, POW_LIMIT), cada
+ * objetivo tiene exactamente un nonce en ese rango. La tabla guarda ese nonce para todos
+ * los objetivos en un fichero que mineros y comprobador proyectan en memoria en modo
+ * solo lectura, de modo que el sistema operativo comparte las páginas entre procesos.
+ *
+ * El fichero empieza con una cabecera con los parámetros de la función y una suma de
+ * comprobación de las entradas; una tabla generada con otros parámetros o dañada se
+ * rechaza al abrirla.
+ */
+
+#ifndef TABLA_POW_H
+#define TABLA_POW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TABLA_POW_MAGICO "POWTABLA" /**< Identificador al principio del fichero */
+#define TABLA_POW_VERSION 1 /**< Versión del formato del fichero */
+
+/**
+ * @brief Cabecera del fichero de la tabla.
+ */
+typedef struct {
+    char magico[8];     /**< TABLA_POW_MAGICO, sin terminador */
+    uint32_t version;   /**< TABLA_POW_VERSION */
+    uint32_t entradas;  /**< Número de entradas, igual a POW_LIMIT */
+    int64_t primo;      /**< Módulo P de la función */
+    int64_t big_x;      /**< Multiplicador X de la función */
+    int64_t big_y;      /**< Sumando Y de la función */
+    uint64_t suma;      /**< Suma de comprobación de las entradas */
+} CabeceraTablaPow;
+
+/**
+ * @brief Tabla proyectada en memoria.
+ */
+typedef struct {
+    void *mapa;              /**< Inicio de la proyección (la cabecera) */
+    size_t tamano;           /**< Tamaño de la proyección */
+    const uint32_t *nonces;  /**< nonces[objetivo] = nonce tal que pow_hash(nonce) == objetivo */
+    uint32_t entradas;       /**< Número de entradas */
+} TablaPow;
+
+/**
+ * @brief Calcula la tabla completa y la escribe en un fichero.
+ *
+ * El fichero se escribe con otro nombre y se renombra al terminar, así que un proceso que
+ * abra la tabla mientras se genera nunca ve un fichero a medias.
+ *
+ * @param ruta Ruta del fichero a generar.
+ * @return 0 si se ha generado correctamente, -1 en caso contrario.
+ */
+int tabla_pow_generar(const char *ruta);
+
+/**
+ * @brief Proyecta una tabla en memoria y comprueba que corresponde a la función actual.
+ *
+ * @param tabla Tabla a rellenar.
+ * @param ruta Ruta del fichero de la tabla.
+ * @return 0 si la tabla es válida, -1 si no existe, está dañada o es de otros parámetros.
+ */
+int tabla_pow_abrir(TablaPow *tabla, const char *ruta);
+
+/**
+ * @brief Devuelve el nonce cuyo hash es el objetivo, en O(1).
+ *
+ * @param tabla Tabla abierta.
+ * @param objetivo Objetivo buscado.
+ * @return El nonce, o -1 si el objetivo está fuera de [0, POW_LIMIT).
+ */
+long int tabla_pow_buscar(const TablaPow *tabla, long int objetivo);
+
+/**
+ * @brief Deshace la proyección de la tabla.
+ *
+ * @param tabla Tabla abierta.
+ */
+void tabla_pow_cerrar(TablaPow *tabla);
+
+#endif
@@ -0,0 +1,234 @@
+/**
+ * @file top_mineros.c
+ * @brief Herramienta que muestra en vivo las tasas de los mineros, el comprobador y el monitor.
+ *
+ * Uso: ./top_mineros [--intervalo <ms>] [--iteraciones <n>] [--hilos]
+ *
+ * Lee el segmento de métricas cada intervalo (1000 ms por defecto) y muestra, a partir de la
+ * diferencia entre dos lecturas, los hashes por segundo de cada minero y de cada uno de sus
+ * hilos (el más lento y el más rápido, o todos con --hilos, con la CPU de los que están
+ * fijados), las rondas ganadas, perdidas y los votos, y la parte del intervalo que ha
+ * pasado esperando cada semáforo y cada futex.
+ * Del comprobador muestra los bloques validados por segundo, la profundidad del transporte
+ * y la ocupación del anillo del monitor. La primera línea suma todo el clúster.
+ *
+ * Solo lee el segmento: no añade trabajo ni llamadas al sistema a los procesos que mide.
+ * En un terminal redibuja la pantalla; si la salida va a un fichero, añade cada muestra.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metricas.h"
+
+#define INTERVALO_POR_DEFECTO_MS 1000 /* Tiempo entre dos muestras */
+
+/* Cabecera de cada espera, en el orden de los contadores MET_ESPERA_* */
+static const char *nombres_espera[MET_N_ESPERAS] = {
+    "mutex", "m_ronda", "ganador", "entrada", "puerta", "ronda", "votos"
+};
+
+/**
+ * @brief Copia de una casilla del segmento en un instante.
+ */
+typedef struct {
+    pid_t pid;
+    uint32_t tipo;
+    uint32_t hilos;
+    uint64_t contadores[MET_CONTADORES];
+    uint64_t hashes[METRICAS_HILOS];
+    int32_t cpus[METRICAS_HILOS];
+} Muestra;
+
+static uint64_t ahora_ns(void) {
+    struct timespec ahora;
+
+    clock_gettime(CLOCK_MONOTONIC, &ahora);
+    return (uint64_t)ahora.tv_sec * 1000000000ULL + (uint64_t)ahora.tv_nsec;
+}
+
+/**
+ * @brief Copia todas las casillas ocupadas del segmento.
+ */
+static void muestrear(const SegmentoMetricas *segmento, Muestra *muestras) {
+    for (int i = 0; i < METRICAS_PROCESOS; i++) {
+        const ProcesoMetricas *proceso = &segmento->procesos[i];
+        Muestra *muestra = &muestras[i];
+
+        /* El tipo se publica el último al tomar la casilla: se lee el primero */
+        muestra->tipo = atomic_load_explicit(&proceso->tipo, memory_order_acquire);
+        muestra->pid = atomic_load_explicit(&proceso->pid, memory_order_relaxed);
+        if (muestra->tipo == PROCESO_LIBRE) {
+            continue;
+        }
+        muestra->hilos = proceso->hilos;
+        for (int c = 0; c < MET_CONTADORES; c++) {
+            muestra->contadores[c] = atomic_load_explicit(&proceso->contadores[c], memory_order_relaxed);
+        }
+        for (uint32_t h = 0; h < muestra->hilos && h < METRICAS_HILOS; h++) {
+            muestra->hashes[h] = atomic_load_explicit(&proceso->hashes[h].hashes, memory_order_relaxed);
+            muestra->cpus[h] = atomic_load_explicit(&proceso->hashes[h].cpu, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief Diferencia de un contador entre dos muestras de la misma casilla, por segundo.
+ */
+static double tasa(const Muestra *antes, const Muestra *ahora, ContadorMetricas contador, double segundos) {
+    return (double)(ahora->contadores[contador] - antes->contadores[contador]) / segundos;
+}
+
+/**
+ * @brief Muestra una pantalla con las tasas entre dos muestras.
+ */
+static void mostrar(const Muestra *antes, const Muestra *ahora, double segundos, bool por_hilo) {
+    double total_hashes = 0.0, bloques = 0.0, validos = 0.0, invalidos = 0.0, hilo, menor, mayor, suma;
+    uint64_t cola = 0, anillo = 0;
+    int mineros = 0, comprobadores = 0, monitores = 0;
+
+    for (int i = 0; i < METRICAS_PROCESOS; i++) {
+        if (ahora[i].tipo == PROCESO_LIBRE || ahora[i].pid != antes[i].pid || ahora[i].tipo != antes[i].tipo) {
+            continue;
+        }
+        if (ahora[i].tipo == PROCESO_MINERO) {
+            mineros++;
+            for (uint32_t h = 0; h < ahora[i].hilos; h++) {
+                total_hashes += (double)(ahora[i].hashes[h] - antes[i].hashes[h]) / segundos;
+            }
+        } else if (ahora[i].tipo == PROCESO_COMPROBADOR) {
+            comprobadores++;
+            bloques += tasa(&antes[i], &ahora[i], MET_BLOQUES, segundos);
+            validos += tasa(&antes[i], &ahora[i], MET_VALIDOS, segundos);
+            invalidos += tasa(&antes[i], &ahora[i], MET_INVALIDOS, segundos);
+            cola += ahora[i].contadores[MET_COLA];
+            anillo += ahora[i].contadores[MET_ANILLO];
+        } else {
+            monitores++;
+        }
+    }
+
+    printf("[%d] %d miners, %d checkers, %d monitors, every %.0f ms\n", getpid(), mineros, comprobadores, monitores,
+           segundos * 1e3);
+    printf("Cluster: %.2f MH/s, %.1f blocks/s checked (%.1f valid, %.1f invalid), transport depth %llu, "
+           "monitor ring %llu\n\n", total_hashes / 1e6, bloques, validos, invalidos,
+           (unsigned long long)cola, (unsigned long long)anillo);
+
+    printf("%8s %4s %9s %9s %9s %8s %6s %6s %6s", "pid", "thr", "MH/s", "min/thr", "max/thr", "rounds/s", "won",
+           "lost", "votes");
+    for (int e = 0; e < MET_N_ESPERAS; e++) {
+        printf(" %7s", nombres_espera[e]);
+    }
+    printf("   (wait: %% of time)\n");
+    for (int i = 0; i < METRICAS_PROCESOS; i++) {
+        if (ahora[i].tipo != PROCESO_MINERO || ahora[i].pid != antes[i].pid || antes[i].tipo != PROCESO_MINERO) {
+            continue;
+        }
+        suma = 0.0;
+        menor = -1.0;
+        mayor = 0.0;
+        for (uint32_t h = 0; h < ahora[i].hilos; h++) {
+            hilo = (double)(ahora[i].hashes[h] - antes[i].hashes[h]) / segundos;
+            suma += hilo;
+            menor = (menor < 0.0 || hilo < menor) ? hilo : menor;
+            mayor = hilo > mayor ? hilo : mayor;
+        }
+        printf("%8d %4u %9.2f %9.2f %9.2f %8.1f %6llu %6llu %6llu", ahora[i].pid, ahora[i].hilos, suma / 1e6,
+               (menor < 0.0 ? 0.0 : menor) / 1e6, mayor / 1e6, tasa(&antes[i], &ahora[i], MET_RONDAS, segundos),
+               (unsigned long long)ahora[i].contadores[MET_GANADAS],
+               (unsigned long long)ahora[i].contadores[MET_PERDIDAS],
+               (unsigned long long)ahora[i].contadores[MET_VOTOS]);
+        for (int e = 0; e < MET_N_ESPERAS; e++) {
+            /* ns esperados por segundo de intervalo, en porcentaje */
+            printf(" %6.1f%%", tasa(&antes[i], &ahora[i], (ContadorMetricas)(MET_ESPERAS + e), segundos) / 1e7);
+        }
+        printf("\n");
+        if (por_hilo) {
+            for (uint32_t h = 0; h < ahora[i].hilos; h++) {
+                printf("%8s %4u %9.2f", "", h, (double)(ahora[i].hashes[h] - antes[i].hashes[h]) / segundos / 1e6);
+                if (ahora[i].cpus[h] >= 0) {
+                    printf("   cpu %d", ahora[i].cpus[h]);
+                }
+                printf("\n");
+            }
+        }
+    }
+
+    for (int i = 0; i < METRICAS_PROCESOS; i++) {
+        if (ahora[i].tipo == PROCESO_LIBRE || ahora[i].tipo == PROCESO_MINERO || ahora[i].pid != antes[i].pid ||
+            ahora[i].tipo != antes[i].tipo) {
+            continue;
+        }
+        if (ahora[i].tipo == PROCESO_COMPROBADOR) {
+            printf("\n%8d checker: %.1f blocks/s, %llu valid, %llu invalid, transport depth %llu, monitor ring %llu\n",
+                   ahora[i].pid, tasa(&antes[i], &ahora[i], MET_BLOQUES, segundos),
+                   (unsigned long long)ahora[i].contadores[MET_VALIDOS],
+                   (unsigned long long)ahora[i].contadores[MET_INVALIDOS],
+                   (unsigned long long)ahora[i].contadores[MET_COLA],
+                   (unsigned long long)ahora[i].contadores[MET_ANILLO]);
+        } else {
+            printf("\n%8d monitor: %.1f blocks/s printed, %llu skipped\n", ahora[i].pid,
+                   tasa(&antes[i], &ahora[i], MET_BLOQUES, segundos),
+                   (unsigned long long)ahora[i].contadores[MET_SALTADOS]);
+        }
+    }
+}
+
+int main(int argc, char const *argv[]) {
+    static Muestra muestras[2][METRICAS_PROCESOS];
+    const SegmentoMetricas *segmento;
+    struct timespec espera;
+    long intervalo_ms = INTERVALO_POR_DEFECTO_MS, iteraciones = -1;
+    bool por_hilo = false, terminal = isatty(STDOUT_FILENO);
+    uint64_t antes, ahora;
+    int actual = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--intervalo") == 0 && i + 1 < argc) {
+            intervalo_ms = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--iteraciones") == 0 && i + 1 < argc) {
+            iteraciones = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--hilos") == 0) {
+            por_hilo = true;
+        } else {
+            fprintf(stderr, "Uso: %s [--intervalo <ms>] [--iteraciones <n>] [--hilos]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (intervalo_ms <= 0) {
+        fprintf(stderr, "El intervalo debe ser superior a 0 ms\n");
+        exit(EXIT_FAILURE);
+    }
+    if (metricas_leer(&segmento) != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    espera.tv_sec = intervalo_ms / 1000;
+    espera.tv_nsec = (intervalo_ms % 1000) * 1000000L;
+    antes = ahora_ns();
+    muestrear(segmento, muestras[actual]);
+    while (iteraciones != 0) {
+        nanosleep(&espera, NULL);
+        ahora = ahora_ns();
+        muestrear(segmento, muestras[1 - actual]);
+        if (terminal) {
+            printf("\033[H\033[J");
+        }
+        mostrar(muestras[actual], muestras[1 - actual], (double)(ahora - antes) / 1e9, por_hilo);
+        printf("\n");
+        fflush(stdout);
+        actual = 1 - actual;
+        antes = ahora;
+        if (iteraciones > 0) {
+            iteraciones--;
+        }
+    }
+
+    munmap((void *)segmento, sizeof(SegmentoMetricas));
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,315 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "futex.h"
+#include "transporte.h"
+
+#define ESPERA_VERSION_MS 1000 /**< Lo que espera un minero a que el comprobador termine de iniciar el anillo */
+
+/**
+ * @brief Redondea `celdas` a la potencia de dos siguiente, dentro de [2, ANILLO_MAX_CELDAS].
+ */
+static uint32_t redondear_celdas(int celdas) {
+    uint32_t potencia = 2;
+
+    while (potencia < (uint32_t)celdas && potencia < ANILLO_MAX_CELDAS) {
+        potencia <<= 1;
+    }
+    return potencia;
+}
+
+static int crear_anillo(Transporte *transporte, const char *nombre, int celdas) {
+    AnilloBloques *anillo;
+    uint32_t n = redondear_celdas(celdas);
+    size_t tamano = sizeof(AnilloBloques) + (size_t)n * sizeof(CeldaAnillo);
+    int fd;
+
+    /* Un anillo que quedase de una ejecución anterior tendría posiciones y secuencias viejas */
+    shm_unlink(nombre);
+    fd = shm_open(nombre, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        perror("shm_open anillo");
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)tamano) == -1) {
+        perror("ftruncate anillo");
+        close(fd);
+        shm_unlink(nombre);
+        return -1;
+    }
+    anillo = mmap(NULL, tamano, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (anillo == MAP_FAILED) {
+        perror("mmap anillo");
+        shm_unlink(nombre);
+        return -1;
+    }
+
+    memcpy(anillo->magico, ANILLO_MAGICO, sizeof(anillo->magico));
+    anillo->celdas = n;
+    anillo->tamano = tamano;
+    atomic_init(&anillo->cola, 0);
+    anillo->cabeza = 0;
+    atomic_init(&anillo->consumidor_dormido, 0);
+    atomic_init(&anillo->aviso_datos, 0);
+    atomic_init(&anillo->productores_esperando, 0);
+    atomic_init(&anillo->aviso_hueco, 0);
+    for (uint32_t i = 0; i < n; i++) {
+        atomic_init(&anillo->celda[i].secuencia, i);
+    }
+    /* La versión se publica la última: quien la ve, ve el anillo iniciado */
+    atomic_store_explicit(&anillo->version, ANILLO_VERSION, memory_order_release);
+
+    transporte->anillo = anillo;
+    transporte->tamano = tamano;
+    return 0;
+}
+
+int transporte_crear(Transporte *transporte, int tipo, const char *nombre, int celdas) {
+    struct mq_attr attr;
+
+    memset(transporte, 0, sizeof(*transporte));
+    transporte->tipo = tipo;
+    transporte->nombre = nombre;
+    transporte->mq = (mqd_t)-1;
+    if (tipo == TRANSPORTE_ANILLO) {
+        return crear_anillo(transporte, nombre, celdas);
+    }
+
+    attr.mq_flags   = 0;                 // bloqueo
+    attr.mq_maxmsg  = COLA_MAX_MENSAJES; // max. mensajes en cola
+    attr.mq_msgsize = BLOQUE_MAX_BYTES;  // el mayor bloque compacto posible
+    attr.mq_curmsgs = 0;                 // (lectura solo)
+    transporte->mq = mq_open(nombre, O_CREAT | O_RDONLY, 0666, &attr);
+    if (transporte->mq == (mqd_t)-1) {
+        perror("Error al crear/abrir la cola");
+        return -1;
+    }
+    return 0;
+}
+
+static int abrir_anillo(Transporte *transporte, int fd) {
+    AnilloBloques *cabecera;
+    struct stat info;
+    size_t tamano;
+    int esperado = 0;
+
+    /* El comprobador puede estar todavía dimensionando o iniciando el segmento */
+    while (fstat(fd, &info) == 0 && (size_t)info.st_size < sizeof(AnilloBloques) && esperado < ESPERA_VERSION_MS) {
+        usleep(1000);
+        esperado++;
+    }
+    if ((size_t)info.st_size < sizeof(AnilloBloques)) {
+        fprintf(stderr, "El anillo de bloques no está iniciado\n");
+        return -1;
+    }
+    cabecera = mmap(NULL, sizeof(AnilloBloques), PROT_READ, MAP_SHARED, fd, 0);
+    if (cabecera == MAP_FAILED) {
+        perror("mmap anillo");
+        return -1;
+    }
+    while (atomic_load_explicit(&cabecera->version, memory_order_acquire) != ANILLO_VERSION && esperado < ESPERA_VERSION_MS) {
+        usleep(1000);
+        esperado++;
+    }
+    if (memcmp(cabecera->magico, ANILLO_MAGICO, sizeof(cabecera->magico)) != 0 ||
+        atomic_load(&cabecera->version) != ANILLO_VERSION) {
+        fprintf(stderr, "El anillo de bloques no tiene el formato esperado\n");
+        munmap(cabecera, sizeof(AnilloBloques));
+        return -1;
+    }
+    tamano = cabecera->tamano;
+    munmap(cabecera, sizeof(AnilloBloques));
+
+    transporte->anillo = mmap(NULL, tamano, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (transporte->anillo == MAP_FAILED) {
+        perror("mmap anillo");
+        transporte->anillo = NULL;
+        return -1;
+    }
+    transporte->tamano = tamano;
+    return 0;
+}
+
+int transporte_abrir(Transporte *transporte, const char *nombre_anillo, const char *nombre_cola) {
+    int fd, resultado;
+
+    memset(transporte, 0, sizeof(*transporte));
+    transporte->mq = (mqd_t)-1;
+
+    fd = shm_open(nombre_anillo, O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd != -1) {
+        transporte->tipo = TRANSPORTE_ANILLO;
+        transporte->nombre = nombre_anillo;
+        resultado = abrir_anillo(transporte, fd);
+        close(fd);
+        return resultado;
+    }
+
+    transporte->tipo = TRANSPORTE_COLA;
+    transporte->nombre = nombre_cola;
+    transporte->mq = mq_open(nombre_cola, O_RDWR);
+    if (transporte->mq == (mqd_t)-1) {
+        printf("Error al abrir la cola de mensajes\n");
+        perror("Error al abrir la cola");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Espera a que el consumidor libere la celda `celda`, que esperaba la posición `posicion`.
+ *
+ * Vuelve al recibir el aviso, al vencer la espera o al llegar una señal; en todos los casos
+ * quien llama vuelve a mirar la celda.
+ */
+static void esperar_hueco(AnilloBloques *anillo, CeldaAnillo *celda, uint64_t posicion) {
+    uint32_t aviso = atomic_load(&anillo->aviso_hueco);
+
+    atomic_fetch_add(&anillo->productores_esperando, 1);
+    /* Tras anunciarse se vuelve a mirar: si el consumidor ya liberó la celda no habrá aviso */
+    if ((int64_t)(atomic_load(&celda->secuencia) - posicion) < 0) {
+        futex_esperar(&anillo->aviso_hueco, aviso, ESPERA_TRANSPORTE_MS);
+    }
+    atomic_fetch_sub(&anillo->productores_esperando, 1);
+}
+
+static int enviar_anillo(AnilloBloques *anillo, const void *mensaje, size_t bytes) {
+    uint64_t mascara = anillo->celdas - 1;
+    uint64_t posicion = atomic_load_explicit(&anillo->cola, memory_order_relaxed);
+    CeldaAnillo *celda;
+    int64_t diferencia;
+
+    for (;;) {
+        celda = &anillo->celda[posicion & mascara];
+        diferencia = (int64_t)(atomic_load_explicit(&celda->secuencia, memory_order_acquire) - posicion);
+        if (diferencia == 0) {
+            /* La celda está libre para esta posición: se reserva avanzando la cola */
+            if (atomic_compare_exchange_weak_explicit(&anillo->cola, &posicion, posicion + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diferencia < 0) {
+            /* El consumidor no ha leído aún la vuelta anterior de esta celda: anillo lleno. Una
+               señal no aborta el envío, igual que mq_send con SA_RESTART: el bloque se entrega */
+            esperar_hueco(anillo, celda, posicion);
+            posicion = atomic_load_explicit(&anillo->cola, memory_order_relaxed);
+        } else {
+            /* Otro productor se ha llevado la posición */
+            posicion = atomic_load_explicit(&anillo->cola, memory_order_relaxed);
+        }
+    }
+
+    memcpy(celda->datos, mensaje, bytes);
+    celda->bytes = bytes;
+    atomic_store_explicit(&celda->secuencia, posicion + 1, memory_order_release);
+
+    /* Solo se entra en el núcleo si el consumidor se ha ido a dormir */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&anillo->consumidor_dormido, memory_order_relaxed)) {
+        atomic_fetch_add(&anillo->aviso_datos, 1);
+        futex_despertar_uno(&anillo->aviso_datos);
+    }
+    return 0;
+}
+
+int transporte_enviar(Transporte *transporte, const void *mensaje, size_t bytes) {
+    if (bytes > BLOQUE_MAX_BYTES) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (transporte->tipo == TRANSPORTE_ANILLO) {
+        return enviar_anillo(transporte->anillo, mensaje, bytes);
+    }
+    return mq_send(transporte->mq, mensaje, bytes, 0);
+}
+
+static ssize_t recibir_anillo(AnilloBloques *anillo, void *buffer) {
+    CeldaAnillo *celda = &anillo->celda[anillo->cabeza & (anillo->celdas - 1)];
+    uint64_t listo = anillo->cabeza + 1;
+    uint32_t aviso;
+    size_t bytes;
+
+    while (atomic_load_explicit(&celda->secuencia, memory_order_acquire) != listo) {
+        aviso = atomic_load(&anillo->aviso_datos);
+        atomic_store_explicit(&anillo->consumidor_dormido, 1, memory_order_relaxed);
+        /* Tras anunciarse se vuelve a mirar: un productor que publicó antes no avisará */
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&celda->secuencia, memory_order_acquire) != listo) {
+            futex_esperar(&anillo->aviso_datos, aviso, ESPERA_TRANSPORTE_MS);
+        }
+        atomic_store_explicit(&anillo->consumidor_dormido, 0, memory_order_relaxed);
+    }
+
+    bytes = celda->bytes;
+    memcpy(buffer, celda->datos, bytes);
+    /* La celda queda libre para la posición de la siguiente vuelta */
+    atomic_store_explicit(&celda->secuencia, anillo->cabeza + anillo->celdas, memory_order_release);
+    anillo->cabeza++;
+
+    /* Los productores bloqueados se despiertan cuando se ha vaciado medio anillo, no en cada
+       celda: así cada despertar les deja sitio para una ráfaga y no para un solo bloque */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&anillo->productores_esperando, memory_order_relaxed) > 0 &&
+        atomic_load_explicit(&anillo->cola, memory_order_relaxed) - anillo->cabeza <= anillo->celdas / 2) {
+        atomic_fetch_add(&anillo->aviso_hueco, 1);
+        futex_despertar_todos(&anillo->aviso_hueco);
+    }
+    return (ssize_t)bytes;
+}
+
+ssize_t transporte_recibir(Transporte *transporte, void *buffer) {
+    ssize_t bytes;
+
+    if (transporte->tipo == TRANSPORTE_ANILLO) {
+        return recibir_anillo(transporte->anillo, buffer);
+    }
+    while ((bytes = mq_receive(transporte->mq, buffer, BLOQUE_MAX_BYTES, NULL)) == -1) {
+        if (errno != EINTR) {
+            perror("Error en mq_receive");
+            return -1;
+        }
+    }
+    return bytes;
+}
+
+long transporte_pendientes(const Transporte *transporte) {
+    struct mq_attr atributos;
+
+    if (transporte->tipo == TRANSPORTE_ANILLO) {
+        /* Incluye las celdas reservadas que su productor aún no ha publicado */
+        return (long)(atomic_load_explicit(&transporte->anillo->cola, memory_order_relaxed) - transporte->anillo->cabeza);
+    }
+    if (mq_getattr(transporte->mq, &atributos) == -1) {
+        return 0;
+    }
+    return atributos.mq_curmsgs;
+}
+
+void transporte_cerrar(Transporte *transporte) {
+    if (transporte->tipo == TRANSPORTE_ANILLO) {
+        if (transporte->anillo) {
+            munmap(transporte->anillo, transporte->tamano);
+            transporte->anillo = NULL;
+        }
+    } else if (transporte->mq != (mqd_t)-1) {
+        mq_close(transporte->mq);
+        transporte->mq = (mqd_t)-1;
+    }
+}
+
+void transporte_borrar(Transporte *transporte) {
+    if (transporte->nombre == NULL) {
+        return;
+    }
+    if (transporte->tipo == TRANSPORTE_ANILLO) {
+        shm_unlink(transporte->nombre);
+    } else {
+        mq_unlink(transporte->nombre);
+    }
+}
@@ -0,0 +1,143 @@
+/**
+ * @file transporte.h
+ * @brief Transporte de bloques de los mineros al comprobador.
+ *
+ * Hay dos transportes intercambiables: la cola de mensajes POSIX de siempre y un anillo
+ * en memoria compartida de varios productores y un consumidor, sin bloqueos. En el
+ * anillo cada celda lleva un número de secuencia que dice si está libre para el
+ * productor que la reservó o lista para el consumidor, así que los productores solo
+ * compiten por un CAS en la cola. El consumidor solo entra en el núcleo para dormir
+ * cuando no hay nada que leer, y los productores solo lo despiertan si está dormido.
+ * Con el anillo lleno los productores esperan a que haya hueco (contrapresión).
+ *
+ * El comprobador elige el transporte al crearlo; los mineros usan el anillo si existe y
+ * la cola en otro caso.
+ */
+
+#ifndef TRANSPORTE_H
+#define TRANSPORTE_H
+
+#include <mqueue.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "bloque.h"
+
+#define TRANSPORTE_COLA 0   /**< Cola de mensajes POSIX */
+#define TRANSPORTE_ANILLO 1 /**< Anillo en memoria compartida */
+
+#define ANILLO_NAME "/anillo_bloques" /**< Segmento del anillo de bloques */
+#define ANILLO_MAGICO "ANILLOB" /**< Identifica el segmento del anillo */
+#define ANILLO_VERSION 1 /**< Versión del formato del segmento del anillo */
+#define ANILLO_CELDAS_POR_DEFECTO 64 /**< Celdas del anillo si no se indica otra cosa */
+#define ANILLO_MAX_CELDAS 4096 /**< Mayor número de celdas admitido */
+#define COLA_MAX_MENSAJES 10 /**< Mensajes de la cola POSIX (límite por defecto de msg_max) */
+#define ESPERA_TRANSPORTE_MS 50 /**< Espera máxima en un futex antes de volver a comprobar el anillo */
+
+/**
+ * @brief Celda del anillo: un mensaje y su número de secuencia.
+ *
+ * La secuencia vale `posición` cuando la celda está libre para el productor de esa
+ * posición y `posición + 1` cuando el mensaje está listo para el consumidor.
+ */
+typedef struct {
+    _Alignas(64) _Atomic uint64_t secuencia;
+    size_t bytes; /**< Longitud del mensaje */
+    unsigned char datos[BLOQUE_MAX_BYTES];
+} CeldaAnillo;
+
+/**
+ * @brief Segmento del anillo: cabecera versionada y `celdas` celdas.
+ */
+typedef struct {
+    char magico[8]; /**< ANILLO_MAGICO */
+    _Atomic uint32_t version; /**< ANILLO_VERSION; se escribe la última */
+    uint32_t celdas; /**< Número de celdas, potencia de dos */
+    size_t tamano; /**< Tamaño total del segmento en bytes */
+    _Alignas(64) _Atomic uint64_t cola; /**< Siguiente posición que reservará un productor */
+    _Alignas(64) uint64_t cabeza; /**< Siguiente posición que leerá el consumidor; solo la toca él */
+    _Atomic int consumidor_dormido; /**< El consumidor está (o va a estar) dormido en aviso_datos */
+    _Atomic uint32_t aviso_datos; /**< Palabra futex en la que duerme el consumidor */
+    _Alignas(64) _Atomic int productores_esperando; /**< Productores dormidos en aviso_hueco */
+    _Atomic uint32_t aviso_hueco; /**< Palabra futex en la que duermen los productores con el anillo lleno */
+    CeldaAnillo celda[]; /**< Celdas del anillo */
+} AnilloBloques;
+
+/**
+ * @brief Un extremo del transporte, del tipo que sea.
+ */
+typedef struct {
+    int tipo; /**< TRANSPORTE_COLA o TRANSPORTE_ANILLO */
+    mqd_t mq; /**< Cola POSIX, si tipo es TRANSPORTE_COLA */
+    AnilloBloques *anillo; /**< Anillo proyectado, si tipo es TRANSPORTE_ANILLO */
+    size_t tamano; /**< Bytes proyectados del anillo */
+    const char *nombre; /**< Nombre de la cola o del segmento */
+} Transporte;
+
+/**
+ * @brief Crea el transporte en el lado del comprobador.
+ *
+ * @param transporte Transporte a rellenar.
+ * @param tipo TRANSPORTE_COLA o TRANSPORTE_ANILLO.
+ * @param nombre Nombre de la cola o del segmento del anillo.
+ * @param celdas Celdas del anillo; se redondea a potencia de dos. Se ignora con la cola.
+ * @return 0 si todo va bien, -1 en caso de error.
+ */
+int transporte_crear(Transporte *transporte, int tipo, const char *nombre, int celdas);
+
+/**
+ * @brief Abre el transporte en el lado del minero: el anillo si existe, la cola si no.
+ *
+ * @param transporte Transporte a rellenar.
+ * @param nombre_anillo Nombre del segmento del anillo.
+ * @param nombre_cola Nombre de la cola.
+ * @return 0 si todo va bien, -1 si no existe ninguno de los dos.
+ */
+int transporte_abrir(Transporte *transporte, const char *nombre_anillo, const char *nombre_cola);
+
+/**
+ * @brief Envía un mensaje. Si no hay hueco espera a que el consumidor lo haga.
+ *
+ * @param transporte Transporte abierto.
+ * @param mensaje Mensaje a enviar.
+ * @param bytes Longitud, como mucho BLOQUE_MAX_BYTES.
+ * @return 0 si se ha enviado, -1 en caso de error.
+ */
+int transporte_enviar(Transporte *transporte, const void *mensaje, size_t bytes);
+
+/**
+ * @brief Recibe el siguiente mensaje, esperando si no hay ninguno. Solo un consumidor.
+ *
+ * @param transporte Transporte creado con transporte_crear().
+ * @param buffer Destino, de al menos BLOQUE_MAX_BYTES bytes.
+ * @return Longitud del mensaje, o -1 en caso de error.
+ */
+ssize_t transporte_recibir(Transporte *transporte, void *buffer);
+
+/**
+ * @brief Mensajes pendientes de recibir. Solo la llama el consumidor.
+ *
+ * Con el anillo es una resta de índices; con la cola cuesta un mq_getattr().
+ *
+ * @param transporte Transporte creado con transporte_crear().
+ * @return Mensajes pendientes, o 0 si no se pueden consultar.
+ */
+long transporte_pendientes(const Transporte *transporte);
+
+/**
+ * @brief Cierra el transporte en este proceso.
+ *
+ * @param transporte Transporte abierto o creado.
+ */
+void transporte_cerrar(Transporte *transporte);
+
+/**
+ * @brief Borra la cola o el segmento del sistema; los que lo tengan abierto siguen usándolo.
+ *
+ * @param transporte Transporte abierto o creado.
+ */
+void transporte_borrar(Transporte *transporte);
+
+#endif
@@ -0,0 +1,257 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "traza.h"
+
+const char *const traza_nombres_fase[FASES] = {
+    "wake", "start", "mining", "semaphore", "vote-open", "votes", "send", "check", "print", "close", "round"
+};
+
+/**
+ * @brief Suma a un contador que solo escribe este proceso, sin instrucción atómica.
+ */
+static inline void sumar(_Atomic uint64_t *contador, uint64_t valor) {
+    atomic_store_explicit(contador, atomic_load_explicit(contador, memory_order_relaxed) + valor,
+                          memory_order_relaxed);
+}
+
+/**
+ * @brief Pasa los histogramas de una casilla a los retirados y la deja a ceros.
+ *
+ * Solo se llama con la casilla ya tomada por este proceso; los retirados los pueden tocar
+ * varios procesos a la vez, así que ahí sí se suma con instrucciones atómicas.
+ */
+static void retirar(SegmentoTraza *segmento, ProcesoTraza *proceso) {
+    uint64_t maximo, visto;
+
+    for (int f = 0; f < FASES; f++) {
+        HistogramaTraza *origen = &proceso->fases[f], *destino = &segmento->retirados[f];
+
+        atomic_fetch_add(&destino->cuenta, atomic_exchange(&origen->cuenta, 0));
+        atomic_fetch_add(&destino->suma, atomic_exchange(&origen->suma, 0));
+        maximo = atomic_exchange(&origen->maximo, 0);
+        visto = atomic_load(&destino->maximo);
+        while (maximo > visto && !atomic_compare_exchange_weak(&destino->maximo, &visto, maximo)) {
+        }
+        for (int c = 0; c < TRAZA_CUBETAS; c++) {
+            if (atomic_load_explicit(&origen->cubetas[c], memory_order_relaxed)) {
+                atomic_fetch_add(&destino->cubetas[c], atomic_exchange(&origen->cubetas[c], 0));
+            }
+        }
+    }
+}
+
+/**
+ * @brief Toma una casilla para este proceso.
+ *
+ * Primero la que ya fuera suya, luego una sin usar y por último la de un proceso muerto.
+ *
+ * @return La casilla, o NULL si todas son de procesos vivos.
+ */
+static ProcesoTraza *tomar_casilla_traza(SegmentoTraza *segmento) {
+    pid_t yo = getpid(), otro;
+
+    for (int i = 0; i < TRAZA_PROCESOS; i++) {
+        if (atomic_load(&segmento->procesos[i].pid) == yo) {
+            return &segmento->procesos[i];
+        }
+    }
+    for (int i = 0; i < TRAZA_PROCESOS; i++) {
+        otro = 0;
+        if (atomic_compare_exchange_strong(&segmento->procesos[i].pid, &otro, yo)) {
+            return &segmento->procesos[i];
+        }
+    }
+    for (int i = 0; i < TRAZA_PROCESOS; i++) {
+        otro = atomic_load(&segmento->procesos[i].pid);
+        if (otro > 0 && kill(otro, 0) == -1 && errno == ESRCH &&
+            atomic_compare_exchange_strong(&segmento->procesos[i].pid, &otro, yo)) {
+            retirar(segmento, &segmento->procesos[i]);
+            return &segmento->procesos[i];
+        }
+    }
+    return NULL;
+}
+
+int traza_abrir(Traza *traza) {
+    struct stat info;
+    uint32_t version = 0;
+    int fd;
+
+    if ((fd = shm_open(SHM_NAME_TRAZA, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR)) == -1) {
+        perror("shm_open traza");
+        return -1;
+    }
+    if (fstat(fd, &info) == -1) {
+        perror("fstat traza");
+        close(fd);
+        return -1;
+    }
+    /* Un segmento nuevo queda a ceros, que ya es un estado válido */
+    if (info.st_size == 0 && ftruncate(fd, sizeof(SegmentoTraza)) == -1) {
+        perror("ftruncate traza");
+        close(fd);
+        return -1;
+    }
+    if (info.st_size != 0 && (size_t)info.st_size != sizeof(SegmentoTraza)) {
+        fprintf(stderr, "%s no es una traza de la versión %d\n", SHM_NAME_TRAZA, TRAZA_VERSION);
+        close(fd);
+        return -1;
+    }
+    traza->segmento = mmap(NULL, sizeof(SegmentoTraza), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (traza->segmento == MAP_FAILED) {
+        perror("mmap traza");
+        return -1;
+    }
+    if (!atomic_compare_exchange_strong(&traza->segmento->version, &version, TRAZA_VERSION) &&
+        version != TRAZA_VERSION) {
+        fprintf(stderr, "%s no es una traza de la versión %d\n", SHM_NAME_TRAZA, TRAZA_VERSION);
+        munmap(traza->segmento, sizeof(SegmentoTraza));
+        return -1;
+    }
+    if ((traza->proceso = tomar_casilla_traza(traza->segmento)) == NULL) {
+        fprintf(stderr, "No quedan casillas en la traza (%d procesos vivos)\n", TRAZA_PROCESOS);
+        munmap(traza->segmento, sizeof(SegmentoTraza));
+        return -1;
+    }
+    return 0;
+}
+
+int traza_leer(const SegmentoTraza **segmento) {
+    struct stat info;
+    int fd;
+
+    if ((fd = shm_open(SHM_NAME_TRAZA, O_RDONLY, 0)) == -1) {
+        perror("shm_open traza");
+        return -1;
+    }
+    if (fstat(fd, &info) == -1 || (size_t)info.st_size != sizeof(SegmentoTraza)) {
+        fprintf(stderr, "%s no es una traza de la versión %d\n", SHM_NAME_TRAZA, TRAZA_VERSION);
+        close(fd);
+        return -1;
+    }
+    *segmento = mmap(NULL, sizeof(SegmentoTraza), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (*segmento == MAP_FAILED) {
+        perror("mmap traza");
+        return -1;
+    }
+    if (atomic_load(&(*segmento)->version) != TRAZA_VERSION) {
+        fprintf(stderr, "%s no es una traza de la versión %d\n", SHM_NAME_TRAZA, TRAZA_VERSION);
+        munmap((void *)*segmento, sizeof(SegmentoTraza));
+        return -1;
+    }
+    return 0;
+}
+
+uint64_t traza_instante(const Traza *traza) {
+    struct timespec ahora;
+
+    if (!traza) {
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ahora);
+    return (uint64_t)ahora.tv_sec * 1000000000ULL + (uint64_t)ahora.tv_nsec;
+}
+
+void traza_abrir_ronda(Traza *traza, int ronda, uint64_t instante) {
+    RondaTraza *marcas;
+
+    if (!traza) {
+        return;
+    }
+    marcas = &traza->segmento->rondas[ronda & (TRAZA_RONDAS - 1)];
+    /* Las marcas de la ronda que ocupaba la posición se borran antes de publicar el id */
+    for (int m = 0; m < MARCAS; m++) {
+        atomic_store_explicit(&marcas->marcas[m], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&marcas->id, ronda, memory_order_release);
+    atomic_store_explicit(&marcas->marcas[MARCA_RONDA], instante, memory_order_relaxed);
+}
+
+void traza_marcar(Traza *traza, int ronda, MarcaTraza marca, uint64_t instante) {
+    RondaTraza *marcas;
+
+    if (!traza) {
+        return;
+    }
+    marcas = &traza->segmento->rondas[ronda & (TRAZA_RONDAS - 1)];
+    if (atomic_load_explicit(&marcas->id, memory_order_acquire) == ronda) {
+        atomic_store_explicit(&marcas->marcas[marca], instante, memory_order_relaxed);
+    }
+}
+
+uint64_t traza_marca(const Traza *traza, int ronda, MarcaTraza marca) {
+    const RondaTraza *marcas;
+
+    if (!traza) {
+        return 0;
+    }
+    marcas = &traza->segmento->rondas[ronda & (TRAZA_RONDAS - 1)];
+    if (atomic_load_explicit(&marcas->id, memory_order_acquire) != ronda) {
+        return 0;
+    }
+    return atomic_load_explicit(&marcas->marcas[marca], memory_order_relaxed);
+}
+
+int traza_cubeta(uint64_t ns) {
+    int desplazamiento;
+
+    if (ns >= (1ULL << TRAZA_EXPONENTE)) {
+        ns = (1ULL << TRAZA_EXPONENTE) - 1;
+    }
+    /* Por debajo de 2^(SUBBITS+1) cada nanosegundo tiene su cubeta */
+    if (ns < (2ULL << TRAZA_SUBBITS)) {
+        return (int)ns;
+    }
+    /* Después, 16 cubetas por potencia de dos con los bits que siguen al más alto */
+    desplazamiento = 63 - __builtin_clzll(ns) - TRAZA_SUBBITS;
+    return (desplazamiento << TRAZA_SUBBITS) + (int)(ns >> desplazamiento);
+}
+
+uint64_t traza_cubeta_inicio(int cubeta) {
+    int desplazamiento;
+
+    if (cubeta < (2 << TRAZA_SUBBITS)) {
+        return (uint64_t)cubeta;
+    }
+    desplazamiento = (cubeta >> TRAZA_SUBBITS) - 1;
+    return ((uint64_t)(cubeta & ((1 << TRAZA_SUBBITS) - 1)) + (1ULL << TRAZA_SUBBITS)) << desplazamiento;
+}
+
+void traza_anotar(HistogramaTraza *histograma, uint64_t ns) {
+    sumar(&histograma->cubetas[traza_cubeta(ns)], 1);
+    sumar(&histograma->suma, ns);
+    if (ns > atomic_load_explicit(&histograma->maximo, memory_order_relaxed)) {
+        atomic_store_explicit(&histograma->maximo, ns, memory_order_relaxed);
+    }
+    /* La cuenta va la última: quien vuelca no ve una muestra sin su cubeta */
+    atomic_store_explicit(&histograma->cuenta, atomic_load_explicit(&histograma->cuenta, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+void traza_fase(Traza *traza, FaseTraza fase, uint64_t desde, uint64_t hasta) {
+    if (!traza || desde == 0 || hasta < desde) {
+        return;
+    }
+    traza_anotar(&traza->proceso->fases[fase], hasta - desde);
+}
+
+uint64_t traza_cruzar(Traza *traza, int ronda, MarcaTraza marca, FaseTraza fase, MarcaTraza desde) {
+    uint64_t instante = traza_instante(traza);
+
+    traza_marcar(traza, ronda, marca, instante);
+    traza_fase(traza, fase, traza_marca(traza, ronda, desde), instante);
+    return instante;
+}
+
+void traza_cerrar(Traza *traza) {
+    munmap(traza->segmento, sizeof(SegmentoTraza));
+}
@@ -0,0 +1,227 @@
+/**
+ * @file traza.h
+ * @brief Traza de latencia de las rondas, por fases, en memoria compartida.
+ *
+ * Cada proceso trazado (mineros, comprobador y monitor) toma con un CAS una casilla del
+ * segmento SHM_NAME_TRAZA y anota en ella la duración de cada fase de la ronda en un
+ * histograma logarítmico-lineal al estilo HDR: 16 cubetas por potencia de dos, con un
+ * error relativo de como mucho un 6,25 %. La casilla solo la escribe su proceso, así que
+ * anotar son unas pocas cargas y almacenamientos relajados, sin operaciones atómicas de
+ * lectura-modificación-escritura, sin bloqueos ni llamadas al sistema: junto con la
+ * lectura de CLOCK_MONOTONIC, que va por el vDSO, cuesta unas decenas de nanosegundos.
+ *
+ * Las fases que empiezan en un proceso y acaban en otro se miden con las marcas de la
+ * ronda: un anillo indexado por el id del bloque donde cada proceso deja el instante en el
+ * que la ronda cruza una frontera. CLOCK_MONOTONIC es el mismo reloj en todo el sistema,
+ * así que las marcas de procesos distintos se pueden restar.
+ *
+ * El segmento sobrevive a los procesos: volcar_traza suma las casillas y muestra los
+ * percentiles de cada fase en cualquier momento, también con la red en marcha.
+ */
+
+#ifndef TRAZA_H
+#define TRAZA_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SHM_NAME_TRAZA "/traza_rondas" /**< Nombre del segmento de la traza */
+#define TRAZA_VERSION 1 /**< Versión del formato del segmento */
+#define TRAZA_PROCESOS 64 /**< Procesos que pueden trazar a la vez */
+#define TRAZA_RONDAS 1024 /**< Rondas recientes con marcas, potencia de dos */
+#define TRAZA_SUBBITS 4 /**< Bits de mantisa: 16 cubetas por potencia de dos */
+#define TRAZA_EXPONENTE 36 /**< Latencias de hasta 2^36 ns (68 s); las mayores van a la última cubeta */
+#define TRAZA_CUBETAS ((TRAZA_EXPONENTE - TRAZA_SUBBITS + 1) << TRAZA_SUBBITS) /**< Cubetas por histograma */
+
+/**
+ * @brief Fronteras de una ronda que se marcan en el anillo de rondas.
+ */
+typedef enum {
+    MARCA_RONDA,      /**< El ganador anterior (o el primer minero) abre la ronda */
+    MARCA_SOLUCION,   /**< El ganador encuentra la solución */
+    MARCA_GANADOR,    /**< El ganador toma el semáforo ganador */
+    MARCA_VOTACION,   /**< La votación queda abierta para todos los mineros */
+    MARCA_VOTOS,      /**< La votación queda decidida */
+    MARCA_ENVIO,      /**< El bloque codificado se entrega al transporte */
+    MARCA_VALIDADO,   /**< El comprobador termina de validar el bloque */
+    MARCA_IMPRESO,    /**< El monitor formatea el bloque */
+    MARCAS
+} MarcaTraza;
+
+/**
+ * @brief Fases de la ronda con histograma propio.
+ */
+typedef enum {
+    FASE_DESPERTAR,    /**< Apertura de la ronda -> el minero despierta (cada minero) */
+    FASE_ARRANQUE,     /**< Despertar -> empieza la búsqueda (cada minero) */
+    FASE_MINADO,       /**< Empieza la búsqueda -> solución (cada minero que la encuentra) */
+    FASE_SEMAFORO,     /**< Solución -> semáforo ganador tomado (cada minero que la encuentra) */
+    FASE_VOTACION,     /**< Semáforo tomado -> votación abierta */
+    FASE_VOTOS,        /**< Votación abierta -> votación decidida */
+    FASE_ENVIO,        /**< Votación decidida -> bloque codificado y entregado al transporte */
+    FASE_COMPROBACION, /**< Entrega al transporte -> bloque recibido y validado */
+    FASE_IMPRESION,    /**< Bloque validado -> publicado y formateado por el monitor */
+    FASE_CIERRE,       /**< Entrega al transporte -> apertura de la ronda siguiente */
+    FASE_RONDA,        /**< Apertura de la ronda -> bloque formateado por el monitor */
+    FASES
+} FaseTraza;
+
+extern const char *const traza_nombres_fase[FASES]; /**< Nombre corto de cada fase, para los volcados */
+
+/**
+ * @brief Histograma de una fase.
+ */
+typedef struct {
+    _Atomic uint64_t cuenta; /**< Muestras anotadas */
+    _Atomic uint64_t suma; /**< Suma de las muestras, en ns */
+    _Atomic uint64_t maximo; /**< Mayor muestra, en ns */
+    _Atomic uint64_t cubetas[TRAZA_CUBETAS]; /**< Muestras por cubeta */
+} HistogramaTraza;
+
+/**
+ * @brief Casilla de un proceso: solo la escribe el proceso que la ocupa.
+ */
+typedef struct {
+    _Alignas(64) _Atomic pid_t pid; /**< Proceso que la ocupa, 0 si nunca se ha usado */
+    HistogramaTraza fases[FASES]; /**< Un histograma por fase */
+} ProcesoTraza;
+
+/**
+ * @brief Marcas de una ronda reciente.
+ */
+typedef struct {
+    _Alignas(64) _Atomic int id; /**< Bloque al que pertenecen las marcas */
+    _Atomic uint64_t marcas[MARCAS]; /**< Instantes CLOCK_MONOTONIC en ns, 0 si no ha pasado */
+} RondaTraza;
+
+/**
+ * @brief Contenido del segmento; a ceros ya es válido.
+ */
+typedef struct {
+    _Atomic uint32_t version; /**< TRAZA_VERSION, o 0 si nadie lo ha abierto todavía */
+    HistogramaTraza retirados[FASES]; /**< Lo anotado por procesos muertos cuya casilla se reutilizó */
+    ProcesoTraza procesos[TRAZA_PROCESOS]; /**< Casillas de los procesos */
+    RondaTraza rondas[TRAZA_RONDAS]; /**< Marcas de las rondas, por id de bloque */
+} SegmentoTraza;
+
+/**
+ * @brief Traza abierta por un proceso.
+ */
+typedef struct {
+    SegmentoTraza *segmento; /**< Proyección del segmento */
+    ProcesoTraza *proceso; /**< Casilla del proceso */
+} Traza;
+
+/**
+ * @brief Abre o crea el segmento de la traza y toma una casilla para este proceso.
+ *
+ * Si todas las casillas están ocupadas por procesos vivos, reutiliza la de uno muerto tras
+ * pasar sus histogramas a los retirados.
+ *
+ * @param traza Traza a rellenar.
+ * @return 0 si todo va bien, -1 en caso de error.
+ */
+int traza_abrir(Traza *traza);
+
+/**
+ * @brief Proyecta el segmento de la traza solo para leerlo.
+ *
+ * @param segmento Proyección del segmento.
+ * @return 0 si todo va bien, -1 si no existe o es de otra versión.
+ */
+int traza_leer(const SegmentoTraza **segmento);
+
+/**
+ * @brief Instante actual de CLOCK_MONOTONIC en nanosegundos.
+ *
+ * @param traza Traza abierta, o NULL para no leer el reloj.
+ * @return El instante, o 0 si la traza es NULL.
+ */
+uint64_t traza_instante(const Traza *traza);
+
+/**
+ * @brief Abre las marcas de una ronda y deja la de apertura.
+ *
+ * @param traza Traza abierta, o NULL para no trazar.
+ * @param ronda Id del bloque de la ronda.
+ * @param instante Instante de apertura.
+ */
+void traza_abrir_ronda(Traza *traza, int ronda, uint64_t instante);
+
+/**
+ * @brief Deja una marca de una ronda abierta.
+ *
+ * @param traza Traza abierta, o NULL para no trazar.
+ * @param ronda Id del bloque de la ronda.
+ * @param marca Frontera que cruza la ronda.
+ * @param instante Instante en el que la cruza.
+ */
+void traza_marcar(Traza *traza, int ronda, MarcaTraza marca, uint64_t instante);
+
+/**
+ * @brief Instante de una marca de una ronda reciente.
+ *
+ * @param traza Traza abierta, o NULL.
+ * @param ronda Id del bloque de la ronda.
+ * @param marca Frontera buscada.
+ * @return El instante, o 0 si no se marcó o la ronda ya no está en el anillo.
+ */
+uint64_t traza_marca(const Traza *traza, int ronda, MarcaTraza marca);
+
+/**
+ * @brief Anota la duración de una fase en el histograma del proceso.
+ *
+ * No anota nada si la traza es NULL o si falta alguno de los dos instantes.
+ *
+ * @param traza Traza abierta, o NULL para no trazar.
+ * @param fase Fase medida.
+ * @param desde Instante en que empezó, o 0 si no se conoce.
+ * @param hasta Instante en que acabó.
+ */
+void traza_fase(Traza *traza, FaseTraza fase, uint64_t desde, uint64_t hasta);
+
+/**
+ * @brief Anota una latencia en un histograma que solo escribe el hilo que llama.
+ *
+ * @param histograma Histograma con un único escritor.
+ * @param ns Latencia en nanosegundos.
+ */
+void traza_anotar(HistogramaTraza *histograma, uint64_t ns);
+
+/**
+ * @brief Marca una frontera de la ronda y anota la fase que acaba en ella.
+ *
+ * @param traza Traza abierta, o NULL para no trazar.
+ * @param ronda Id del bloque de la ronda.
+ * @param marca Frontera que cruza ahora la ronda.
+ * @param fase Fase que acaba en esta frontera.
+ * @param desde Marca de la ronda en la que empezó la fase.
+ * @return El instante de la marca, o 0 si la traza es NULL.
+ */
+uint64_t traza_cruzar(Traza *traza, int ronda, MarcaTraza marca, FaseTraza fase, MarcaTraza desde);
+
+/**
+ * @brief Cubeta de un histograma en la que cae una latencia.
+ *
+ * @param ns Latencia en nanosegundos.
+ * @return Índice de la cubeta, menor que TRAZA_CUBETAS.
+ */
+int traza_cubeta(uint64_t ns);
+
+/**
+ * @brief Menor latencia que cae en una cubeta.
+ *
+ * @param cubeta Índice de la cubeta.
+ * @return Latencia en nanosegundos.
+ */
+uint64_t traza_cubeta_inicio(int cubeta);
+
+/**
+ * @brief Deshace la proyección del segmento; la casilla queda con sus histogramas.
+ *
+ * @param traza Traza abierta.
+ */
+void traza_cerrar(Traza *traza);
+
+#endif
@@ -0,0 +1,437 @@
+/**
+ * @file verificar.c
+ * @brief Herramienta que audita un libro de bloques repartiendo el trabajo entre todos los núcleos.
+ *
+ * Uso: ./verificar <libro> [hilos]
+ *
+ * En cada bloque comprueba que pow_hash(solucion) == objetivo, que la marca de validado lo
+ * refleja y que los votos a favor no superan a los emitidos. Entre bloques consecutivos
+ * comprueba que el objetivo es la solución del anterior (como lo deja ganador()), que no
+ * faltan ids y que ninguna cartera baja ni sube, salvo la del ganador: una moneda y solo
+ * con mayoría de los votos emitidos. Una red nueva puede empezar otra vez en el id 1.
+ *
+ * El libro se parte en tramos que empiezan en los registros que el índice da para los ids
+ * múltiplos de VERIFICAR_TRAMO, sin recorrerlo antes. Cada hilo toma tramos de un contador
+ * compartido y comprueba el POW de VERIFICAR_LOTE bloques de una vez; los pares que cruzan
+ * de un tramo a otro se comprueban al final. Se informa del primer bloque que falla en el
+ * orden del libro y los tramos posteriores a uno con fallo ya no se verifican.
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bloque.h"
+#include "libro.h"
+#include "pow.h"
+
+#define VERIFICAR_TRAMO 65536 /* Ids por tramo de trabajo */
+#define VERIFICAR_LOTE 1024 /* Bloques cuyo POW se comprueba de una vez */
+#define VERIFICAR_MAX_HILOS 256 /* Hilos como mucho */
+#define TABLA_CARTERAS 4096 /* Casillas de la tabla de carteras: potencia de dos, más del doble de BLOQUE_MAX_CARTERAS */
+#define SIN_FALLO UINT64_MAX /* Desplazamiento de un fallo que no ha ocurrido */
+
+/**
+ * @brief Primer fallo encontrado, por su posición en el libro.
+ */
+typedef struct {
+    uint64_t desplazamiento; /**< Registro del bloque que falla, o SIN_FALLO */
+    int id;                  /**< Id del bloque que falla */
+    const char *motivo;      /**< Invariante que no se cumple */
+} Fallo;
+
+/**
+ * @brief Registros [inicio, fin) del libro que verifica un hilo.
+ */
+typedef struct {
+    uint64_t inicio;  /**< Primer registro del tramo */
+    uint64_t fin;     /**< Primer registro del tramo siguiente, o el final del libro */
+    uint64_t ultimo;  /**< Último registro del tramo, para comprobar el paso al siguiente */
+    uint64_t bloques; /**< Bloques verificados */
+    Fallo fallo;      /**< Primer fallo del tramo */
+} Tramo;
+
+/**
+ * @brief Trabajo compartido por los hilos.
+ */
+typedef struct {
+    const LibroLectura *libro;
+    Tramo *tramos;
+    size_t n_tramos;
+    _Atomic size_t siguiente;     /**< Próximo tramo sin repartir */
+    _Atomic size_t tramo_fallido; /**< Primer tramo con fallo, o n_tramos */
+} Verificacion;
+
+/**
+ * @brief Carteras de un bloque indexadas por pid; `generacion` vacía la tabla en O(1).
+ */
+typedef struct {
+    pid_t pid[TABLA_CARTERAS];
+    int monedas[TABLA_CARTERAS];
+    uint32_t marca[TABLA_CARTERAS];
+    uint32_t generacion;
+} TablaCarteras;
+
+/**
+ * @brief Bloques pendientes de comprobar su POW.
+ */
+typedef struct {
+    long int soluciones[VERIFICAR_LOTE];
+    long int objetivos[VERIFICAR_LOTE];
+    long int hashes[VERIFICAR_LOTE];
+    bool correctos[VERIFICAR_LOTE];
+    uint64_t desplazamientos[VERIFICAR_LOTE];
+    int ids[VERIFICAR_LOTE];
+    int n;
+} LotePow;
+
+static void fallar(Fallo *fallo, uint64_t desplazamiento, int id, const char *motivo) {
+    if (desplazamiento < fallo->desplazamiento) {
+        fallo->desplazamiento = desplazamiento;
+        fallo->id = id;
+        fallo->motivo = motivo;
+    }
+}
+
+static uint32_t casilla_de(pid_t pid) {
+    return (((uint32_t)pid * 2654435761u) >> 20) & (TABLA_CARTERAS - 1);
+}
+
+/**
+ * @brief Sustituye el contenido de la tabla por las carteras de un bloque.
+ */
+static void tabla_llenar(TablaCarteras *tabla, const Monedas *carteras, int n) {
+    uint32_t i;
+
+    if (++tabla->generacion == 0) {
+        memset(tabla->marca, 0, sizeof(tabla->marca));
+        tabla->generacion = 1;
+    }
+    for (int j = 0; j < n; j++) {
+        /* Las casillas que se vaciaban al salir un minero no son carteras */
+        if (carteras[j].pid <= 0 || carteras[j].monedas < 0) {
+            continue;
+        }
+        for (i = casilla_de(carteras[j].pid); tabla->marca[i] == tabla->generacion && tabla->pid[i] != carteras[j].pid;
+             i = (i + 1) & (TABLA_CARTERAS - 1))
+            ;
+        tabla->pid[i] = carteras[j].pid;
+        tabla->monedas[i] = carteras[j].monedas;
+        tabla->marca[i] = tabla->generacion;
+    }
+}
+
+/**
+ * @brief Monedas de un pid en la tabla, o -1 si no estaba.
+ */
+static int tabla_buscar(const TablaCarteras *tabla, pid_t pid) {
+    uint32_t i;
+
+    for (i = casilla_de(pid); tabla->marca[i] == tabla->generacion; i = (i + 1) & (TABLA_CARTERAS - 1)) {
+        if (tabla->pid[i] == pid) {
+            return tabla->monedas[i];
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Invariantes de un bloque solo, salvo el POW, que va por lotes.
+ *
+ * @return El motivo del fallo, o NULL si se cumplen.
+ */
+static const char *comprobar_bloque(const CabeceraBloque *bloque) {
+    if (bloque->votos_positivos < 0 || bloque->votos_positivos > bloque->total_votos) {
+        return "more votes in favour than votes cast";
+    }
+    return NULL;
+}
+
+/**
+ * @brief Invariantes entre un bloque y el anterior del libro.
+ *
+ * @param anterior Bloque anterior.
+ * @param tabla Carteras del bloque anterior.
+ * @param bloque Bloque actual.
+ * @param carteras Carteras del bloque actual.
+ * @param n Número de carteras.
+ * @return El motivo del fallo, o NULL si se cumplen.
+ */
+static const char *comprobar_par(const CabeceraBloque *anterior, const TablaCarteras *tabla,
+                                 const CabeceraBloque *bloque, const Monedas *carteras, int n) {
+    int antes, diferencia;
+
+    if (bloque->id != anterior->id + 1) {
+        /* Solo una red nueva puede volver a empezar */
+        return bloque->id == 1 ? NULL : "block ids are not consecutive";
+    }
+    if (bloque->objetivo != anterior->solucion) {
+        return "target is not the solution of the previous block";
+    }
+    for (int j = 0; j < n; j++) {
+        if (carteras[j].pid <= 0 || carteras[j].monedas < 0 || (antes = tabla_buscar(tabla, carteras[j].pid)) == -1) {
+            continue;
+        }
+        diferencia = carteras[j].monedas - antes;
+        if (diferencia < 0) {
+            return "a wallet lost coins";
+        }
+        if (diferencia > 0 && (carteras[j].pid != bloque->ganador || diferencia > 1)) {
+            return "a wallet gained coins without winning the block";
+        }
+        if (diferencia > 0 && 2 * bloque->votos_positivos <= bloque->total_votos) {
+            return "the winner got a coin without a majority of votes";
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Comprueba el POW de los bloques pendientes de una vez.
+ *
+ * @return true si todos lo cumplen.
+ */
+static bool vaciar_lote(LotePow *lote, Fallo *fallo) {
+    int n = lote->n;
+
+    lote->n = 0;
+    pow_hash_list(lote->soluciones, n, lote->hashes);
+    for (int i = 0; i < n; i++) {
+        if (lote->hashes[i] != lote->objetivos[i]) {
+            fallar(fallo, lote->desplazamientos[i], lote->ids[i], "pow_hash(solution) is not the target");
+            return false;
+        }
+        if (!lote->correctos[i]) {
+            fallar(fallo, lote->desplazamientos[i], lote->ids[i], "valid block not marked as validated");
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Verifica los bloques de un tramo, salvo el paso desde el tramo anterior.
+ */
+static void verificar_tramo(const LibroLectura *libro, Tramo *tramo) {
+    static _Thread_local Monedas carteras[BLOQUE_MAX_CARTERAS];
+    static _Thread_local TablaCarteras tabla;
+    static _Thread_local LotePow lote;
+    CabeceraBloque bloque, anterior = {0};
+    uint64_t desplazamiento = tramo->inicio, registro;
+    const char *motivo;
+    const void *datos;
+    size_t bytes;
+    int id, formato, n;
+    bool primero = true;
+
+    lote.n = 0;
+    tramo->fallo.desplazamiento = SIN_FALLO;
+    while (desplazamiento < tramo->fin) {
+        registro = desplazamiento;
+        if (!(datos = libro_siguiente(libro, &desplazamiento, &id, &bytes))) {
+            fallar(&tramo->fallo, registro, 0, "damaged record");
+            break;
+        }
+        if ((n = bloque_decodificar(datos, bytes, &bloque, &formato, carteras)) == -1 || formato != BLOQUE_COMPLETO ||
+            bloque.id != id) {
+            fallar(&tramo->fallo, registro, id, "malformed block");
+            break;
+        }
+        motivo = comprobar_bloque(&bloque);
+        if (!motivo && !primero) {
+            motivo = comprobar_par(&anterior, &tabla, &bloque, carteras, n);
+        }
+        if (motivo) {
+            fallar(&tramo->fallo, registro, id, motivo);
+            break;
+        }
+        tabla_llenar(&tabla, carteras, n);
+        anterior = bloque;
+        primero = false;
+        tramo->ultimo = registro;
+        tramo->bloques++;
+
+        lote.soluciones[lote.n] = bloque.solucion;
+        lote.objetivos[lote.n] = bloque.objetivo;
+        lote.correctos[lote.n] = bloque.correcto;
+        lote.desplazamientos[lote.n] = registro;
+        lote.ids[lote.n] = id;
+        if (++lote.n == VERIFICAR_LOTE && !vaciar_lote(&lote, &tramo->fallo)) {
+            return;
+        }
+    }
+    /* Un fallo de POW anterior en el lote va antes que el que ha cortado el recorrido */
+    vaciar_lote(&lote, &tramo->fallo);
+}
+
+static void *hilo_verificador(void *arg) {
+    Verificacion *verificacion = (Verificacion *)arg;
+    size_t t, fallido;
+
+    while ((t = atomic_fetch_add(&verificacion->siguiente, 1)) < verificacion->n_tramos) {
+        /* Un fallo en un tramo anterior ya es el primero: este no hace falta */
+        if (t > atomic_load(&verificacion->tramo_fallido)) {
+            continue;
+        }
+        verificar_tramo(verificacion->libro, &verificacion->tramos[t]);
+        if (verificacion->tramos[t].fallo.desplazamiento == SIN_FALLO) {
+            continue;
+        }
+        fallido = atomic_load(&verificacion->tramo_fallido);
+        while (t < fallido && !atomic_compare_exchange_weak(&verificacion->tramo_fallido, &fallido, t))
+            ;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Comprueba el paso del último bloque de un tramo al primero del siguiente.
+ */
+static void verificar_paso(const LibroLectura *libro, const Tramo *previo, const Tramo *tramo, Fallo *fallo) {
+    static Monedas carteras[BLOQUE_MAX_CARTERAS];
+    static TablaCarteras tabla;
+    CabeceraBloque anterior, bloque;
+    uint64_t desplazamiento = previo->ultimo;
+    const char *motivo;
+    const void *datos;
+    size_t bytes;
+    int id, formato, n;
+
+    datos = libro_siguiente(libro, &desplazamiento, &id, &bytes);
+    n = bloque_decodificar(datos, bytes, &anterior, &formato, carteras);
+    tabla_llenar(&tabla, carteras, n);
+    desplazamiento = tramo->inicio;
+    /* Un primer registro dañado ya lo ha anotado el hilo que verificó el tramo */
+    if (!(datos = libro_siguiente(libro, &desplazamiento, &id, &bytes)) ||
+        (n = bloque_decodificar(datos, bytes, &bloque, &formato, carteras)) == -1) {
+        return;
+    }
+    if ((motivo = comprobar_par(&anterior, &tabla, &bloque, carteras, n))) {
+        fallar(fallo, tramo->inicio, bloque.id, motivo);
+    }
+}
+
+static int comparar_desplazamientos(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Parte el libro en tramos a partir de los registros que da el índice.
+ *
+ * @return Número de tramos, o 0 si no hay memoria.
+ */
+static size_t partir(const LibroLectura *libro, Tramo **tramos) {
+    size_t maximo = 2 + libro->ids / VERIFICAR_TRAMO, n = 0, unicos = 0;
+    uint64_t *inicios = malloc(maximo * sizeof(uint64_t));
+    const unsigned char *datos;
+    size_t bytes;
+
+    if (!inicios) {
+        return 0;
+    }
+    inicios[n++] = sizeof(CabeceraLibro);
+    for (uint64_t id = VERIFICAR_TRAMO; id < libro->ids; id += VERIFICAR_TRAMO) {
+        if ((datos = libro_buscar(libro, (int)id, &bytes))) {
+            inicios[n++] = (uint64_t)(datos - libro->mapa) - sizeof(CabeceraRegistro);
+        }
+    }
+    /* Con varias redes en el libro los ids repetidos no siguen el orden de los registros */
+    qsort(inicios, n, sizeof(uint64_t), comparar_desplazamientos);
+    if (!(*tramos = calloc(n, sizeof(Tramo)))) {
+        free(inicios);
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (i > 0 && inicios[i] == inicios[i - 1]) {
+            continue;
+        }
+        (*tramos)[unicos++].inicio = inicios[i];
+    }
+    for (size_t i = 0; i < unicos; i++) {
+        (*tramos)[i].fin = (i + 1 < unicos) ? (*tramos)[i + 1].inicio : libro->tamano;
+        (*tramos)[i].fallo.desplazamiento = SIN_FALLO;
+    }
+    free(inicios);
+    return unicos;
+}
+
+int main(int argc, char const *argv[]) {
+    pthread_t hilos[VERIFICAR_MAX_HILOS];
+    struct timespec antes, despues;
+    Verificacion verificacion;
+    LibroLectura libro;
+    Fallo fallo = {SIN_FALLO, 0, NULL};
+    uint64_t bloques = 0;
+    size_t fallido;
+    double ms;
+    long n_hilos = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (argc < 2 || argc > 3) {
+        printf("Uso: %s <libro> [hilos]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (argc == 3) {
+        n_hilos = atol(argv[2]);
+    }
+    if (n_hilos < 1) {
+        n_hilos = 1;
+    } else if (n_hilos > VERIFICAR_MAX_HILOS) {
+        n_hilos = VERIFICAR_MAX_HILOS;
+    }
+    if (libro_leer(&libro, argv[1]) != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &antes);
+    verificacion.libro = &libro;
+    if ((verificacion.n_tramos = partir(&libro, &verificacion.tramos)) == 0) {
+        perror("malloc");
+        libro_soltar(&libro);
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&verificacion.siguiente, 0);
+    atomic_init(&verificacion.tramo_fallido, verificacion.n_tramos);
+    if ((size_t)n_hilos > verificacion.n_tramos) {
+        n_hilos = (long)verificacion.n_tramos;
+    }
+    for (long i = 0; i < n_hilos; i++) {
+        if (pthread_create(&hilos[i], NULL, hilo_verificador, &verificacion) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (long i = 0; i < n_hilos; i++) {
+        pthread_join(hilos[i], NULL);
+    }
+
+    /* Los tramos anteriores al primero con fallo están enteros: falta el paso entre ellos */
+    fallido = atomic_load(&verificacion.tramo_fallido);
+    for (size_t t = 1; t < verificacion.n_tramos && t <= fallido && fallo.desplazamiento == SIN_FALLO; t++) {
+        verificar_paso(&libro, &verificacion.tramos[t - 1], &verificacion.tramos[t], &fallo);
+    }
+    if (fallo.desplazamiento == SIN_FALLO && fallido < verificacion.n_tramos) {
+        fallo = verificacion.tramos[fallido].fallo;
+    }
+    for (size_t t = 0; t < verificacion.n_tramos; t++) {
+        bloques += verificacion.tramos[t].bloques;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &despues);
+    ms = (despues.tv_sec - antes.tv_sec) * 1e3 + (despues.tv_nsec - antes.tv_nsec) / 1e6;
+
+    printf("[%d] Ledger %s: %llu blocks checked in %.1f ms with %ld threads (%.1f M blocks/s)\n", getpid(), argv[1],
+           (unsigned long long)bloques, ms, n_hilos, ms > 0 ? bloques / ms / 1e3 : 0.0);
+    if (fallo.desplazamiento != SIN_FALLO) {
+        printf("[%d] First failing block: id %d at offset %llu: %s\n", getpid(), fallo.id,
+               (unsigned long long)fallo.desplazamiento, fallo.motivo);
+    } else {
+        printf("[%d] Chain verified: no failing block\n", getpid());
+    }
+    free(verificacion.tramos);
+    libro_soltar(&libro);
+    exit(fallo.desplazamiento == SIN_FALLO ? EXIT_SUCCESS : EXIT_FAILURE);
+}
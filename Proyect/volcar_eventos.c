@@ -0,0 +1,234 @@
+/**
+ * @file volcar_eventos.c
+ * @brief Herramienta que mezcla los registros de eventos de varios procesos en una traza de Chrome.
+ *
+ * Uso: ./volcar_eventos [--salida <fichero.json>] <eventos.pid.bin>...
+ *
+ * Lee los ficheros que dejan el minero y el monitor con --eventos, también los de procesos
+ * que murieron o siguen en marcha, ordena todos los eventos por su instante y escribe el
+ * formato JSON de Chrome (chrome://tracing o Perfetto): un proceso por fichero, un evento
+ * instantáneo por cada evento y, en los mineros, una franja por ronda que va de un despertar
+ * al siguiente. Los instantes son microsegundos desde el primer evento.
+ *
+ * Un evento sobrescrito por la vuelta del anillo, o que se quedó a medio escribir, no se
+ * vuelca; cuántos hay se indica por la salida de error.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "eventos.h"
+
+/* Nombre de cada evento en la traza, en el orden de TipoEvento */
+static const char *nombres_evento[EVENTOS] = {
+    "round-open", "wake", "signal", "solution", "vote", "votes-decided", "send", "validated", "printed"
+};
+
+/* Nombre de cada papel, en el orden de RolEventos */
+static const char *nombres_rol[] = {"miner", "checker", "monitor"};
+
+/**
+ * @brief Un evento leído, con el fichero del que viene.
+ */
+typedef struct {
+    uint64_t instante_ns;
+    int64_t dato;
+    int32_t ronda;
+    uint32_t tipo;
+    int fichero;
+} Suceso;
+
+/**
+ * @brief Un fichero de eventos abierto.
+ */
+typedef struct {
+    const CabeceraEventos *cabecera;
+    size_t tamano;
+    int despertar; /* Suceso del último despertar todavía sin franja, o -1 */
+} Fichero;
+
+static int comparar_sucesos(const void *a, const void *b) {
+    const Suceso *x = (const Suceso *)a, *y = (const Suceso *)b;
+
+    if (x->instante_ns != y->instante_ns) {
+        return x->instante_ns < y->instante_ns ? -1 : 1;
+    }
+    return x->fichero - y->fichero;
+}
+
+/**
+ * @brief Proyecta un fichero de eventos y comprueba su cabecera.
+ *
+ * @return 0 si todo va bien, -1 si no se puede leer o no es un registro de esta versión.
+ */
+static int abrir_fichero(const char *ruta, Fichero *fichero) {
+    struct stat info;
+    int fd;
+
+    if ((fd = open(ruta, O_RDONLY)) == -1) {
+        perror(ruta);
+        return -1;
+    }
+    if (fstat(fd, &info) == -1 || (size_t)info.st_size != EVENTOS_TAMANO) {
+        fprintf(stderr, "%s no es un registro de eventos de la versión %d\n", ruta, EVENTOS_VERSION);
+        close(fd);
+        return -1;
+    }
+    fichero->tamano = EVENTOS_TAMANO;
+    fichero->cabecera = mmap(NULL, fichero->tamano, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (fichero->cabecera == MAP_FAILED) {
+        perror("mmap eventos");
+        return -1;
+    }
+    if (memcmp(fichero->cabecera->magia, EVENTOS_MAGIA, sizeof(fichero->cabecera->magia)) != 0 ||
+        fichero->cabecera->version != EVENTOS_VERSION || fichero->cabecera->capacidad != EVENTOS_CAPACIDAD ||
+        fichero->cabecera->rol > EVENTOS_MONITOR) {
+        fprintf(stderr, "%s no es un registro de eventos de la versión %d\n", ruta, EVENTOS_VERSION);
+        munmap((void *)fichero->cabecera, fichero->tamano);
+        return -1;
+    }
+    fichero->despertar = -1;
+    return 0;
+}
+
+/**
+ * @brief Copia los eventos completos del anillo de un fichero.
+ *
+ * @return Eventos copiados.
+ */
+static size_t leer_fichero(const Fichero *fichero, int indice, Suceso *sucesos, uint64_t *perdidos,
+                           uint64_t *incompletos) {
+    const Evento *anillo = (const Evento *)(fichero->cabecera + 1);
+    uint64_t siguiente = atomic_load(&fichero->cabecera->siguiente), primero;
+    const Evento *evento;
+    size_t n = 0;
+
+    primero = siguiente > EVENTOS_CAPACIDAD ? siguiente - EVENTOS_CAPACIDAD : 0;
+    *perdidos += primero;
+    for (uint64_t k = primero; k < siguiente; k++) {
+        evento = &anillo[k & (EVENTOS_CAPACIDAD - 1)];
+        /* Solo vale si lleva el número de su posición: si no, está a medio escribir */
+        if (atomic_load_explicit(&evento->numero, memory_order_acquire) != k + 1 || evento->tipo >= EVENTOS) {
+            (*incompletos)++;
+            continue;
+        }
+        sucesos[n].instante_ns = evento->instante_ns;
+        sucesos[n].tipo = evento->tipo;
+        sucesos[n].ronda = evento->ronda;
+        sucesos[n].dato = evento->dato;
+        sucesos[n].fichero = indice;
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief Escribe la franja de una ronda de un minero, de su despertar a hasta_ns.
+ */
+static void escribir_franja(FILE *salida, const Suceso *despertar, pid_t pid, uint64_t base, uint64_t hasta_ns) {
+    fprintf(salida, ",\n{\"name\":\"round %d\",\"cat\":\"round\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"pid\":%d,\"tid\":%d,\"args\":{\"round\":%d}}",
+            despertar->ronda, (despertar->instante_ns - base) / 1e3, (hasta_ns - despertar->instante_ns) / 1e3, pid,
+            pid, despertar->ronda);
+}
+
+int main(int argc, char const *argv[]) {
+    const char *ruta_salida = NULL;
+    Fichero *ficheros;
+    Suceso *sucesos;
+    FILE *salida = stdout;
+    uint64_t perdidos = 0, incompletos = 0, base, ultimo;
+    size_t n = 0;
+    int n_ficheros = 0;
+    pid_t pid;
+
+    ficheros = calloc((size_t)argc, sizeof(Fichero));
+    if (!ficheros) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--salida") == 0 && i + 1 < argc) {
+            ruta_salida = argv[++i];
+        } else if (argv[i][0] == '-') {
+            n_ficheros = 0;
+            break;
+        } else if (abrir_fichero(argv[i], &ficheros[n_ficheros]) == 0) {
+            n_ficheros++;
+        }
+    }
+    if (n_ficheros == 0) {
+        fprintf(stderr, "Uso: %s [--salida <fichero.json>] <eventos.pid.bin>...\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    sucesos = malloc((size_t)n_ficheros * EVENTOS_CAPACIDAD * sizeof(Suceso));
+    if (!sucesos) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int f = 0; f < n_ficheros; f++) {
+        n += leer_fichero(&ficheros[f], f, sucesos + n, &perdidos, &incompletos);
+    }
+    qsort(sucesos, n, sizeof(Suceso), comparar_sucesos);
+    if (ruta_salida && (salida = fopen(ruta_salida, "w")) == NULL) {
+        perror(ruta_salida);
+        exit(EXIT_FAILURE);
+    }
+
+    base = n ? sucesos[0].instante_ns : 0;
+    fprintf(salida, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (int f = 0; f < n_ficheros; f++) {
+        pid = ficheros[f].cabecera->pid;
+        fprintf(salida, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                f ? ",\n" : "", pid, pid, nombres_rol[ficheros[f].cabecera->rol], pid);
+    }
+    for (size_t i = 0; i < n; i++) {
+        Fichero *fichero = &ficheros[sucesos[i].fichero];
+
+        pid = fichero->cabecera->pid;
+        fprintf(salida, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,"
+                        "\"args\":{\"round\":%d,\"value\":%lld}}",
+                nombres_evento[sucesos[i].tipo], nombres_rol[fichero->cabecera->rol],
+                (sucesos[i].instante_ns - base) / 1e3, pid, pid, sucesos[i].ronda, (long long)sucesos[i].dato);
+        if (sucesos[i].tipo == EVENTO_DESPERTAR) {
+            if (fichero->despertar != -1) {
+                escribir_franja(salida, &sucesos[fichero->despertar], pid, base, sucesos[i].instante_ns);
+            }
+            fichero->despertar = (int)i;
+        }
+    }
+    /* La última ronda de cada minero acaba en su último evento */
+    for (int f = 0; f < n_ficheros; f++) {
+        if (ficheros[f].despertar == -1) {
+            continue;
+        }
+        ultimo = sucesos[ficheros[f].despertar].instante_ns;
+        for (size_t i = (size_t)ficheros[f].despertar; i < n; i++) {
+            if (sucesos[i].fichero == f) {
+                ultimo = sucesos[i].instante_ns;
+            }
+        }
+        escribir_franja(salida, &sucesos[ficheros[f].despertar], ficheros[f].cabecera->pid, base, ultimo);
+    }
+    fprintf(salida, "\n]}\n");
+    if (salida != stdout) {
+        fclose(salida);
+    }
+
+    fprintf(stderr, "[%d] %zu events from %d processes over %.3f ms (%llu overwritten, %llu incomplete)\n", getpid(),
+            n, n_ficheros, n ? (sucesos[n - 1].instante_ns - base) / 1e6 : 0.0, (unsigned long long)perdidos,
+            (unsigned long long)incompletos);
+    for (int f = 0; f < n_ficheros; f++) {
+        munmap((void *)ficheros[f].cabecera, ficheros[f].tamano);
+    }
+    free(sucesos);
+    free(ficheros);
+    exit(EXIT_SUCCESS);
+}
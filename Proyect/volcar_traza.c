@@ -0,0 +1,180 @@
+/**
+ * @file volcar_traza.c
+ * @brief Herramienta que muestra los histogramas de latencia por fase de la traza de rondas.
+ *
+ * Uso: ./volcar_traza [--rondas <n>] [--borrar]
+ *
+ * Suma los histogramas de todas las casillas del segmento (y los de los procesos retirados)
+ * y muestra por fase el número de muestras, la media, los percentiles 50, 90, 99 y 99.9 y el
+ * máximo. Los percentiles salen del punto medio de su cubeta, así que llevan el error
+ * relativo de la cubeta. Se puede lanzar en cualquier momento, también con la red en marcha.
+ *
+ * Con --rondas muestra además las marcas de las últimas rondas, relativas a su apertura.
+ * Con --borrar elimina el segmento después de volcarlo, para empezar de cero.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "traza.h"
+
+/* Nombre de cada marca en el volcado, en el orden de MarcaTraza */
+static const char *nombres_marca[MARCAS] = {
+    "round", "solution", "semaphore", "vote-open", "votes", "send", "checked", "printed"
+};
+
+/**
+ * @brief Histograma de una fase sumado sobre todos los procesos.
+ */
+typedef struct {
+    uint64_t cuenta;
+    uint64_t suma;
+    uint64_t maximo;
+    uint64_t cubetas[TRAZA_CUBETAS];
+} Acumulado;
+
+/**
+ * @brief Suma un histograma compartido al acumulado.
+ */
+static void acumular(Acumulado *acumulado, const HistogramaTraza *histograma) {
+    uint64_t maximo;
+
+    /* La cuenta se lee primero: sus muestras ya tienen la cubeta anotada */
+    acumulado->cuenta += atomic_load_explicit(&histograma->cuenta, memory_order_acquire);
+    acumulado->suma += atomic_load_explicit(&histograma->suma, memory_order_relaxed);
+    maximo = atomic_load_explicit(&histograma->maximo, memory_order_relaxed);
+    if (maximo > acumulado->maximo) {
+        acumulado->maximo = maximo;
+    }
+    for (int c = 0; c < TRAZA_CUBETAS; c++) {
+        acumulado->cubetas[c] += atomic_load_explicit(&histograma->cubetas[c], memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Percentil de un histograma acumulado, en microsegundos.
+ *
+ * @param acumulado Histograma acumulado.
+ * @param q Fracción de las muestras que queda por debajo, entre 0 y 1.
+ * @return Punto medio de la cubeta del percentil, sin pasar del máximo.
+ */
+static double percentil(const Acumulado *acumulado, double q) {
+    uint64_t total = 0, visto = 0, objetivo, medio;
+
+    for (int c = 0; c < TRAZA_CUBETAS; c++) {
+        total += acumulado->cubetas[c];
+    }
+    if (total == 0) {
+        return 0.0;
+    }
+    objetivo = (uint64_t)(q * (double)total + 0.999999);
+    if (objetivo == 0) {
+        objetivo = 1;
+    }
+    for (int c = 0; c < TRAZA_CUBETAS; c++) {
+        visto += acumulado->cubetas[c];
+        if (visto >= objetivo) {
+            medio = c + 1 < TRAZA_CUBETAS
+                        ? (traza_cubeta_inicio(c) + traza_cubeta_inicio(c + 1) - 1) / 2
+                        : traza_cubeta_inicio(c);
+            return (medio < acumulado->maximo ? medio : acumulado->maximo) / 1e3;
+        }
+    }
+    return acumulado->maximo / 1e3;
+}
+
+/**
+ * @brief Muestra las marcas de las últimas rondas, en microsegundos desde su apertura.
+ */
+static void volcar_rondas(const SegmentoTraza *segmento, int n) {
+    const RondaTraza *ronda;
+    int ultima = 0, id;
+    uint64_t apertura, marca;
+
+    /* La ronda más reciente es la de mayor id con marca de apertura */
+    for (int r = 0; r < TRAZA_RONDAS; r++) {
+        id = atomic_load(&segmento->rondas[r].id);
+        if (id > ultima && atomic_load(&segmento->rondas[r].marcas[MARCA_RONDA])) {
+            ultima = id;
+        }
+    }
+    printf("\n%8s", "block");
+    for (int m = 1; m < MARCAS; m++) {
+        printf(" %12s", nombres_marca[m]);
+    }
+    printf("\n");
+    for (int b = ultima - n + 1 > 1 ? ultima - n + 1 : 1; b <= ultima; b++) {
+        ronda = &segmento->rondas[b & (TRAZA_RONDAS - 1)];
+        apertura = atomic_load(&ronda->marcas[MARCA_RONDA]);
+        if (atomic_load(&ronda->id) != b || apertura == 0) {
+            continue;
+        }
+        printf("%8d", b);
+        for (int m = 1; m < MARCAS; m++) {
+            marca = atomic_load(&ronda->marcas[m]);
+            if (marca >= apertura) {
+                printf(" %12.1f", (marca - apertura) / 1e3);
+            } else {
+                printf(" %12s", "-");
+            }
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char const *argv[]) {
+    static Acumulado fases[FASES];
+    const SegmentoTraza *segmento;
+    bool borrar = false;
+    int rondas = 0, procesos = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--borrar") == 0) {
+            borrar = true;
+        } else if (strcmp(argv[i], "--rondas") == 0 && i + 1 < argc) {
+            rondas = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Uso: %s [--rondas <n>] [--borrar]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (traza_leer(&segmento) != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    for (int f = 0; f < FASES; f++) {
+        acumular(&fases[f], &segmento->retirados[f]);
+    }
+    for (int p = 0; p < TRAZA_PROCESOS; p++) {
+        if (atomic_load(&segmento->procesos[p].pid) == 0) {
+            continue;
+        }
+        procesos++;
+        for (int f = 0; f < FASES; f++) {
+            acumular(&fases[f], &segmento->procesos[p].fases[f]);
+        }
+    }
+
+    printf("[%d] Round trace from %d processes (latencies in us)\n", getpid(), procesos);
+    printf("%-10s %10s %12s %12s %12s %12s %12s %12s\n", "phase", "samples", "mean", "p50", "p90", "p99", "p99.9", "max");
+    for (int f = 0; f < FASES; f++) {
+        printf("%-10s %10llu %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f\n", traza_nombres_fase[f],
+               (unsigned long long)fases[f].cuenta,
+               fases[f].cuenta ? (double)fases[f].suma / (double)fases[f].cuenta / 1e3 : 0.0,
+               percentil(&fases[f], 0.50), percentil(&fases[f], 0.90), percentil(&fases[f], 0.99),
+               percentil(&fases[f], 0.999), fases[f].maximo / 1e3);
+    }
+    if (rondas > 0) {
+        volcar_rondas(segmento, rondas);
+    }
+
+    munmap((void *)segmento, sizeof(SegmentoTraza));
+    if (borrar) {
+        shm_unlink(SHM_NAME_TRAZA);
+    }
+    exit(EXIT_SUCCESS);
+}